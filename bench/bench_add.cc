@@ -0,0 +1,119 @@
+// Add throughput of MapBloom as the number of writer processes grows,
+// racy byte |= path against the atomic word path (atomic_add).
+//
+// usage: bench_add [-d dir] [-p max_procs] [-u users] [-n adds_per_proc]
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "map_bloom.h"
+#include "hash.h"
+#include "bench_util.h"
+
+using namespace std;
+using namespace srec;
+
+static string vid_of(int proc, int i)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%d_%d", proc, i);
+
+    return string(buf);
+}
+
+static void run(const string &dir, bool atomic_add, int procs, 
+    int users, int adds)
+{
+    string fname = dir + "/bench_add.bloom";
+    unlink(fname.c_str());
+
+    MapBloom bloom;
+    if (!bloom.Init(users, 500, 0.01, hDouble, lBlocked, fname)) 
+    {
+        fprintf(stderr, "init %s failed\n", fname.c_str());
+
+        return;
+    }
+    bloom.SetAtomicAdd(atomic_add);
+    bloom.SetDelete(true);
+
+    int64_t slot_size = bloom.GetBitNum() / 8;
+    int hash_num = bloom.GetHashNum();
+
+    double start = bench_ms();
+    for (int p = 0; p < procs; p++) 
+    {
+        if (0 == fork()) 
+        {
+            vector<int64_t> hashs;
+            for (int i = 0; i < adds; i++) 
+            {
+                hashs.clear();
+                Hash::CalcHash(vid_of(p, i), hDouble, hash_num, hashs);
+                bloom.Add((i % users) * slot_size, hashs);
+            }
+
+            _exit(0);
+        }
+    }
+
+    for (int p = 0; p < procs; p++) 
+    {
+        wait(NULL);
+    }
+    double cost = bench_ms() - start;
+
+    // every vid that doesn't come back lost at least one bit to a race
+    int64_t lost = 0;
+    vector<int64_t> hashs;
+    for (int p = 0; p < procs; p++) 
+    {
+        for (int i = 0; i < adds; i++) 
+        {
+            hashs.clear();
+            Hash::CalcHash(vid_of(p, i), hDouble, hash_num, hashs);
+            if (!bloom.Lookup((i % users) * slot_size, hashs)) 
+            {
+                lost++;
+            }
+        }
+    }
+
+    printf("%-7s procs=%-3d adds/s=%-12.0f lost=%ld\n", 
+        atomic_add ? "atomic" : "racy", procs, 
+        (double)procs * adds / cost * 1000, lost);
+}
+
+int main(int argc, char **argv)
+{
+    string dir = "/tmp";
+    int max_procs = 16;
+    int users = 64;
+    int adds = 1000000;
+
+    int opt = 0;
+    while (-1 != (opt = getopt(argc, argv, "d:p:u:n:"))) 
+    {
+        switch (opt) 
+        {
+        case 'd': dir = optarg; break;
+        case 'p': max_procs = atoi(optarg); break;
+        case 'u': users = atoi(optarg); break;
+        case 'n': adds = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-d dir] [-p max_procs] [-u users] "
+                "[-n adds_per_proc]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    for (int procs = 1; procs <= max_procs; procs *= 2) 
+    {
+        run(dir, false, procs, users, adds);
+        run(dir, true, procs, users, adds);
+    }
+
+    return 0;
+}
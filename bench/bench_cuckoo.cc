@@ -0,0 +1,144 @@
+// MapBloom slots against the cuckoo slots of "layout" : 2 at the same
+// capacity and fail_rate: bytes per vid, the false positive rate seen,
+// and lookup latency for vids of the slot and vids not in it, on slots
+// filled to capacity. The cuckoo slots also time removing the vids that
+// were looked up.
+//
+// usage: bench_cuckoo [-d dir] [-u users] [-c capacity] [-f fail_rate]
+//     [-n lookups]
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "map_bloom.h"
+#include "hash.h"
+#include "bench_util.h"
+
+using namespace std;
+using namespace srec;
+
+static void run(const string &dir, int layout, int64_t users,
+    int64_t capacity, double fail_rate, int64_t lookups)
+{
+    const char *names[] = {"standard", "blocked", "cuckoo"};
+    string fname = dir + "/bench_cuckoo.bloom";
+    unlink(fname.c_str());
+
+    MapBloom bloom;
+    if (!bloom.Init(users, capacity, fail_rate, hDouble, layout, fname))
+    {
+        fprintf(stderr, "init %s failed\n", fname.c_str());
+
+        return;
+    }
+    bloom.SetDelete(true);
+    bloom.StopFlush();
+
+    int64_t slot_size = bloom.GetBitNum() / 8;
+    int hash_num = bloom.GetHashNum();
+    vector<int64_t> hashs;
+    // two int64 values, the separator and the NUL
+    char vid[48];
+
+    // vid i of slot s is "s_i"
+    int64_t failed = 0;
+    double start = bench_ms();
+    for (int64_t s = 0; s < users; s++)
+    {
+        for (int64_t i = 0; i < capacity; i++)
+        {
+            snprintf(vid, sizeof(vid), "%ld_%ld", s, i);
+            hashs.clear();
+            Hash::CalcHash(vid, hDouble, hash_num, hashs);
+            failed += bloom.Add(s * slot_size, hashs) ? 0 : 1;
+        }
+    }
+    double fill = bench_ms() - start;
+
+    // hashed up front, the times are those of the slots
+    uint64_t seed = 88172645463325252ULL;
+    vector<int64_t> slots(65536);
+    vector<vector<int64_t> > in(slots.size());
+    vector<vector<int64_t> > out(slots.size());
+    for (size_t j = 0; j < slots.size(); j++)
+    {
+        slots[j] = next_rand(seed) % users;
+        snprintf(vid, sizeof(vid), "%ld_%ld", slots[j],
+            (int64_t)(next_rand(seed) % capacity));
+        Hash::CalcHash(vid, hDouble, hash_num, in[j]);
+        snprintf(vid, sizeof(vid), "none_%zu", j);
+        Hash::CalcHash(vid, hDouble, hash_num, out[j]);
+    }
+
+    int64_t hits = 0;
+    start = bench_ms();
+    for (int64_t i = 0; i < lookups; i++)
+    {
+        size_t j = i % slots.size();
+        hits += bloom.Lookup(slots[j] * slot_size, in[j]);
+    }
+    double in_cost = bench_ms() - start;
+
+    int64_t false_hits = 0;
+    start = bench_ms();
+    for (int64_t i = 0; i < lookups; i++)
+    {
+        size_t j = i % slots.size();
+        false_hits += bloom.Lookup(slots[(j * 7919) % slots.size()]
+            * slot_size, out[j]);
+    }
+    double out_cost = bench_ms() - start;
+
+    double remove_ns = 0;
+    if (lCuckoo == layout)
+    {
+        start = bench_ms();
+        for (size_t j = 0; j < slots.size(); j++)
+        {
+            bloom.Remove(slots[j] * slot_size, in[j]);
+        }
+        remove_ns = (bench_ms() - start) * 1000000.0 / slots.size();
+    }
+
+    printf("%-8s slot_bytes=%-6ld bits_per_vid=%-6.2f fail_rate=%-8.5f "
+        "ns_in=%-7.1f ns_out=%-7.1f ns_add=%-7.1f ns_remove=%-7.1f "
+        "hits=%ld/%ld add_failed=%ld\n", names[layout], slot_size,
+        slot_size * 8.0 / capacity, (double)false_hits / lookups,
+        in_cost * 1000000.0 / lookups, out_cost * 1000000.0 / lookups,
+        fill * 1000000.0 / (users * capacity), remove_ns, hits, lookups,
+        failed);
+}
+
+int main(int argc, char **argv)
+{
+    string dir = "/tmp";
+    int64_t users = 100000;
+    int64_t capacity = 500;
+    double fail_rate = 0.01;
+    int64_t lookups = 20000000;
+
+    int opt = 0;
+    while (-1 != (opt = getopt(argc, argv, "d:u:c:f:n:")))
+    {
+        switch (opt)
+        {
+        case 'd': dir = optarg; break;
+        case 'u': users = atol(optarg); break;
+        case 'c': capacity = atol(optarg); break;
+        case 'f': fail_rate = atof(optarg); break;
+        case 'n': lookups = atol(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-d dir] [-u users] [-c capacity] "
+                "[-f fail_rate] [-n lookups]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    run(dir, lStandard, users, capacity, fail_rate, lookups);
+    run(dir, lBlocked, users, capacity, fail_rate, lookups);
+    run(dir, lCuckoo, users, capacity, fail_rate, lookups);
+
+    return 0;
+}
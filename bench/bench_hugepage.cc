@@ -0,0 +1,149 @@
+// Lookup latency of MapBloom on 4k pages against huge pages: the plain
+// file mapping, the same with transparent huge pages asked for, and the
+// bloom kept in a hugetlbfs file (-H). Lookups go to random slots with
+// vids that are not in them, as most lookups of a filter do, so the
+// time is that of the memory accesses. Also prints how much of the
+// mapping the kernel did back with huge pages.
+//
+// usage: bench_hugepage [-d dir] [-H hugetlb_dir] [-u users] [-n lookups]
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "map_bloom.h"
+#include "hash.h"
+#include "bench_util.h"
+
+using namespace std;
+using namespace srec;
+
+// kB of huge pages behind the mapping starting at ptr, from smaps
+static int64_t huge_kb(const char *ptr)
+{
+    FILE *fp = fopen("/proc/self/smaps", "r");
+    if (!fp) 
+    {
+        return -1;
+    }
+
+    char line[256];
+    bool in = false;
+    int64_t kb = 0;
+    while (fgets(line, sizeof(line), fp)) 
+    {
+        unsigned long begin = 0;
+        unsigned long end = 0;
+        if (2 == sscanf(line, "%lx-%lx ", &begin, &end)) 
+        {
+            in = (begin == (unsigned long)ptr);
+            continue;
+        }
+
+        int64_t v = 0;
+        char key[64];
+        if (in && 2 == sscanf(line, "%63[^:]: %ld kB", key, &v)
+            && (strstr(key, "PmdMapped") || strstr(key, "Hugetlb")
+                || 0 == strcmp(key, "AnonHugePages"))) 
+        {
+            kb += v;
+        }
+    }
+    fclose(fp);
+
+    return kb;
+}
+
+static void run(const string &dir, int backing, const string &huge_dir,
+    int64_t users, int64_t lookups)
+{
+    const char *names[] = {"page", "thp", "hugetlb"};
+    string fname = dir + "/bench_hugepage.bloom";
+    unlink(fname.c_str());
+
+    MapBloom bloom;
+    bloom.SetBacking(backing, huge_dir);
+    if (!bloom.Init(users, 500, 0.01, hDouble, lBlocked, fname)) 
+    {
+        fprintf(stderr, "init %s failed\n", fname.c_str());
+
+        return;
+    }
+    bloom.SetDelete(true);
+    bloom.StopFlush();
+
+    if (backing != bloom.GetBacking()) 
+    {
+        printf("%-8s not available\n", names[backing]);
+        bloom.UnlinkHuge();
+
+        return;
+    }
+
+    // about half the bits set, a full day's density
+    int64_t slot_size = bloom.GetBitNum() / 8;
+    uint64_t *words = (uint64_t *)bloom.GetMapPtr();
+    uint64_t seed = 88172645463325252ULL;
+    for (int64_t i = 0; i < slot_size * users / 8; i++) 
+    {
+        words[i] = next_rand(seed);
+    }
+
+    vector<vector<int64_t> > hashs(4096);
+    for (size_t i = 0; i < hashs.size(); i++) 
+    {
+        char vid[32];
+        snprintf(vid, sizeof(vid), "vid_%zu", i);
+        Hash::CalcHash(vid, hDouble, bloom.GetHashNum(), hashs[i]);
+    }
+
+    int64_t hits = 0;
+    double start = bench_ms();
+    for (int64_t i = 0; i < lookups; i++) 
+    {
+        int64_t slot = next_rand(seed) % users;
+        hits += bloom.Lookup(slot * slot_size, hashs[i % hashs.size()]);
+    }
+    double cost = bench_ms() - start;
+
+    printf("%-8s slots=%-9ld bytes=%-12ld ns_per_lookup=%-8.1f "
+        "huge_kb=%-10ld hits=%ld\n", names[backing], users,
+        slot_size * users, cost * 1000000.0 / lookups,
+        huge_kb(bloom.GetMapPtr()), hits);
+
+    bloom.UnlinkHuge();
+}
+
+int main(int argc, char **argv)
+{
+    string dir = "/tmp";
+    string huge_dir;
+    int64_t users = 4200000;
+    int64_t lookups = 20000000;
+
+    int opt = 0;
+    while (-1 != (opt = getopt(argc, argv, "d:H:u:n:"))) 
+    {
+        switch (opt) 
+        {
+        case 'd': dir = optarg; break;
+        case 'H': huge_dir = optarg; break;
+        case 'u': users = atol(optarg); break;
+        case 'n': lookups = atol(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-d dir] [-H hugetlb_dir] [-u users] "
+                "[-n lookups]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    run(dir, mPage, huge_dir, users, lookups);
+    run(dir, mThp, huge_dir, users, lookups);
+    if (!huge_dir.empty()) 
+    {
+        run(dir, mHugetlb, huge_dir, users, lookups);
+    }
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+// Time to get one day's uid index ready at startup: rebuilding it from
+// the uids of the .idx_ records, as a day without a usable image does,
+// against opening the checkpointed .uidx_ image, faulted in up front
+// (the written day) or lazily (the closed days).
+//
+// usage: bench_startup [-d dir] [-u users] [-s slots_per_user]
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "uid_index.h"
+#include "bench_util.h"
+
+using namespace std;
+using namespace srec;
+
+static string uid_of(int64_t i)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "uid_%ld", i);
+
+    return string(buf);
+}
+
+static void check(UidIndex &uidx, int64_t users, const char *what)
+{
+    int64_t missing = 0;
+    for (int64_t i = 0; i < users; i += users / 1000 + 1) 
+    {
+        if (uidx.Find(uid_of(i)) < 0) 
+        {
+            missing++;
+        }
+    }
+
+    if (missing > 0) 
+    {
+        fprintf(stderr, "%s: %ld sampled uids missing\n", what, missing);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    string dir = "/tmp";
+    int64_t users = 4000000;
+    int64_t slots_per_user = 1;
+
+    int opt = 0;
+    while (-1 != (opt = getopt(argc, argv, "d:u:s:"))) 
+    {
+        switch (opt) 
+        {
+        case 'd': dir = optarg; break;
+        case 'u': users = atol(optarg); break;
+        case 's': slots_per_user = atol(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-d dir] [-u users] "
+                "[-s slots_per_user]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    int64_t slot_num = users * slots_per_user;
+    string fname = dir + "/.uidx_bench_startup";
+    unlink(fname.c_str());
+
+    // the uids as LoadIndex reads them from the records
+    vector<string> uids;
+    uids.reserve(slot_num);
+    for (int64_t s = 0; s < slot_num; s++) 
+    {
+        uids.push_back(uid_of(s % users));
+    }
+
+    double start = bench_ms();
+    {
+        UidIndex uidx;
+        if (!uidx.Init(slot_num, fname)) 
+        {
+            fprintf(stderr, "init %s failed\n", fname.c_str());
+
+            return -1;
+        }
+
+        for (int64_t s = 0; s < slot_num; s++) 
+        {
+            uidx.Insert(uids[s], s);
+            uidx.Touch(s, 1);
+        }
+        uidx.Sync2File();
+        uidx.Checkpoint(slot_num);
+
+        printf("%-18s slots=%-10ld cost_ms=%.1f\n", "rebuild", slot_num,
+            bench_ms() - start);
+        check(uidx, users, "rebuild");
+    }
+
+    for (int populate = 1; populate >= 0; populate--) 
+    {
+        start = bench_ms();
+        UidIndex uidx;
+        if (!uidx.Init(slot_num, fname, true, populate) || uidx.IsNew() 
+            || uidx.GetCheckpoint() != slot_num) 
+        {
+            fprintf(stderr, "reopen %s failed\n", fname.c_str());
+
+            return -1;
+        }
+
+        printf("%-18s slots=%-10ld cost_ms=%.1f\n",
+            populate ? "image populate" : "image lazy", slot_num,
+            bench_ms() - start);
+        check(uidx, users, "image");
+    }
+
+    unlink(fname.c_str());
+
+    return 0;
+}
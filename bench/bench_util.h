@@ -0,0 +1,29 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <sys/time.h>
+#include <stdint.h>
+
+// what the benches share. srec::now_ms of util is whole ms, the benches 
+// time runs shorter than that and keep the fraction.
+
+static inline double bench_ms()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+// xorshift64, the same seed gives the same sequence, so two runs over 
+// the same random slots can be compared
+static inline uint64_t next_rand(uint64_t &seed)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+
+    return seed;
+}
+
+#endif
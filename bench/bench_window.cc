@@ -0,0 +1,252 @@
+// Lookup latency over a window of days: a MapBloom per day, probed one
+// day after the other as BloomMgr does, against a SliceMgr of "store" : 1
+// filled with the same vids through Add and rotated day by day, where
+// SliceMgr::Lookup answers for every day with one probe of the k cells.
+// Lookups go to random users with vids that are not in them, the case
+// where every day has to be asked.
+//
+// usage: bench_window [-d dir] [-u users] [-D days] [-v vids] [-n lookups]
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "slice_mgr.h"
+#include "map_bloom.h"
+#include "hash.h"
+#include "bench_util.h"
+
+using namespace std;
+using namespace srec;
+
+static string uid_of(int64_t u)
+{
+    char uid[32];
+    snprintf(uid, sizeof(uid), "u%ld", u);
+
+    return uid;
+}
+
+// an add of vids "d_u_i" for user u in day d, the way a request has them
+static ContextPtr add_ctx(int d, int64_t u, int vids)
+{
+    ContextPtr ctx(new Context);
+    ctx->uid_ = uid_of(u);
+    ctx->finfo_.type = tAdd;
+
+    string &val = ctx->params_["vids"];
+    vector<uint32_t> ends;
+    char vid[64];
+    for (int i = 0; i < vids; i++) 
+    {
+        snprintf(vid, sizeof(vid), "%s%d_%ld_%d", (0 == i) ? "" : ",", d,
+            u, i);
+        val += vid;
+        ends.push_back(val.size());
+    }
+
+    for (int i = 0; i < vids; i++) 
+    {
+        uint32_t begin = (0 == i) ? 0 : ends[i - 1] + 1;
+        VidView v = {val.c_str() + begin, ends[i] - begin};
+        ctx->finfo_.vids.push_back(v);
+    }
+    ctx->finfo_.vid_size = vids;
+    ctx->finfo_.groups.push_back(vids);
+    ctx->finfo_.req_group_size = 1;
+
+    return ctx;
+}
+
+int main(int argc, char **argv)
+{
+    string dir = "/tmp";
+    int64_t users = 100000;
+    int days = 5;
+    int vids = 100;
+    int64_t lookups = 10000000;
+
+    int opt = 0;
+    while (-1 != (opt = getopt(argc, argv, "d:u:D:v:n:"))) 
+    {
+        switch (opt) 
+        {
+        case 'd': dir = optarg; break;
+        case 'u': users = atol(optarg); break;
+        case 'D': days = atoi(optarg); break;
+        case 'v': vids = atoi(optarg); break;
+        case 'n': lookups = atol(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-d dir] [-u users] [-D days] "
+                "[-v vids] [-n lookups]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    if (days < 1 || days > MAX_SLICE_DAYS) 
+    {
+        fprintf(stderr, "days is 1 to %d\n", MAX_SLICE_DAYS);
+
+        return -1;
+    }
+
+    // the sliced store is a directory of its own, rotated by hand: its
+    // create hour is put half a day away
+    bloom_conf_t conf;
+    conf.prefix = dir + "/bench_window";
+    conf.bloom_num = users;
+    conf.capacity = 500;
+    conf.fail_rate = 0.01;
+    conf.days = days;
+    time_t now = time(NULL);
+    struct tm tmstru;
+    localtime_r(&now, &tmstru);
+    conf.create_bloom_at = (tmstru.tm_hour + 12) % 24;
+    conf.hash_type = hDouble;
+    conf.layout = lBlocked;
+    conf.store = sSliced;
+
+    mkdir(conf.prefix.c_str(), 0755);
+    unlink((conf.prefix + "/slices").c_str());
+    unlink((conf.prefix + "/.uidx_slices").c_str());
+
+    SliceMgr slices(conf);
+    if (!slices.InitBlooms()) 
+    {
+        fprintf(stderr, "init %s failed\n", conf.prefix.c_str());
+
+        return -1;
+    }
+
+    // slot u of every day is user u's, SliceMgr picks its own
+    vector<MapBloom *> blooms;
+    double fill_ms = bench_ms();
+    for (int d = 0; d < days; d++) 
+    {
+        char fname[256];
+        snprintf(fname, sizeof(fname), "%s/bench_window.%d", dir.c_str(), d);
+        unlink(fname);
+
+        MapBloom *bloom = new MapBloom;
+        if (!bloom->Init(users, conf.capacity, conf.fail_rate,
+            conf.hash_type, conf.layout, fname)) 
+        {
+            fprintf(stderr, "init %s failed\n", fname);
+
+            return -1;
+        }
+        bloom->SetDelete(true);
+        bloom->StopFlush();
+        blooms.push_back(bloom);
+
+        if (d > 0) 
+        {
+            char name[BLOOM_NAME_SZ];
+            snprintf(name, sizeof(name), "bench_%d", d);
+            slices.Rotate(name);
+        }
+
+        int64_t slot_size = bloom->GetBitNum() / 8;
+        vector<int64_t> hashs;
+        for (int64_t u = 0; u < users; u++) 
+        {
+            ContextPtr ctx = add_ctx(d, u, vids);
+            for (auto &v : ctx->finfo_.vids) 
+            {
+                hashs.clear();
+                Hash::CalcHash(v.ptr, v.len, conf.hash_type,
+                    bloom->GetHashNum(), hashs);
+                bloom->Add(u * slot_size, hashs);
+            }
+
+            if (!slices.Add(ctx)) 
+            {
+                fprintf(stderr, "add of u%ld in day %d failed\n", u, d);
+
+                return -1;
+            }
+        }
+    }
+    fill_ms = bench_ms() - fill_ms;
+
+    // written back before timing, no flush pass runs during the lookups
+    int64_t gen = slices.RequestSync();
+    while (slices.GetSyncedGen() < gen) 
+    {
+        usleep(1000);
+    }
+
+    vector<string> pool(4096);
+    for (size_t i = 0; i < pool.size(); i++) 
+    {
+        char vid[32];
+        snprintf(vid, sizeof(vid), "vid_%zu", i);
+        pool[i] = vid;
+    }
+
+    // the slots of a user are found once, both sides time the hashing
+    // and probing of a vid only
+    vector<vector<int64_t> > user_slots(users);
+    for (int64_t u = 0; u < users; u++) 
+    {
+        slices.UserSlots(uid_of(u), user_slots[u]);
+    }
+
+    uint64_t seed = 88172645463325252ULL;
+    uint64_t run_seed = seed;
+    int64_t slot_size = blooms[0]->GetBitNum() / 8;
+    int hash_num = blooms[0]->GetHashNum();
+    vector<int64_t> hashs;
+    int64_t hits = 0;
+    double start = bench_ms();
+    for (int64_t i = 0; i < lookups; i++) 
+    {
+        int64_t u = next_rand(seed) % users;
+        const string &vid = pool[i % pool.size()];
+        hashs.clear();
+        Hash::CalcHash(vid.c_str(), vid.size(), conf.hash_type, hash_num,
+            hashs);
+        for (int d = 0; d < days; d++) 
+        {
+            if (blooms[d]->Lookup(u * slot_size, hashs)) 
+            {
+                hits++;
+                break;
+            }
+        }
+    }
+    double cost = bench_ms() - start;
+
+    printf("%-8s days=%d users=%-9ld bytes=%-12ld ns_per_lookup=%-8.1f "
+        "hits=%ld\n", "per_day", days, users, slot_size * users * days,
+        cost * 1000000.0 / lookups, hits);
+
+    uint8_t mask = slices.DayMask(days);
+    seed = run_seed;
+    hits = 0;
+    start = bench_ms();
+    for (int64_t i = 0; i < lookups; i++) 
+    {
+        int64_t u = next_rand(seed) % users;
+        const string &vid = pool[i % pool.size()];
+        VidView v = {vid.c_str(), (uint32_t)vid.size()};
+        hits += slices.Lookup(user_slots[u], mask, v) ? 1 : 0;
+    }
+    cost = bench_ms() - start;
+
+    printf("%-8s days=%d users=%-9ld bytes=%-12ld ns_per_lookup=%-8.1f "
+        "hits=%ld fill_ms=%.0f\n", "sliced", days, users,
+        blooms[0]->GetBitNum() * users, cost * 1000000.0 / lookups, hits,
+        fill_ms);
+    printf("%s\n", slices.GetStats().c_str());
+
+    for (auto bloom : blooms) 
+    {
+        delete bloom;
+    }
+
+    return 0;
+}
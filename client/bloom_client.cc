@@ -0,0 +1,241 @@
+#include "bloom_client.h"
+#include <string.h>
+#include <map>
+
+NAME_SPACE_BS
+
+BloomClient::BloomClient()
+{
+    version_ = 0;
+}
+
+BloomClient::~BloomClient()
+{
+}
+
+bool BloomClient::Parse(const char *data, size_t len, int mode)
+{
+    slots_.clear();
+    decoded_.clear();
+    version_ = 0;
+
+    bool ret = (eDelta == mode) ? ParseDelta(data, len)
+        : ParseFull(data, len);
+    if (!ret)
+    {
+        slots_.clear();
+        decoded_.clear();
+    }
+
+    return ret;
+}
+
+bool BloomClient::ParseFull(const char *data, size_t len)
+{
+    // type,ts,bits,len
+    size_t head_sz = sizeof(int32_t) + BLOOM_NAME_SZ + sizeof(int64_t) * 2;
+    const char *ptr = data;
+    const char *end = data + len;
+
+    int32_t bloom_num = 0;
+    if (len < sizeof(int32_t))
+    {
+        return false;
+    }
+    memcpy(&bloom_num, ptr, sizeof(int32_t));
+    ptr += sizeof(int32_t);
+
+    // bit_num of each day seen
+    map<string, int64_t> days;
+    slots_.reserve(bloom_num);
+    for (int32_t i = 0; i < bloom_num; i++)
+    {
+        if ((size_t)(end - ptr) < head_sz)
+        {
+            return false;
+        }
+
+        client_slot_t slot;
+        int64_t bloom_size = 0;
+        string name(ptr + sizeof(int32_t),
+            strnlen(ptr + sizeof(int32_t), BLOOM_NAME_SZ));
+        memcpy(&slot.bit_num, ptr + sizeof(int32_t) + BLOOM_NAME_SZ,
+            sizeof(int64_t));
+        memcpy(&bloom_size, ptr + sizeof(int32_t) + BLOOM_NAME_SZ
+            + sizeof(int64_t), sizeof(int64_t));
+        ptr += head_sz;
+
+        if (bloom_size <= 0 || slot.bit_num <= 0
+            || slot.bit_num > bloom_size * 8 + 7 || end - ptr < bloom_size)
+        {
+            return false;
+        }
+
+        // slots of another size in a day have their own hash_num
+        auto it = days.insert(make_pair(name, slot.bit_num)).first;
+        if (it->second != slot.bit_num)
+        {
+            return false;
+        }
+
+        slot.bits = Bits(ptr, bloom_size, slot.bit_num);
+        slot.hash_type = hLegacy;
+        slot.hash_num = LEGACY_HASH_NUM;
+        slot.layout = lStandard;
+        slots_.push_back(slot);
+        ptr += bloom_size;
+    }
+
+    return true;
+}
+
+bool BloomClient::ParseDelta(const char *data, size_t len)
+{
+    const char *ptr = data;
+    const char *end = data + len;
+
+    int32_t bloom_num = 0;
+    int32_t day_num = 0;
+    if (len < sizeof(int32_t) * 2 + sizeof(int64_t))
+    {
+        return false;
+    }
+    memcpy(&bloom_num, ptr, sizeof(int32_t));
+    ptr += sizeof(int32_t);
+
+    memcpy(&version_, ptr, sizeof(int64_t));
+    ptr += sizeof(int64_t);
+
+    memcpy(&day_num, ptr, sizeof(int32_t));
+    ptr += sizeof(int32_t);
+
+    if (day_num < 0 || end - ptr < (int64_t)day_num * BLOOM_NAME_SZ)
+    {
+        return false;
+    }
+    ptr += day_num * BLOOM_NAME_SZ;
+
+    slots_.reserve(bloom_num);
+    for (int32_t i = 0; i < bloom_num; i++)
+    {
+        if ((size_t)(end - ptr) < EXPORT_HEAD_SZ)
+        {
+            return false;
+        }
+
+        export_head_t head;
+        ptr = BloomExport::GetHead(ptr, head);
+        if (head.len <= 0 || head.bit_num <= 0 
+            || head.bit_num > head.len * 8 + 7
+            || head.data_len < 0 || end - ptr < head.data_len)
+        {
+            return false;
+        }
+
+        client_slot_t slot;
+        slot.bit_num = head.bit_num;
+        slot.hash_type = head.hash_type;
+        slot.hash_num = head.hash_num;
+        slot.layout = head.layout;
+
+        if (encRaw == head.encoding && head.data_len == head.len)
+        {
+            slot.bits = Bits(ptr, head.len, head.bit_num);
+        }
+        else
+        {
+            // the byte past len is the legacy tail, see Bits
+            decoded_.push_back(string(head.len + 1, (char)0xff));
+            string &bits = decoded_.back();
+            if (!BloomExport::Decode(head.encoding, ptr, head.data_len,
+                &bits[0], head.len))
+            {
+                return false;
+            }
+            slot.bits = bits.c_str();
+        }
+
+        slots_.push_back(slot);
+        ptr += head.data_len;
+    }
+
+    return true;
+}
+
+// days created before bit_num was rounded to whole bytes have up to 7 
+// bits past the exported bytes, they read as set here: a vid with a 
+// position there may be reported, but none the server has is missed
+const char *BloomClient::Bits(const char *ptr, int64_t len, int64_t bit_num)
+{
+    if (bit_num <= len * 8)
+    {
+        return ptr;
+    }
+
+    decoded_.push_back(string(ptr, len));
+    decoded_.back().push_back((char)0xff);
+
+    return decoded_.back().c_str();
+}
+
+bool BloomClient::Contains(const string &vid)
+{
+    vector<int64_t> hashs[2];
+    int hash_nums[2] = {0, 0};
+
+    return Lookup(vid.c_str(), vid.size(), hashs, hash_nums);
+}
+
+void BloomClient::Contains(const vector<string> &vids,
+    vector<uint8_t> &res)
+{
+    vector<int64_t> hashs[2];
+    hashs[0].reserve(MAX_HASH_NUM);
+    hashs[1].reserve(MAX_HASH_NUM);
+
+    res.assign(vids.size(), 0);
+    for (size_t i = 0; i < vids.size(); i++)
+    {
+        int hash_nums[2] = {0, 0};
+        if (!vids[i].empty()
+            && Lookup(vids[i].c_str(), vids[i].size(), hashs, hash_nums))
+        {
+            res[i] = 1;
+        }
+    }
+}
+
+// same as BloomMgr::Lookup, the vid is hashed lazily once per scheme
+bool BloomClient::Lookup(const char *vid, size_t len,
+    vector<int64_t> *hashs, int *hash_nums)
+{
+    for (auto &s : slots_)
+    {
+        int t = (hDouble == s.hash_type) ? hDouble : hLegacy;
+        if (hash_nums[t] != s.hash_num)
+        {
+            hash_nums[t] = s.hash_num;
+            hashs[t].clear();
+            Hash::CalcHash(vid, len, t, hash_nums[t], hashs[t]);
+        }
+
+        if (MapBloom::Test(s.bits, s.bit_num, s.layout, hashs[t]))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int BloomClient::GetSlotNum()
+{
+    return slots_.size();
+}
+
+int64_t BloomClient::GetVersion()
+{
+    return version_;
+}
+
+NAME_SPACE_ES
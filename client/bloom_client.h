@@ -0,0 +1,65 @@
+#ifndef BLOOM_CLIENT_H
+#define BLOOM_CLIENT_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include "common.h"
+#include "hash.h"
+#include "map_bloom.h"
+#include "bloom_export.h"
+
+using namespace std;
+
+NAME_SPACE_BS
+
+// Lookups on the blob of /sbf/get on the client side, so an edge can
+// filter vids locally. The slots point into the blob, which must stay
+// alive as long as the client, only bit-gap encoded slots of a mode=1
+// blob are decoded into buffers owned here.
+
+typedef struct client_slot_s
+{
+    const char *bits;
+    int64_t bit_num;
+    int hash_type;
+    int hash_num;
+    int layout;
+} client_slot_t;
+
+class BloomClient
+{
+public:
+    BloomClient();
+    virtual ~BloomClient();
+
+    // mode=1 blobs say the hash scheme, layout and hash_num per slot. A
+    // mode=0 blob says none of them, the server only sends days of the
+    // legacy ones there: a blob whose slots of one day differ in bit_num
+    // (a tiered day of an older server) is refused, use mode=1.
+    bool Parse(const char *data, size_t len, int mode = eFull);
+
+    bool Contains(const string &vid);
+    // res[i] is 1 if vids[i] may have been added for the user
+    void Contains(const vector<string> &vids, vector<uint8_t> &res);
+
+    int GetSlotNum();
+    // mode=1 only, to send back as ver
+    int64_t GetVersion();
+
+private:
+    bool ParseFull(const char *data, size_t len);
+    bool ParseDelta(const char *data, size_t len);
+    const char *Bits(const char *ptr, int64_t len, int64_t bit_num);
+    bool Lookup(const char *vid, size_t len, vector<int64_t> *hashs,
+        int *hash_nums);
+
+private:
+    int64_t version_;
+    vector<client_slot_t> slots_;
+    list<string> decoded_;
+};
+
+NAME_SPACE_ES
+
+#endif
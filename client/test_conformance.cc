@@ -0,0 +1,362 @@
+// Conformance of BloomClient with the server. A window of days is filled
+// through MapBloom, each day with its own hash scheme, layout, size tiers
+// and legacy bit_num, and every user has slots in every day, one per
+// tier. A user's slots of all days are serialized by BloomExport::PutFull
+// and PutDelta, the code /sbf/get runs, and Contains on both blobs is
+// checked against MapBloom::Lookup over those slots for the added vids
+// and random ones. mode=0 is only compared on windows the server sends
+// it for, its blob of a tiered day has to be refused.
+//
+// Days from before bit_num was rounded keep up to 7 bits of a slot in
+// the next slot's first byte, the client reads them as set: there it may
+// only report a vid the server doesn't have for a bit in that tail.
+//
+// usage: test_conformance [-d dir], exits 1 on a mismatch
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "bloom_client.h"
+
+using namespace std;
+using namespace srec;
+
+#define TEST_SLOTS 64
+#define TEST_USERS 8
+#define TEST_MAX_DAYS 3
+#define TEST_CAPACITY 200
+#define TEST_FAIL_RATE 0.01
+#define TEST_RANDOM 500
+
+typedef struct test_day_s
+{
+    int hash_type;
+    int layout;
+    int tiers;
+    // 0 for a new day, else that of a day created before the rounding
+    int64_t bit_num;
+} test_day_t;
+
+typedef struct test_window_s
+{
+    const char *name;
+    // the server sends mode=0 for it
+    bool full;
+    int day_num;
+    // newest first
+    test_day_t days[TEST_MAX_DAYS];
+} test_window_t;
+
+typedef struct test_slot_s
+{
+    int64_t slot;
+    int64_t offset;
+    int tier;
+} test_slot_t;
+
+// a position of the vid lies past the exported bytes
+static bool in_tail(int64_t bit_num, int layout, const vector<int64_t> &hashs)
+{
+    if (0 == bit_num % 8)
+    {
+        return false;
+    }
+
+    int64_t block_num = (lBlocked == layout) ? bit_num / BLOCK_BITS : 0;
+    int64_t block = MapBloom::BlockOf(layout, block_num, hashs);
+    for (auto val : hashs)
+    {
+        if (MapBloom::PosOf(layout, bit_num, block_num, block, val)
+            >= bit_num / 8 * 8)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// the slots of user u in a day: one in every tier's region, or two
+static void user_slots(MapBloom &bloom, int u, vector<test_slot_t> &slots)
+{
+    if (0 == bloom.GetTiers())
+    {
+        for (int64_t i = u; i < TEST_USERS * 2; i += TEST_USERS)
+        {
+            test_slot_t s = {i, bloom.GetBitNum() / 8 * i, 0};
+            slots.push_back(s);
+        }
+
+        return;
+    }
+
+    int64_t slot = 0;
+    for (int t = 0; t < bloom.GetTiers(); t++)
+    {
+        const bloom_tier_t &bt = bloom.GetTier(t);
+        if (u < bt.slot_num)
+        {
+            test_slot_t s = {slot + u, bt.base + bt.bit_num / 8 * u, t};
+            slots.push_back(s);
+        }
+        slot += bt.slot_num;
+    }
+}
+
+// every fourth slot only gets a few vids, so mode=1 bit-gap encodes it
+static int64_t vid_num(int u, size_t j, int tier)
+{
+    return (0 == (u + j) % 4) ? 5 : (TEST_CAPACITY << tier);
+}
+
+static bool open_day(const string &fname, const test_day_t &d,
+    MapBloom &bloom)
+{
+    unlink(fname.c_str());
+
+    // a legacy day is opened from its file, as with bit_num from .meta
+    if (d.bit_num > 0)
+    {
+        int fd = open(fname.c_str(), O_CREAT | O_RDWR, 0744);
+        if (fd < 0 || 0 != ftruncate(fd, d.bit_num / 8 * TEST_SLOTS))
+        {
+            fprintf(stderr, "create %s failed\n", fname.c_str());
+
+            return false;
+        }
+        close(fd);
+    }
+
+    bloom.SetTiers(d.tiers);
+    if (!bloom.Init(TEST_SLOTS, TEST_CAPACITY, TEST_FAIL_RATE, d.hash_type,
+        d.layout, fname, d.bit_num))
+    {
+        fprintf(stderr, "init %s failed\n", fname.c_str());
+
+        return false;
+    }
+    bloom.SetDelete(true);
+    bloom.StopFlush();
+
+    return true;
+}
+
+static bool run(const string &dir, const test_window_t &w)
+{
+    MapBloom blooms[TEST_MAX_DAYS];
+    vector<string> names;
+    for (int d = 0; d < w.day_num; d++)
+    {
+        char name[BLOOM_NAME_SZ];
+        snprintf(name, sizeof(name), "2026101%d03", 8 - d);
+        names.push_back(name);
+        if (!open_day(dir + "/test_conformance." + name, w.days[d],
+            blooms[d]))
+        {
+            return false;
+        }
+    }
+
+    vector<test_slot_t> slots[TEST_USERS][TEST_MAX_DAYS];
+    vector<int64_t> hashs;
+    char vid[64];
+    for (int u = 0; u < TEST_USERS; u++)
+    {
+        for (int d = 0; d < w.day_num; d++)
+        {
+            MapBloom &bloom = blooms[d];
+            user_slots(bloom, u, slots[u][d]);
+            for (size_t j = 0; j < slots[u][d].size(); j++)
+            {
+                const test_slot_t &s = slots[u][d][j];
+                for (int64_t i = 0; i < vid_num(u, j, s.tier); i++)
+                {
+                    snprintf(vid, sizeof(vid), "%s_%d_%d_%zu_%ld", w.name,
+                        d, u, j, i);
+                    hashs.clear();
+                    Hash::CalcHash(vid, bloom.GetHashType(),
+                        bloom.GetHashNum(s.tier), hashs);
+                    bloom.Add(s.offset, hashs, s.tier);
+                }
+            }
+        }
+    }
+
+    int64_t checked = 0;
+    int64_t hits = 0;
+    int64_t tail_extra = 0;
+    int64_t refused = 0;
+    int64_t errors = 0;
+    for (int u = 0; u < TEST_USERS; u++)
+    {
+        // the user's slots newest day first, as /sbf/get collects them
+        vector<export_slot_t> out;
+        bool tiered = false;
+        for (int d = 0; d < w.day_num; d++)
+        {
+            for (auto &ts : slots[u][d])
+            {
+                export_slot_t s;
+                s.name = names[d];
+                s.bits = blooms[d].GetMapPtr() + ts.offset;
+                s.bit_num = blooms[d].GetBitNum(ts.tier);
+                s.slot = ts.slot;
+                s.version = 1;
+                s.hash_type = blooms[d].GetHashType();
+                s.hash_num = blooms[d].GetHashNum(ts.tier);
+                s.layout = blooms[d].GetLayout();
+                out.push_back(s);
+                tiered = tiered || (ts.tier != slots[u][d][0].tier);
+            }
+        }
+
+        string full;
+        string delta;
+        BloomExport::PutFull(0, out, full);
+        BloomExport::PutDelta(0, 1, names, out, delta);
+
+        BloomClient full_client;
+        BloomClient delta_client;
+        bool full_ok = full_client.Parse(full.data(), full.size(), eFull);
+        if (!delta_client.Parse(delta.data(), delta.size(), eDelta)
+            || (w.full && !full_ok))
+        {
+            fprintf(stderr, "%s: parse of user %d failed\n", w.name, u);
+            errors++;
+            continue;
+        }
+
+        refused += full_ok ? 0 : 1;
+        if (tiered && full_ok)
+        {
+            fprintf(stderr, "%s: mode=0 blob of user %d with tiers taken\n",
+                w.name, u);
+            errors++;
+        }
+
+        // the added vids of the user first, then some never added
+        vector<string> vids;
+        for (int d = 0; d < w.day_num; d++)
+        {
+            for (size_t j = 0; j < slots[u][d].size(); j++)
+            {
+                for (int64_t i = 0; i < vid_num(u, j, slots[u][d][j].tier);
+                    i++)
+                {
+                    snprintf(vid, sizeof(vid), "%s_%d_%d_%zu_%ld", w.name,
+                        d, u, j, i);
+                    vids.push_back(vid);
+                }
+            }
+        }
+        size_t added = vids.size();
+        for (int64_t i = 0; i < TEST_RANDOM; i++)
+        {
+            snprintf(vid, sizeof(vid), "random_%d_%ld", u, i);
+            vids.push_back(vid);
+        }
+
+        for (size_t k = 0; k < vids.size(); k++)
+        {
+            bool server = false;
+            bool tail = false;
+            for (int d = 0; d < w.day_num; d++)
+            {
+                for (auto &ts : slots[u][d])
+                {
+                    hashs.clear();
+                    Hash::CalcHash(vids[k].c_str(), blooms[d].GetHashType(),
+                        blooms[d].GetHashNum(ts.tier), hashs);
+                    server = server
+                        || blooms[d].Lookup(ts.offset, hashs, ts.tier);
+                    tail = tail || in_tail(blooms[d].GetBitNum(ts.tier),
+                        blooms[d].GetLayout(), hashs);
+                }
+            }
+
+            bool delta_res = delta_client.Contains(vids[k]);
+            checked++;
+            hits += server ? 1 : 0;
+
+            if (k < added && !server)
+            {
+                fprintf(stderr, "%s: added vid %s not found by Lookup\n",
+                    w.name, vids[k].c_str());
+                errors++;
+            }
+
+            if (w.full && full_client.Contains(vids[k]) != delta_res)
+            {
+                fprintf(stderr, "%s: mode=0 %d mode=1 %d for %s\n", w.name,
+                    !delta_res, delta_res, vids[k].c_str());
+                errors++;
+            }
+
+            if (delta_res != server)
+            {
+                // a superset only, never a miss
+                if (!server && tail)
+                {
+                    tail_extra++;
+                    continue;
+                }
+
+                fprintf(stderr, "%s: client %d Lookup %d for %s\n", w.name,
+                    delta_res, server, vids[k].c_str());
+                errors++;
+            }
+        }
+    }
+
+    printf("%-18s days=%d mode0=%d refused=%ld checked=%-7ld hits=%-7ld "
+        "tail_extra=%-4ld errors=%ld\n", w.name, w.day_num, w.full,
+        refused, checked, hits, tail_extra, errors);
+
+    return 0 == errors;
+}
+
+int main(int argc, char **argv)
+{
+    string dir = "/tmp";
+
+    int opt = 0;
+    while (-1 != (opt = getopt(argc, argv, "d:")))
+    {
+        switch (opt)
+        {
+        case 'd': dir = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-d dir]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    // 1917 bits is the unrounded size of 200 vids at 0.01
+    test_window_t windows[] = {
+        {"legacy", true, 3, {{hLegacy, lStandard, 0, 0},
+            {hLegacy, lStandard, 0, 0}, {hLegacy, lStandard, 0, 0}}},
+        {"legacy_unaligned", true, 3, {{hLegacy, lStandard, 0, 1917},
+            {hLegacy, lStandard, 0, 0}, {hLegacy, lStandard, 0, 1917}}},
+        {"double", false, 3, {{hDouble, lBlocked, 0, 0},
+            {hDouble, lStandard, 0, 0}, {hLegacy, lStandard, 0, 0}}},
+        {"double_unaligned", false, 2, {{hDouble, lStandard, 0, 0},
+            {hDouble, lStandard, 0, 1917}}},
+        {"legacy_tiered", false, 2, {{hLegacy, lStandard, 3, 0},
+            {hLegacy, lStandard, 0, 0}}},
+        {"mixed_tiered", false, 3, {{hDouble, lBlocked, 3, 0},
+            {hDouble, lStandard, 3, 0}, {hLegacy, lStandard, 3, 0}}}
+    };
+
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(windows) / sizeof(windows[0]); i++)
+    {
+        ok = run(dir, windows[i]) && ok;
+    }
+
+    printf("%s\n", ok ? "PASS" : "FAIL");
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,288 @@
+#include "add_log.h"
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sstream>
+#include "hash.h"
+
+NAME_SPACE_BS
+
+AddLog::AddLog()
+{
+    seg_bytes_ = 0;
+    seq_ = 0;
+    fd_ = -1;
+    seg_size_ = 0;
+    seg_ver_ = 0;
+    buf_ver_ = 0;
+}
+
+AddLog::~AddLog()
+{
+    if (fd_ > 0) 
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool AddLog::Open(const string &fname, int64_t seg_bytes)
+{
+    fname_ = fname;
+    seg_bytes_ = seg_bytes;
+
+    return NewSegment();
+}
+
+bool AddLog::NewSegment()
+{
+    stringstream ss;
+    ss << fname_ << "_" << seq_++;
+
+    int fd = open(ss.str().c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_APPEND,
+        0744);
+    if (fd < 0) 
+    {
+        return false;
+    }
+
+    if (fd_ > 0) 
+    {
+        close(fd_);
+    }
+
+    // only Append reads fd_ from other threads, to tell if the log is on
+    __atomic_store_n(&fd_, fd, __ATOMIC_RELEASE);
+    seg_fname_ = ss.str();
+    seg_size_ = 0;
+    seg_ver_ = 0;
+
+    return true;
+}
+
+void AddLog::Append(const string &name, int64_t slot, int64_t ver,
+    const string &uid, const vector<VidView> &vids)
+{
+    if (__atomic_load_n(&fd_, __ATOMIC_ACQUIRE) < 0) 
+    {
+        return;
+    }
+
+    size_t body = sizeof(int64_t) * 2 + BLOOM_NAME_SZ + sizeof(uint8_t)
+        + uid.size() + sizeof(uint32_t);
+    for (auto &v : vids) 
+    {
+        body += sizeof(uint16_t) + v.len;
+    }
+
+    string rec(sizeof(uint32_t) * 2 + body, 0x00);
+    char *ptr = &rec[0];
+
+    uint32_t len = body;
+    memcpy(ptr, &len, sizeof(uint32_t));
+    ptr += sizeof(uint32_t) * 2;
+
+    memcpy(ptr, &slot, sizeof(int64_t));
+    ptr += sizeof(int64_t);
+    memcpy(ptr, &ver, sizeof(int64_t));
+    ptr += sizeof(int64_t);
+
+    strncpy(ptr, name.c_str(), BLOOM_NAME_SZ - 1);
+    ptr += BLOOM_NAME_SZ;
+
+    // uids are cut at UID_LEN in the index, 255 is plenty
+    uint8_t uid_len = uid.size() > 255 ? 255 : uid.size();
+    *ptr++ = uid_len;
+    memcpy(ptr, uid.c_str(), uid_len);
+    ptr += uid_len;
+
+    uint32_t vid_num = vids.size();
+    memcpy(ptr, &vid_num, sizeof(uint32_t));
+    ptr += sizeof(uint32_t);
+
+    for (auto &v : vids) 
+    {
+        uint16_t vid_len = v.len > 0xffff ? 0xffff : v.len;
+        memcpy(ptr, &vid_len, sizeof(uint16_t));
+        ptr += sizeof(uint16_t);
+        memcpy(ptr, v.ptr, vid_len);
+        ptr += vid_len;
+    }
+
+    len = ptr - &rec[sizeof(uint32_t) * 2];
+    memcpy(&rec[0], &len, sizeof(uint32_t));
+    uint32_t sum = Sum(&rec[sizeof(uint32_t) * 2], len);
+    memcpy(&rec[sizeof(uint32_t)], &sum, sizeof(uint32_t));
+
+    boost::mutex::scoped_lock lock(mutex_);
+    buf_.append(rec.c_str(), sizeof(uint32_t) * 2 + len);
+    if (ver > buf_ver_) 
+    {
+        buf_ver_ = ver;
+    }
+}
+
+int64_t AddLog::Commit()
+{
+    string buf;
+    int64_t ver = 0;
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        buf.swap(buf_);
+        ver = buf_ver_;
+        buf_ver_ = 0;
+    }
+
+    if (buf.empty() || fd_ < 0) 
+    {
+        return 0;
+    }
+
+    const char *ptr = buf.c_str();
+    size_t left = buf.size();
+    while (left > 0) 
+    {
+        ssize_t n = write(fd_, ptr, left);
+        if (n <= 0) 
+        {
+            return -1;
+        }
+        ptr += n;
+        left -= n;
+    }
+
+    fdatasync(fd_);
+
+    seg_size_ += buf.size();
+    if (ver > seg_ver_) 
+    {
+        seg_ver_ = ver;
+    }
+
+    if (seg_size_ >= seg_bytes_) 
+    {
+        segment_t seg;
+        seg.fname = seg_fname_;
+        seg.ver = seg_ver_;
+        closed_.push_back(seg);
+
+        NewSegment();
+    }
+
+    return buf.size();
+}
+
+void AddLog::Purge(int64_t ver)
+{
+    while (!closed_.empty() && closed_.front().ver < ver) 
+    {
+        unlink(closed_.front().fname.c_str());
+        closed_.pop_front();
+    }
+
+    // under light load the open segment may never fill up, empty it
+    // in place instead
+    if (seg_size_ > 0 && seg_ver_ < ver && 0 == ftruncate(fd_, 0)) 
+    {
+        seg_size_ = 0;
+        seg_ver_ = 0;
+    }
+}
+
+int64_t AddLog::Replay(const string &fname, const AddLogHandler &handler)
+{
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) 
+    {
+        return 0;
+    }
+
+    struct stat sb;
+    if (0 != fstat(fd, &sb) || 0 == sb.st_size) 
+    {
+        close(fd);
+
+        return 0;
+    }
+
+    void *mptr = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == mptr) 
+    {
+        return 0;
+    }
+
+    int64_t num = 0;
+    const char *ptr = (const char *)mptr;
+    const char *end = ptr + sb.st_size;
+    size_t fixed = sizeof(int64_t) * 2 + BLOOM_NAME_SZ + sizeof(uint8_t)
+        + sizeof(uint32_t);
+
+    while ((size_t)(end - ptr) >= sizeof(uint32_t) * 2) 
+    {
+        uint32_t len = 0;
+        uint32_t sum = 0;
+        memcpy(&len, ptr, sizeof(uint32_t));
+        memcpy(&sum, ptr + sizeof(uint32_t), sizeof(uint32_t));
+        ptr += sizeof(uint32_t) * 2;
+
+        if (len < fixed || (size_t)(end - ptr) < len 
+            || sum != Sum(ptr, len)) 
+        {
+            break;
+        }
+
+        const char *rend = ptr + len;
+        add_rec_t rec;
+        memcpy(&rec.slot, ptr, sizeof(int64_t));
+        ptr += sizeof(int64_t);
+        memcpy(&rec.ver, ptr, sizeof(int64_t));
+        ptr += sizeof(int64_t);
+
+        rec.name.assign(ptr, strnlen(ptr, BLOOM_NAME_SZ));
+        ptr += BLOOM_NAME_SZ;
+
+        uint8_t uid_len = *ptr++;
+        rec.uid.assign(ptr, uid_len);
+        ptr += uid_len;
+
+        uint32_t vid_num = 0;
+        memcpy(&vid_num, ptr, sizeof(uint32_t));
+        ptr += sizeof(uint32_t);
+
+        rec.vids.reserve(vid_num);
+        for (uint32_t i = 0; i < vid_num && ptr < rend; i++) 
+        {
+            uint16_t vid_len = 0;
+            memcpy(&vid_len, ptr, sizeof(uint16_t));
+            ptr += sizeof(uint16_t);
+
+            VidView v;
+            v.ptr = ptr;
+            v.len = vid_len;
+            rec.vids.push_back(v);
+            ptr += vid_len;
+        }
+        ptr = rend;
+
+        handler(rec);
+        num++;
+    }
+
+    munmap(mptr, sb.st_size);
+
+    return num;
+}
+
+uint32_t AddLog::Sum(const char *ptr, size_t len)
+{
+    uint64_t out[2];
+    Hash::Murmur3_128(ptr, len, 0, out);
+
+    return (uint32_t)out[0];
+}
+
+NAME_SPACE_ES
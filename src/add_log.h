@@ -0,0 +1,97 @@
+#ifndef ADD_LOG_H
+#define ADD_LOG_H
+
+#include <boost/thread/mutex.hpp>
+#include <tr1/functional>
+#include <string>
+#include <vector>
+#include <list>
+#include "common.h"
+#include "context.h"
+#include "bloom_export.h"
+
+using namespace std;
+
+NAME_SPACE_BS
+
+// Append-only log of the adds of one process, so the bloom files only
+// need an occasional msync. Add appends a record to a buffer, the commit
+// thread writes and fdatasyncs it every few ms (group commit), a crash
+// loses at most the adds since the last commit. The log is cut into
+// .wal_<pid>_<seq> segments in the prefix dir, a segment goes once the
+// flusher has written back everything up to its newest record.
+//
+// record: uint32 len | uint32 sum | int64 slot | int64 ver
+//     | name[BLOOM_NAME_SZ] | uint8 uid_len | uid | uint32 vid_num
+//     | (uint16 vid_len | vid) * vid_num
+// len and sum cover what follows sum, a torn tail fails them and ends
+// the replay. The vids themselves are logged: they are shorter than
+// their hash values and replay does not depend on the hash scheme.
+// A remove (lCuckoo) is logged as a record of WAL_REMOVE_SLOT under the
+// newest day's name, it applies to every day of the window.
+
+#define WAL_REMOVE_SLOT -1
+
+typedef struct add_rec_s 
+{
+    int64_t slot;
+    int64_t ver;
+    string name;
+    string uid;
+    vector<VidView> vids;
+} add_rec_t;
+
+typedef tr1::function<void (const add_rec_t &)> AddLogHandler;
+
+class AddLog
+{
+public:
+    AddLog();
+    virtual ~AddLog();
+
+    // fname is the segment base name, seg_bytes the size a segment is
+    // closed at
+    bool Open(const string &fname, int64_t seg_bytes);
+
+    // no-op until opened
+    void Append(const string &name, int64_t slot, int64_t ver,
+        const string &uid, const vector<VidView> &vids);
+    // writes and syncs what was appended, returns the bytes written
+    int64_t Commit();
+    // drops the segments whose records are all older than ver
+    void Purge(int64_t ver);
+
+    // calls handler for every intact record of the segment fname,
+    // returns the number of records
+    static int64_t Replay(const string &fname, const AddLogHandler &handler);
+
+private:
+    bool NewSegment();
+    static uint32_t Sum(const char *ptr, size_t len);
+
+private:
+    typedef struct segment_s 
+    {
+        string fname;
+        int64_t ver;
+    } segment_t;
+
+    string fname_;
+    int64_t seg_bytes_;
+    int64_t seq_;
+    int fd_;
+    // the open segment
+    string seg_fname_;
+    int64_t seg_size_;
+    int64_t seg_ver_;
+    list<segment_t> closed_;
+
+    // appended and not yet committed, guarded by mutex_
+    string buf_;
+    int64_t buf_ver_;
+    boost::mutex mutex_;
+};
+
+NAME_SPACE_ES
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef BLOOM_ENGINE_H
+#define BLOOM_ENGINE_H
+
+#include <boost/shared_ptr.hpp>
+#include "common.h"
+#include "context.h"
+
+using namespace std;
+
+NAME_SPACE_BS
+
+// how an engine keeps the days of its window
+enum StoreType
+{
+    // a bloom file per day, see BloomMgr
+    sDays,
+    // one bit-sliced file holding every day, see SliceMgr
+    sSliced
+};
+
+// What the filter module asks of an engine's store, the same in the 
+// master and the forked workers.
+class BloomEngine
+{
+public:
+    virtual ~BloomEngine() {}
+
+    // call it in InitInMaster
+    virtual bool InitBlooms() = 0;
+    // call it in InitInWorker
+    virtual void StartReloadMeta() = 0;
+
+    virtual bool Add(ContextPtr ctx) = 0;
+    // drops the vids of the user again, eForbid where the store can't
+    virtual bool Remove(ContextPtr ctx) = 0;
+    virtual void Get(ContextPtr ctx) = 0;
+    virtual void GetBloom(ContextPtr ctx) = 0;
+
+    // asks the master for a flush, returns the generation to wait for
+    virtual int64_t RequestSync() = 0;
+    // the newest generation written back
+    virtual int64_t GetSyncedGen() = 0;
+    // per process counters for /sbf/stats, key=value tab separated
+    virtual string GetStats() = 0;
+};
+
+typedef boost::shared_ptr<BloomEngine> BloomEnginePtr;
+
+NAME_SPACE_ES
+
+#endif
@@ -0,0 +1,285 @@
+#include "bloom_export.h"
+#include <string.h>
+#include <algorithm>
+
+NAME_SPACE_BS
+
+char *BloomExport::PutHead(char *ptr, const export_head_t &head)
+{
+    memcpy(ptr, &head.type, sizeof(int32_t));
+    ptr += sizeof(int32_t);
+
+    memcpy(ptr, head.name, BLOOM_NAME_SZ);
+    ptr += BLOOM_NAME_SZ;
+
+    memcpy(ptr, &head.bit_num, sizeof(int64_t));
+    ptr += sizeof(int64_t);
+
+    memcpy(ptr, &head.len, sizeof(int64_t));
+    ptr += sizeof(int64_t);
+
+    memcpy(ptr, &head.slot, sizeof(int64_t));
+    ptr += sizeof(int64_t);
+
+    memcpy(ptr, &head.version, sizeof(int64_t));
+    ptr += sizeof(int64_t);
+
+    *ptr++ = head.hash_type;
+    *ptr++ = head.hash_num;
+    *ptr++ = head.layout;
+    *ptr++ = head.encoding;
+
+    memcpy(ptr, &head.data_len, sizeof(int64_t));
+    ptr += sizeof(int64_t);
+
+    return ptr;
+}
+
+const char *BloomExport::GetHead(const char *ptr, export_head_t &head)
+{
+    memcpy(&head.type, ptr, sizeof(int32_t));
+    ptr += sizeof(int32_t);
+
+    memcpy(head.name, ptr, BLOOM_NAME_SZ);
+    ptr += BLOOM_NAME_SZ;
+
+    memcpy(&head.bit_num, ptr, sizeof(int64_t));
+    ptr += sizeof(int64_t);
+
+    memcpy(&head.len, ptr, sizeof(int64_t));
+    ptr += sizeof(int64_t);
+
+    memcpy(&head.slot, ptr, sizeof(int64_t));
+    ptr += sizeof(int64_t);
+
+    memcpy(&head.version, ptr, sizeof(int64_t));
+    ptr += sizeof(int64_t);
+
+    head.hash_type = *ptr++;
+    head.hash_num = *ptr++;
+    head.layout = *ptr++;
+    head.encoding = *ptr++;
+
+    memcpy(&head.data_len, ptr, sizeof(int64_t));
+    ptr += sizeof(int64_t);
+
+    return ptr;
+}
+
+int BloomExport::Encode(const char *bits, int64_t len, char *out,
+    int64_t &data_len)
+{
+    // a gap takes at least one byte, stop as soon as raw is smaller
+    char *p = out;
+    char *end = out + len;
+    int64_t last = 0;
+
+    int64_t words = len / sizeof(uint64_t);
+    for (int64_t i = 0; i < len; )
+    {
+        uint64_t w = 0;
+        int64_t n = 0;
+        if (i < words * (int64_t)sizeof(uint64_t))
+        {
+            memcpy(&w, bits + i, sizeof(uint64_t));
+            n = sizeof(uint64_t);
+        }
+        else
+        {
+            w = (unsigned char)bits[i];
+            n = 1;
+        }
+
+        while (0 != w)
+        {
+            int64_t pos = i * 8 + __builtin_ctzll(w);
+            w &= w - 1;
+
+            uint64_t gap = pos - last;
+            last = pos + 1;
+            do
+            {
+                if (p >= end)
+                {
+                    memcpy(out, bits, len);
+                    data_len = len;
+
+                    return encRaw;
+                }
+
+                *p++ = (char)((gap & 0x7f) | (gap > 0x7f ? 0x80 : 0));
+                gap >>= 7;
+            }
+            while (0 != gap);
+        }
+
+        i += n;
+    }
+
+    data_len = p - out;
+
+    return encBitGap;
+}
+
+bool BloomExport::Decode(int encoding, const char *data, int64_t data_len,
+    char *bits, int64_t len)
+{
+    if (encRaw == encoding)
+    {
+        if (data_len != len)
+        {
+            return false;
+        }
+        memcpy(bits, data, len);
+
+        return true;
+    }
+
+    if (encBitGap != encoding)
+    {
+        return false;
+    }
+
+    memset(bits, 0x00, len);
+
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *end = p + data_len;
+    int64_t last = 0;
+    while (p < end)
+    {
+        uint64_t gap = 0;
+        int shift = 0;
+        do
+        {
+            if (p >= end || shift > 63)
+            {
+                return false;
+            }
+            gap |= (uint64_t)(*p & 0x7f) << shift;
+            shift += 7;
+        }
+        while (*p++ & 0x80);
+
+        int64_t pos = last + gap;
+        if (pos < 0 || pos >= len * 8)
+        {
+            return false;
+        }
+        bits[pos / 8] |= (1 << (pos % 8));
+        last = pos + 1;
+    }
+
+    return true;
+}
+
+static char *put_name(char *ptr, const string &name)
+{
+    memcpy(ptr, name.c_str(), min(name.size(), (size_t)BLOOM_NAME_SZ));
+
+    return ptr + BLOOM_NAME_SZ;
+}
+
+void BloomExport::PutFull(int32_t type, const vector<export_slot_t> &slots,
+    string &out)
+{
+    // bloom_num, then type,ts,bits,len,bloom per slot
+    int64_t head_sz = sizeof(int32_t) + BLOOM_NAME_SZ + sizeof(int64_t) * 2;
+    int64_t total_len = 0;
+    for (auto &s : slots)
+    {
+        total_len += head_sz + s.bit_num / 8;
+    }
+
+    int32_t bloom_num = slots.size();
+    size_t start = out.size();
+    if (0 == start)
+    {
+        out.resize(sizeof(int32_t) + total_len, 0x00);
+        start = sizeof(int32_t);
+    }
+    else
+    {
+        int32_t tmp = 0;
+        memcpy(&tmp, &out[0], sizeof(int32_t));
+        bloom_num += tmp;
+        out.resize(start + total_len, 0x00);
+    }
+    memcpy(&out[0], &bloom_num, sizeof(int32_t));
+
+    char *ptr = &out[0] + start;
+    for (auto &s : slots)
+    {
+        int64_t bloom_size = s.bit_num / 8;
+
+        memcpy(ptr, &type, sizeof(int32_t));
+        ptr += sizeof(int32_t);
+
+        ptr = put_name(ptr, s.name);
+
+        memcpy(ptr, &s.bit_num, sizeof(int64_t));
+        ptr += sizeof(int64_t);
+
+        memcpy(ptr, &bloom_size, sizeof(int64_t));
+        ptr += sizeof(int64_t);
+
+        memcpy(ptr, s.bits, bloom_size);
+        ptr += bloom_size;
+    }
+}
+
+void BloomExport::PutDelta(int32_t type, int64_t version,
+    const vector<string> &days, const vector<export_slot_t> &slots,
+    string &out)
+{
+    // bounded by the raw size of every slot
+    int64_t total_len = sizeof(int32_t) + sizeof(int64_t)
+        + sizeof(int32_t) + BLOOM_NAME_SZ * days.size();
+    for (auto &s : slots)
+    {
+        total_len += EXPORT_HEAD_SZ + s.bit_num / 8;
+    }
+
+    out.assign(total_len, 0x00);
+    char *ptr = &out[0];
+
+    int32_t bloom_num = slots.size();
+    memcpy(ptr, &bloom_num, sizeof(int32_t));
+    ptr += sizeof(int32_t);
+
+    memcpy(ptr, &version, sizeof(int64_t));
+    ptr += sizeof(int64_t);
+
+    int32_t day_num = days.size();
+    memcpy(ptr, &day_num, sizeof(int32_t));
+    ptr += sizeof(int32_t);
+
+    for (auto &name : days)
+    {
+        ptr = put_name(ptr, name);
+    }
+
+    for (auto &s : slots)
+    {
+        export_head_t head;
+        memset(&head, 0x00, sizeof(export_head_t));
+        head.type = type;
+        memcpy(head.name, s.name.c_str(),
+            min(s.name.size(), (size_t)BLOOM_NAME_SZ));
+        head.bit_num = s.bit_num;
+        head.len = s.bit_num / 8;
+        head.slot = s.slot;
+        head.version = s.version;
+        head.hash_type = s.hash_type;
+        head.hash_num = s.hash_num;
+        head.layout = s.layout;
+
+        head.encoding = Encode(s.bits, head.len, ptr + EXPORT_HEAD_SZ,
+            head.data_len);
+        ptr = PutHead(ptr, head);
+        ptr += head.data_len;
+    }
+
+    out.resize(ptr - &out[0]);
+}
+
+NAME_SPACE_ES
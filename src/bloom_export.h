@@ -0,0 +1,100 @@
+#ifndef BLOOM_EXPORT_H
+#define BLOOM_EXPORT_H
+
+#include <string>
+#include <vector>
+#include "common.h"
+
+using namespace std;
+
+NAME_SPACE_BS
+
+// Wire format of /sbf/get.
+//
+// mode=0 (eFull), the original payload:
+//   int32 bloom_num, then per slot
+//   type(int32) name[16] bit_num(int64) len(int64) bits[len]
+//
+// mode=1 (eDelta), only the slots changed since the client's ver:
+//   int32 bloom_num, int64 version, int32 day_num, name[16] * day_num,
+//   then per slot an export_head_t followed by data[data_len]
+// version goes back as ver on the next pull, the day names are the days
+// still alive so the client can drop the others.
+
+#define BLOOM_NAME_SZ 16
+
+enum ExportMode
+{
+    eFull,
+    eDelta
+};
+
+enum ExportEncoding
+{
+    // the len bytes of the slot as they are
+    encRaw,
+    // varint gaps between set bit positions, for sparse slots
+    encBitGap
+};
+
+typedef struct export_head_s
+{
+    int32_t type;
+    char name[BLOOM_NAME_SZ];
+    int64_t bit_num;
+    int64_t len;
+    int64_t slot;
+    int64_t version;
+    int8_t hash_type;
+    int8_t hash_num;
+    int8_t layout;
+    int8_t encoding;
+    int64_t data_len;
+} export_head_t;
+
+// packed size of export_head_t on the wire
+#define EXPORT_HEAD_SZ (sizeof(int32_t) + BLOOM_NAME_SZ \
+    + sizeof(int64_t) * 4 + sizeof(int8_t) * 4 + sizeof(int64_t))
+
+// a slot on its way into a blob, bits has the bit_num / 8 bytes sent
+typedef struct export_slot_s
+{
+    string name;
+    const char *bits;
+    int64_t bit_num;
+    int64_t slot;
+    int64_t version;
+    int hash_type;
+    int hash_num;
+    int layout;
+} export_slot_t;
+
+class BloomExport
+{
+public:
+    static char *PutHead(char *ptr, const export_head_t &head);
+    static const char *GetHead(const char *ptr, export_head_t &head);
+
+    // encodes len bytes of bits into out (at least len bytes), returns
+    // the encoding used and sets data_len
+    static int Encode(const char *bits, int64_t len, char *out,
+        int64_t &data_len);
+    // decodes into bits, len bytes zeroed first
+    static bool Decode(int encoding, const char *data, int64_t data_len,
+        char *bits, int64_t len);
+
+    // the mode=0 payload of slots appended to out, whose bloom_num is
+    // raised if another engine has started it. It has no room for the
+    // scheme, layout or hash_num of a slot, the caller only passes
+    // slots of the first ones.
+    static void PutFull(int32_t type, const vector<export_slot_t> &slots,
+        string &out);
+    // the mode=1 payload of slots, days are the names of the live days
+    static void PutDelta(int32_t type, int64_t version,
+        const vector<string> &days, const vector<export_slot_t> &slots,
+        string &out);
+};
+
+NAME_SPACE_ES
+
+#endif
@@ -1,6 +1,5 @@
 #include "bloom_mgr.h"
 
-#include <boost/interprocess/sync/scoped_lock.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
@@ -9,55 +8,131 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <time.h>
+#include <sys/time.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdio.h>
+#include <dirent.h>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include "fuse_filter.h"
 #include "comm/logging.h"
 
 #define META_ITEMS 5
-#define BLOOM_NAME_SZ 16
+// workers re-stat .meta this often even without an inotify event
+#define META_POLL_SEC 600
+// an expired day is only shrunk once every worker has surely dropped it, 
+// a worker touching a truncated page would get SIGBUS
+#define RECLAIM_GRACE_SEC (META_POLL_SEC * 2)
+#define TRASH_PREFIX ".trash_"
+// a flush pass also covers the slots touched this long before the last 
+// one started, an Add may compute its version a little before the 
+// version lands
+#define FLUSH_OVERLAP_MS 1000
+#define WAL_PREFIX ".wal_"
+#define VLOG_PREFIX ".vlog_"
+#define FUSE_PREFIX ".fuse_"
+// a day still loading is asked for again this much later
+#define FREEZE_RETRY_SEC 10
 
 LOG_NAME("Filter");
 
 NAME_SPACE_BS
 
-typedef boost::interprocess::scoped_lock<
-    boost::interprocess::interprocess_mutex> ScopedLock;
+// .wal_<pid>_<seq> segments by process, then in the order written, a 
+// restored slot of a tiered day takes its tier from the ones before it
+static bool wal_before(const string &a, const string &b)
+{
+    long pa = 0, sa = 0, pb = 0, sb = 0;
+    sscanf(a.c_str() + a.rfind(WAL_PREFIX), WAL_PREFIX "%ld_%ld", &pa, &sa);
+    sscanf(b.c_str() + b.rfind(WAL_PREFIX), WAL_PREFIX "%ld_%ld", &pb, &sb);
+
+    return pa < pb || (pa == pb && sa < sb);
+}
 
-BloomMgr::BloomMgr(string &prefix, int64_t bloom_num, int64_t capacity, 
-    double fail_rate, int days, int create_bloom_at, int32_t type) 
-    : prefix_(prefix)
-    , bloom_num_(bloom_num)
-    , capacity_(capacity)
-    , fail_rate_(fail_rate)
-    , days_(days)
-    , create_bloom_at_(create_bloom_at)
-    , type_(type)
+// a placeholder of a day still loading is neither
+static bool day_ready(const bloom_day_t *day)
 {
-    double m_g = ((capacity * log(fail_rate)) / (log(2) * log(2))) * -1;
-    max_adds_ = (ceil(m_g) / 8) * 0.99;
+    return day->bloom || day->frozen;
+}
+
+// a day a client can test the slots of, cuckoo slots are no bloom bits
+static bool day_exported(const bloom_day_t *day)
+{
+    return day->frozen || (day->bloom && lCuckoo != day->bloom->GetLayout());
+}
+
+// a day a mode=0 client can read, that blob has no room for the hash 
+// scheme, layout or the hash_num of a tier, and the client tests it 
+// with the first ones. A frozen day is always double hashed.
+static bool legacy_day(const bloom_day_t *day)
+{
+    return day->bloom && !day->frozen 
+        && hLegacy == day->bloom->GetHashType() 
+        && lStandard == day->bloom->GetLayout() 
+        && 0 == day->bloom->GetTiers();
+}
+
+static int64_t mtime_ms(const string &fname)
+{
+    struct stat sb;
+    if (0 != stat(fname.c_str(), &sb)) 
+    {
+        return 0;
+    }
 
-    hash_handles_.push_back(tr1::bind(&Hash::AP_hash, 
-        tr1::placeholders::_1));
-    hash_handles_.push_back(tr1::bind(&Hash::RS_hash, 
-        tr1::placeholders::_1));
-    hash_handles_.push_back(tr1::bind(&Hash::JS_hash, 
-        tr1::placeholders::_1));
-    hash_handles_.push_back(tr1::bind(&Hash::PJW_hash, 
-        tr1::placeholders::_1));
-    hash_handles_.push_back(tr1::bind(&Hash::ELF_hash, 
-        tr1::placeholders::_1));
-    hash_handles_.push_back(tr1::bind(&Hash::BKDR_hash, 
-        tr1::placeholders::_1));
-    hash_handles_.push_back(tr1::bind(&Hash::DJB_hash, 
-        tr1::placeholders::_1));
-    hash_handles_.push_back(tr1::bind(&Hash::SDBM_hash, 
-        tr1::placeholders::_1));
+    return (int64_t)sb.st_mtim.tv_sec * 1000 + sb.st_mtim.tv_nsec / 1000000;
+}
+
+BloomMgr::BloomMgr(const bloom_conf_t &conf) 
+    : prefix_(conf.prefix)
+    , bloom_num_(conf.bloom_num)
+    , capacity_(conf.capacity)
+    , fail_rate_(conf.fail_rate)
+    , days_(conf.days)
+    , create_bloom_at_(conf.create_bloom_at)
+    , type_(conf.type)
+    , hash_type_(conf.hash_type)
+    , layout_(conf.layout)
+    , atomic_add_(conf.atomic_add)
+    , stage_hours_(conf.stage_hours)
+    , stage_mb_per_sec_(conf.stage_mb_per_sec)
+    , reclaim_mb_per_sec_(conf.reclaim_mb_per_sec)
+    , flush_sec_(conf.flush_sec)
+    , flush_mb_per_sec_(conf.flush_mb_per_sec)
+    , wal_commit_ms_(conf.wal_commit_ms)
+    , wal_segment_mb_(conf.wal_segment_mb)
+    , load_threads_(conf.load_threads)
+    , mem_backing_(conf.mem_backing)
+    , hugetlb_dir_(conf.hugetlb_dir)
+    , tiers_(min(conf.grow_tiers, MAX_TIERS))
+    , freeze_days_(conf.freeze_days > 0)
+    , sync_(NULL)
+    , ckpt_slots_(0)
+    , rotation_lag_ms_(0)
+    , rotations_(0)
+    , set_(NULL)
+{
+    double m_g = ((capacity_ * log(fail_rate_)) / (log(2) * log(2))) * -1;
+    max_adds_ = (ceil(m_g) / 8) * 0.99;
+    // a cuckoo slot is sized for capacity at CUCKOO_LOAD, and a closed 
+    // day takes removes, it can't wait on hugetlbfs to be settled
+    if (lCuckoo == layout_) 
+    {
+        max_adds_ = capacity_;
+        mem_backing_ = min(mem_backing_, (int)mThp);
+    }
 }
 
 BloomMgr::~BloomMgr()
 {
-    blooms_.clear();
-    bloom_idxs_.clear();
+    if (set_) 
+    {
+        delete set_;
+        set_ = NULL;
+    }
 }
 
 bool BloomMgr::InitBlooms()
@@ -69,12 +144,25 @@ bool BloomMgr::InitBlooms()
         return false;
     }
 
+    // mapped before the workers are forked, so they share it
+    void *mptr = mmap(NULL, sizeof(sync_state_t), PROT_READ | PROT_WRITE, 
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == mptr) 
+    {
+        return false;
+    }
+    sync_ = (sync_state_t *)mptr;
+    sync_->request = 0;
+    sync_->done = 0;
+    sync_->flushed = 0;
+
     bool bRet = false; 
-    bool meta_exist = ReadMeta();
+    vector<string> lines;
+    bool meta_exist = ReadMeta(lines);
 
     if (meta_exist) 
     {
-        bRet = ResetBlooms();
+        bRet = ResetBlooms(lines);
     } 
     else 
     {
@@ -86,14 +174,55 @@ bool BloomMgr::InitBlooms()
         return false;
     }
 
+    ReplayLogs();
+
+    // before the create thread can rotate and make a new copy
+    if (mHugetlb == mem_backing_) 
+    {
+        DropHugeLeftovers();
+    }
+
     create_bloom_thread_.reset(new boost::thread(tr1::bind(
         &BloomMgr::CreateBloomHandle, this)));
     create_bloom_thread_->detach();
 
+    reclaim_thread_.reset(new boost::thread(tr1::bind(
+        &BloomMgr::ReclaimHandle, this)));
+    reclaim_thread_->detach();
+
+    flush_thread_.reset(new boost::thread(tr1::bind(
+        &BloomMgr::FlushHandle, this)));
+    flush_thread_->detach();
+
+    if (freeze_days_) 
+    {
+        // closed days a previous master did not get to, the workers are 
+        // not forked yet and none can be adding to them
+        {
+            EpochGuard guard(epoch_);
+            const bloom_set_t *set = CurrSet();
+            for (size_t i = 1; i < set->days.size(); i++) 
+            {
+                bloom_meta_t meta;
+                if (ParseMeta(set->days[i]->finfo, meta) && !meta.frozen) 
+                {
+                    reclaim_file_t rf;
+                    rf.fname = meta.name;
+                    rf.ready = time(NULL);
+                    freeze_.push_back(rf);
+                }
+            }
+        }
+
+        freeze_thread_.reset(new boost::thread(tr1::bind(
+            &BloomMgr::FreezeHandle, this)));
+        freeze_thread_->detach();
+    }
+
     return true;
 }
 
-bool BloomMgr::ReadMeta()
+bool BloomMgr::ReadMeta(vector<string> &lines)
 {
     string fname = prefix_ + "/.meta";
 	
@@ -112,8 +241,8 @@ bool BloomMgr::ReadMeta()
             continue;
         }
     	
-        bloom_finfos_.push_back(line);
-        if (bloom_finfos_.size() >= days_) 
+        lines.push_back(line);
+        if (lines.size() >= days_) 
         {
             break;
         }
@@ -121,518 +250,2114 @@ bool BloomMgr::ReadMeta()
 
     fin.close();
 
-    return !bloom_finfos_.empty();
+    return !lines.empty();
 }
 
-bool BloomMgr::ResetBlooms()
+bool BloomMgr::ParseMeta(const string &line, bloom_meta_t &meta)
 {
-    if (bloom_finfos_.empty()) 
+    vector<string> bloom_info;
+    boost::split(bloom_info, line, boost::is_any_of("\t"));
+    if (META_ITEMS > bloom_info.size()) 
     {
         return false;
     }
 
-    bool rw = true;
-    bool set_once = true;
-
-    auto ite = bloom_finfos_.begin();
-    for (; ite != bloom_finfos_.end(); ++ite) 
+    try 
     {
-        vector<string> bloom_info;
-        boost::split(bloom_info, *ite, boost::is_any_of("\t"));
-        if (META_ITEMS != bloom_info.size()) 
+        meta.name = bloom_info[0];
+        meta.bloom_num = boost::lexical_cast<int64_t>(bloom_info[1]);    
+        meta.capacity = boost::lexical_cast<int64_t>(bloom_info[2]);    
+        meta.fail_rate = boost::lexical_cast<double>(bloom_info[3]);    
+        meta.bit_num = boost::lexical_cast<int64_t>(bloom_info[4]);    
+
+        // days written before the optional columns are legacy hashed, 
+        // use the standard layout and one slot size
+        meta.hash_type = hLegacy;
+        if (bloom_info.size() > META_ITEMS) 
         {
-            continue;
+            meta.hash_type = boost::lexical_cast<int>(bloom_info[5]);
         }
 
-        if (set_once) 
+        meta.layout = lStandard;
+        if (bloom_info.size() > META_ITEMS + 1) 
         {
-            last_hour_ = bloom_info[0];
-            set_once = false;
-        } 
-        else 
+            meta.layout = boost::lexical_cast<int>(bloom_info[6]);
+        }
+
+        meta.tiers = 0;
+        if (bloom_info.size() > META_ITEMS + 2) 
+        {
+            meta.tiers = boost::lexical_cast<int>(bloom_info[7]);
+        }
+
+        meta.frozen = 0;
+        if (bloom_info.size() > META_ITEMS + 3) 
         {
-            rw = false;
+            meta.frozen = boost::lexical_cast<int>(bloom_info[8]);
         }
+    } 
+    catch (boost::bad_lexical_cast &e) 
+    {
+        LOG(ERROR) << "ParseMeta\tline=" << line << "\terr=" << e.what();
+
+        return false;
+    }
+
+    return true;
+}
+
+string BloomMgr::FormatMeta(const bloom_meta_t &meta)
+{
+    return boost::str(boost::format(
+        "%1%\t%2%\t%3%\t%4%\t%5%\t%6%\t%7%\t%8%\t%9%") 
+        %meta.name %meta.bloom_num %meta.capacity %meta.fail_rate 
+        %meta.bit_num %meta.hash_type %meta.layout %meta.tiers 
+        %meta.frozen);
+}
 
-        string fname = bloom_info[0];
-        string bfname = prefix_ + "/" + fname;
-        int64_t bloom_num = boost::lexical_cast<int64_t>(bloom_info[1]);    
-        int64_t capacity = boost::lexical_cast<int64_t>(bloom_info[2]);    
-        double fail_rate = boost::lexical_cast<double>(bloom_info[3]);    
-        int64_t bit_num = boost::lexical_cast<int64_t>(bloom_info[4]);    
+bool BloomMgr::ResetBlooms(const vector<string> &lines)
+{
+    if (lines.empty()) 
+    {
+        return false;
+    }
 
-        MapBloomPtr bloom(new MapBloom);
-        if (!bloom) 
+    bloom_set_t *set = new bloom_set_t;
+    set->days.reserve(lines.size());
+
+    for (auto &line : lines) 
+    {
+        bloom_meta_t meta;
+        if (!ParseMeta(line, meta)) 
         {
-            return false;
+            continue;
         }
 
-        if (!bloom->Init(bloom_num, capacity, fail_rate, bfname, 
-            bit_num, rw)) 
+        // only the newest day is written to
+        bool rw = set->days.empty();
+        if (rw) 
         {
-            return false;
+            last_hour_ = meta.name;
         }
 
-        BloomIdxPtr bloom_idx(new bloom_index_t);
-        if (!bloom_idx) 
+        // with load_threads the older days come in once they are loaded
+        if (!rw && load_threads_ > 0) 
         {
-            return false;
+            BloomDayPtr day(new bloom_day_t);
+            day->name = meta.name;
+            day->finfo = FormatMeta(meta);
+            set->days.push_back(day);
+
+            continue;
         }
-        bloom_idx->fname = prefix_ + "/.idx_" + fname;
-        bloom_idx->fsize = sizeof(int64_t) 
-            + sizeof(bloom_offset_t) * bloom_num_;
 
-        if (!LoadIndex(bloom_idx, fname, rw)) 
+        BloomDayPtr day = LoadDay(meta, rw);
+        if (!day) 
         {
+            delete set;
+
             return false;
         }
+        set->days.push_back(day);
+
+        LOG(INFO) << "ResetBloom\tbloom_name=" << prefix_ << "/" << meta.name 
+            << "\tlast_hour=" << last_hour_ << "\tuid_num=" 
+            << day->uidx->GetUidNum() << "\tbloom_num=" 
+            << day->idx->slot_num();
+    }
 
-        blooms_.push_back(bloom);
-        bloom_idxs_.push_back(bloom_idx);
+    if (set->days.empty()) 
+    {
+        delete set;
 
-        LOG(INFO) << "ResetBloom\tbloom_name=" << bfname 
-            << "\tlast_hour=" << last_hour_ << "\toffset_num=" 
-            << uid2offset_.size() << "\tbloom_num=" 
-            << bloom2uid_[fname].size();
+        return false;
     }
 
-    auto bite = blooms_.begin();
-    for (; bite != blooms_.end(); ++bite) 
+    for (size_t i = 0; i < set->days.size(); i++) 
     {
-        if (bite == blooms_.begin()) 
+        BloomDayPtr day = set->days[i];
+        if (!day_ready(day.get())) 
+        {
+            continue;
+        }
+
+        if (0 == i) 
         {
-   	    (*bite)->StartFlush();
+            day->bloom->StartFlush();
+            day->idx->need_sync = true;
+            day->uidx->StartFlush();
         } 
         else 
         {
-    	    (*bite)->StopFlush();
-    	}
+            if (day->bloom) 
+            {
+                day->bloom->StopFlush();
+            }
+            day->idx->need_sync = false;
+            day->uidx->StopFlush();
+        }
     }
 
-    auto bitx = bloom_idxs_.begin();
-    for (; bitx != bloom_idxs_.end(); ++bitx) 
     {
-        if (bitx == bloom_idxs_.begin()) 
-        {
-   	    (*bitx)->need_sync = true;
-        } 
-        else 
-        {
-    	    (*bitx)->need_sync = false;
-    	}
+        boost::mutex::scoped_lock lock(update_mutex_);
+        PublishSet(set);
+    }
+
+    // the master builds what the older days lack, the workers load them 
+    // again after the fork, see StartReloadMeta
+    if (load_threads_ > 0) 
+    {
+        LoadDaysAsync(false);
     }
 
     return true;
 }
 
-bool BloomMgr::AddNewBloom()
+// image_only: map the day only if its uid index is a finished image, 
+// for workers, which must not build it next to the master
+BloomDayPtr BloomMgr::LoadDay(const bloom_meta_t &meta, bool rw, 
+    bool image_only)
 {
-    time_t curr_time = time(NULL);
-    struct tm tmstru;
-    localtime_r(&curr_time, &tmstru);
-    stringstream fname;    
-    fname << tmstru.tm_year + 1900 << tmstru.tm_mon + 1 << tmstru.tm_mday
-        << tmstru.tm_hour;
-    last_hour_ = fname.str();
+    string bfname = prefix_ + "/" + meta.name;
 
-    string bfname = prefix_ + "/" + fname.str();
-    string biname = prefix_ + "/.idx_" + fname.str();
+    BloomDayPtr day(new bloom_day_t);
+    day->name = meta.name;
+    day->finfo = FormatMeta(meta);
 
-    MapBloomPtr bloom(new MapBloom);
-    if (!bloom) 
+    // a frozen day keeps its indexes, the filters stand in for the bloom
+    if (meta.frozen && !rw) 
     {
-        return false;
+        day->frozen = LoadFrozen(meta);
+        if (!day->frozen) 
+        {
+            return BloomDayPtr();
+        }
+    } 
+    else 
+    {
+        // a worker never makes a closed day's file anew, it was frozen 
+        // or expired since the line was read
+        if (image_only && 0 != access(bfname.c_str(), F_OK)) 
+        {
+            return BloomDayPtr();
+        }
+
+        day->bloom.reset(new MapBloom);
+        day->bloom->SetBacking(mem_backing_, hugetlb_dir_);
+        day->bloom->SetTiers(meta.tiers);
+        if (!day->bloom->Init(meta.bloom_num, meta.capacity, meta.fail_rate, 
+            meta.hash_type, meta.layout, bfname, meta.bit_num, rw)) 
+        {
+            return BloomDayPtr();
+        }
+        day->bloom->SetAtomicAdd(atomic_add_);
     }
 
-    if (!bloom->Init(bloom_num_, capacity_, fail_rate_, bfname)) 
+    day->idx.reset(new bloom_index_t);
+    day->idx->fname = prefix_ + "/.idx_" + meta.name;
+    day->idx->slot_len = meta.bit_num / 8;
+    if (day->bloom) 
     {
-        return false;
+        day->idx->slot_len = day->bloom->GetBitNum() / 8;
     }
+    day->idx->max_adds = max_adds_;
 
-    BloomIdxPtr bloom_idx(new bloom_index_t);
-    if (!bloom_idx) 
+    day->uidx.reset(new UidIndex);
+
+    string name = meta.name;
+    if (!LoadIndex(day->idx, day->uidx, name, rw, image_only)) 
     {
-        return false;
+        return BloomDayPtr();
     }
-    bloom_idx->fname = biname;
-    bloom_idx->fsize = sizeof(int64_t) 
-        + sizeof(bloom_offset_t) * bloom_num_;
 
-    if (!CreateIndex(bloom_idx)) 
+    // only ever created with its day, a log opened later would miss the 
+    // vids added before
+    string vname = prefix_ + "/" + VLOG_PREFIX + meta.name;
+    if (rw && freeze_days_ && 0 == access(vname.c_str(), F_OK)) 
     {
-        return false;
+        day->vlog.reset(new VidLog);
+        if (!day->vlog->Init(vname)) 
+        {
+            LOG(ERROR) << "LoadDay\topen vid log failed\tfname=" << vname;
+            day->vlog.reset();
+        }
+    }
+
+    return day;
+}
+
+// the frozen filters of the day of meta, they answer for an hDouble 
+// bloom of its shape
+FrozenDayPtr BloomMgr::LoadFrozen(const bloom_meta_t &meta)
+{
+    vector<bloom_tier_t> tiers;
+    MapBloom::MakeTiers(meta.bloom_num, meta.capacity, meta.fail_rate, 
+        meta.hash_type, meta.layout, meta.tiers, tiers);
+
+    FrozenDayPtr frozen(new FrozenDay);
+    frozen->SetShape(meta.layout, meta.bit_num, 
+        Hash::HashNum(meta.fail_rate), tiers);
+    if (!frozen->Init(prefix_ + "/" + FUSE_PREFIX + meta.name)) 
+    {
+        return FrozenDayPtr();
+    }
+
+    return frozen;
+}
+
+void BloomMgr::LoadDaysAsync(bool image_only)
+{
+    vector<bloom_meta_t> metas;
+    {
+        EpochGuard guard(epoch_);
+        for (auto &day : CurrSet()->days) 
+        {
+            bloom_meta_t meta;
+            if (!day_ready(day.get()) && ParseMeta(day->finfo, meta)) 
+            {
+                metas.push_back(meta);
+            }
+        }
     }
 
-    if (blooms_.size() > 0) 
+    // dealt out round robin, newest first, so the days most lookups 
+    // hit are ready first
+    int threads = min((size_t)load_threads_, metas.size());
+    for (int t = 0; t < threads; t++) 
     {
-        MapBloomPtr newest_bloom = *(blooms_.begin());
-        newest_bloom->Sync2File();
-        newest_bloom->StopFlush();
+        vector<bloom_meta_t> part;
+        for (size_t i = t; i < metas.size(); i += threads) 
+        {
+            part.push_back(metas[i]);
+        }
 
-        BloomIdxPtr newest_idx = *(bloom_idxs_.begin()); 
-        newest_idx->sync2file();
-        newest_idx->need_sync = false;
+        boost::thread loader(tr1::bind(&BloomMgr::LoadDaysHandle, this, 
+            part, image_only));
+        loader.detach();
     }
+}
 
-    int64_t bit_num = bloom->GetBitNum();
-    string finfo = boost::str(boost::format("%1%\t%2%\t%3%\t%4%\t%5%") 
-        %fname.str() %bloom_num_ %capacity_ %fail_rate_ %bit_num);
+void BloomMgr::LoadDaysHandle(vector<bloom_meta_t> metas, bool image_only)
+{
+    for (auto &meta : metas) 
     {
-        blooms_.push_front(bloom);
-        bloom_finfos_.push_front(finfo);
-        bloom_idxs_.push_front(bloom_idx);
-        
-        while (bloom_finfos_.size() > days_) 
+        int64_t begin = now_ms();
+
+        // a worker may be forked before the master has finished the 
+        // image, it waits for it as long as the day is still wanted
+        BloomDayPtr day;
+        while (!(day = LoadDay(meta, false, image_only)) 
+            && image_only && IsLoading(meta.name)) 
         {
-            MapBloomPtr oldest_bloom = blooms_.back();
-            oldest_bloom->SetDelete(true);
-            string bloom_name = oldest_bloom->GetFileName();
+            sleep(1);
+        }
 
-            bloom_finfos_.pop_back();
-            blooms_.pop_back();
+        if (!day) 
+        {
+            LOG(ERROR) << "LoadDay\tfailed\tbloom_name=" << prefix_ << "/" 
+                << meta.name;
 
-            BloomIdxPtr oldest_idx = bloom_idxs_.back();
-            oldest_idx->need_del = true;
-            bloom_idxs_.pop_back();
+            continue;
+        }
 
-            StartDeleteBloomIdx(bloom_name);
+        // closed, nothing to write back
+        if (day->bloom) 
+        {
+            day->bloom->StopFlush();
         }
+        day->idx->need_sync = false;
+        day->uidx->StopFlush();
+
+        bool installed = InstallDay(day);
+
+        LOG(INFO) << "LoadDay\tbloom_name=" << prefix_ << "/" << meta.name 
+            << "\tinstalled=" << installed << "\tuid_num=" 
+            << day->uidx->GetUidNum() << "\tbloom_num=" 
+            << day->idx->slot_num() << "\tcost_ms=" << now_ms() - begin;
     }
+}
 
-    WriteMeta();
+// puts a loaded day in the place held for it, a placeholder, a closed 
+// day still on hugetlbfs or one now frozen; false if it expired meanwhile
+bool BloomMgr::InstallDay(BloomDayPtr day)
+{
+    boost::mutex::scoped_lock lock(update_mutex_);
 
-    LOG(INFO) << "AddNewBloom\tbloom_name=" << bfname 
-        << "\tlast_hour=" << last_hour_;
+    bloom_set_t *set = new bloom_set_t(*set_);
+    for (size_t i = 1; i < set->days.size(); i++) 
+    {
+        BloomDayPtr &d = set->days[i];
+        if (0 == d->name.compare(day->name) && (!day_ready(d.get()) 
+            || (d->bloom && mHugetlb == d->bloom->GetBacking()) 
+            || (day->frozen && !d->frozen))) 
+        {
+            d = day;
+            PublishSet(set);
 
-    return true;
+            return true;
+        }
+    }
+
+    delete set;
+
+    return false;
 }
 
-bool BloomMgr::CreateIndex(BloomIdxPtr bloom_idx)
+// Moves a closed day off hugetlbfs onto its own file, so the huge pages 
+// hold the written day only. The master writes the copy back and drops 
+// it once the workers are past the rotation (write_back), the workers 
+// follow when they see it gone.
+bool BloomMgr::SettleDay(const string &name, bool write_back)
 {
-    bloom_idx->fd = open(bloom_idx->fname.c_str(), O_CREAT | O_RDWR, 0744);
-    if (bloom_idx->fd < 0) 
+    BloomDayPtr old;
     {
-        return false;
+        EpochGuard guard(epoch_);
+        const bloom_set_t *set = CurrSet();
+        for (size_t i = 1; i < set->days.size(); i++) 
+        {
+            BloomDayPtr d = set->days[i];
+            if (0 == d->name.compare(name) && d->bloom 
+                && mHugetlb == d->bloom->GetBacking()) 
+            {
+                old = d;
+            }
+        }
     }
 
-    if (-1 == ftruncate(bloom_idx->fd, bloom_idx->fsize)) 
+    bloom_meta_t meta;
+    if (!old || !ParseMeta(old->finfo, meta)) 
     {
         return false;
     }
 
-    bloom_idx->mptr = (char *)mmap(NULL, bloom_idx->fsize, 
-        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, bloom_idx->fd, 0);
-    if (MAP_FAILED == bloom_idx->mptr) 
+    if (write_back) 
+    {
+        old->bloom->StartFlush();
+        old->bloom->Sync2File();
+        old->bloom->UnlinkHuge();
+    }
+    old->bloom->StopFlush();
+
+    // only the bloom moves, the indexes are shared with the old day
+    BloomDayPtr day(new bloom_day_t(*old));
+    day->bloom.reset(new MapBloom);
+    day->bloom->SetBacking(mem_backing_, hugetlb_dir_);
+    day->bloom->SetTiers(meta.tiers);
+    if (!day->bloom->Init(meta.bloom_num, meta.capacity, meta.fail_rate, 
+        meta.hash_type, meta.layout, prefix_ + "/" + meta.name, 
+        meta.bit_num, false)) 
     {
         return false;
     }
+    day->bloom->SetAtomicAdd(atomic_add_);
+    day->bloom->StopFlush();
 
-    int64_t valid_idx = 0;
-    memcpy(bloom_idx->mptr, &valid_idx, sizeof(int64_t));
-    last_idxs_ = 0; 
+    bool installed = InstallDay(day);
 
-    return true;
+    LOG(INFO) << "SettleDay\tbloom_name=" << prefix_ << "/" << name 
+        << "\twrite_back=" << write_back << "\tinstalled=" << installed;
+
+    return installed;
 }
 
-bool BloomMgr::LoadIndex(BloomIdxPtr bloom_idx, string &bloom_name, bool rw)
+// hugetlbfs copies of closed days a previous master left unsettled, 
+// written into their files and dropped
+void BloomMgr::DropHugeLeftovers()
 {
-    bloom_idx->fd = open(bloom_idx->fname.c_str(), 
-        (rw ? O_RDWR : O_RDONLY), 0744);
-    if (bloom_idx->fd < 0) 
+    string newest;
     {
-        return false;
+        EpochGuard guard(epoch_);
+        newest = CurrSet()->days[0]->name;
     }
 
-    bloom_idx->mptr = (char *)mmap(NULL, bloom_idx->fsize, 
-        (rw ? (PROT_READ | PROT_WRITE) : PROT_READ), 
-        MAP_SHARED | MAP_POPULATE, bloom_idx->fd, 0);
-    if (MAP_FAILED == bloom_idx->mptr) 
+    DIR *dir = opendir(hugetlb_dir_.c_str());
+    if (!dir) 
     {
-        return false;
+        return;
     }
 
-    int64_t curr_bloom_num = *(int64_t *)(bloom_idx->mptr);
-    char *pIdx = bloom_idx->mptr + sizeof(int64_t);
-    for (int i = 0; i < curr_bloom_num; i++) 
+    struct dirent *ent = NULL;
+    while (NULL != (ent = readdir(dir))) 
     {
-        BloomOffsetPtr bloom_offset(new bloom_offset_t);
-        strncpy(bloom_offset->uid, pIdx, UID_LEN);
-        pIdx += UID_LEN;
-
-        bloom_offset->offset = *(int64_t *)pIdx;
-        pIdx += sizeof(int64_t);
-
-        bloom_offset->len = *(int64_t *)pIdx;
-        pIdx += sizeof(int64_t);
+        // only copies of days of this prefix
+        string name = ent->d_name;
+        string fname = prefix_ + "/" + name;
+        if (0 == name.compare(newest) || '.' == name[0] 
+            || 0 != access(fname.c_str(), F_OK)) 
+        {
+            continue;
+        }
 
-        bloom_offset->max_adds = *(int64_t *)pIdx;
-        pIdx += sizeof(int64_t);
+        string huge_name = hugetlb_dir_ + "/" + name;
+        bool copied = MapBloom::CopyBack(huge_name, fname);
+        if (copied) 
+        {
+            unlink(huge_name.c_str());
+        }
 
-        bloom_offset->adds = *(int64_t *)pIdx; 
-        pIdx += sizeof(int64_t);
+        LOG(INFO) << "DropHugeLeftovers\tbloom_name=" << fname 
+            << "\tcopied=" << copied;
+    }
+    closedir(dir);
+}
 
-        if (bloom_offset->len > 0) 
+void BloomMgr::SettleDays()
+{
+    vector<string> names;
+    {
+        EpochGuard guard(epoch_);
+        const bloom_set_t *set = CurrSet();
+        for (size_t i = 1; i < set->days.size(); i++) 
         {
-            string uid = string(bloom_offset->uid);
-            string key = bloom_name + "_" + uid;
+            MapBloom *b = set->days[i]->bloom.get();
+            if (b && mHugetlb == b->GetBacking() 
+                && 0 != access(b->GetHugeName().c_str(), F_OK)) 
             {
-                boost::unique_lock<boost::shared_mutex> lock(mutex_); 
-                auto it_off = uid2offset_.find(key);
-                if (it_off != uid2offset_.end()) 
-                {
-                    it_off->second.push_front(bloom_offset);
-                } 
-                else 
-                {
-                    list<BloomOffsetPtr> boffset;
-                    boffset.push_front(bloom_offset);
-                    uid2offset_[key] = boffset;
-                }
-
-                auto it_bloom = bloom2uid_.find(bloom_name);
-                if (it_bloom != bloom2uid_.end()) 
-                {
-                    it_bloom->second.push_back(uid); 
-                } 
-                else 
-                {
-                    list<string> uids;
-                    uids.push_back(uid);
-                    bloom2uid_[bloom_name] = uids;
-                }
+                names.push_back(set->days[i]->name);
             }
         }
     }
 
-    if (rw) 
+    for (auto &name : names) 
     {
-        last_idxs_ = curr_bloom_num;
+        SettleDay(name, false);
     }
-
-    return true;
 }
 
-void BloomMgr::WriteMeta()
+bool BloomMgr::IsLoading(const string &name)
 {
-    string fname = prefix_ + "/.meta";
-    fstream fout(fname, ios::binary | ios::out);
-
-    auto ite = bloom_finfos_.begin();
-    for (; ite != bloom_finfos_.end(); ++ite) 
+    EpochGuard guard(epoch_);
+    for (auto &day : CurrSet()->days) 
     {
-        string line = *ite + "\n";
-        fout.write(line.c_str(), line.size());  
+        if (!day_ready(day.get()) && 0 == day->name.compare(name)) 
+        {
+            return true;
+        }
     }
 
-    fout.close();
+    return false;
 }
 
-void BloomMgr::CreateBloomHandle()
+// callers hold update_mutex_
+void BloomMgr::PushDay(BloomDayPtr day)
 {
-    while (1) 
+    const bloom_set_t *curr = set_;
+
+    bloom_set_t *set = new bloom_set_t;
+    set->days.reserve(days_ + 1);
+    set->days.push_back(day);
+    if (curr) 
     {
-    	sleep(2400);
+        set->days.insert(set->days.end(), curr->days.begin(), 
+            curr->days.end());
+    }
 
-        time_t curr_time = time(NULL);
-        struct tm tmstru;
-        localtime_r(&curr_time, &tmstru);
-        stringstream ss;    
-        ss << tmstru.tm_year + 1900 << tmstru.tm_mon + 1 << tmstru.tm_mday 
-            << tmstru.tm_hour;
-        if (0 == last_hour_.compare(ss.str())) 
-        {
-            continue;
-        }
+    // dropping a day is all expiry costs here, its files are left to 
+    // the master's reclaim thread
+    while (set->days.size() > days_) 
+    {
+        set->days.pop_back();
+    }
 
-        if (create_bloom_at_ != tmstru.tm_hour) 
-        {
-            continue;
-        }
+    PublishSet(set);
+}
 
-        AddNewBloom();
+// callers hold update_mutex_, Synchronize only waits for the readers 
+// that may have the old set
+void BloomMgr::PublishSet(bloom_set_t *set)
+{
+    bloom_set_t *old = __atomic_exchange_n(&set_, set, __ATOMIC_SEQ_CST);
+    if (NULL == old) 
+    {
+        return;
     }
+
+    epoch_.Synchronize();
+    delete old;
 }
 
-void BloomMgr::StartReloadMeta()
+const bloom_set_t *BloomMgr::CurrSet()
 {
-    reload_meta_thread_.reset(new boost::thread(tr1::bind(
-        &BloomMgr::ReloadMetaHandle, this)));
-    reload_meta_thread_->detach();
+    return __atomic_load_n(&set_, __ATOMIC_ACQUIRE);
 }
 
-void BloomMgr::ReloadMetaHandle()
+bool BloomMgr::AddNewBloom()
 {
-    string fname = prefix_ + "/.meta";
-    struct stat sb;
-    stat(fname.c_str(), &sb);
-    last_mtime_ = sb.st_mtime; 
+    string name = day_name(time(NULL));
+    last_hour_ = name;
 
-    while (1) 
-    {
-        sleep(600);
+    string bfname = prefix_ + "/" + name;
+    string biname = prefix_ + "/.idx_" + name;
 
-        stat(fname.c_str(), &sb);
-        if (last_mtime_ != sb.st_mtime) 
+    // files staged ahead for this day only need a rename, the opens below 
+    // then find them allocated, zeroed and in the page cache
+    int staged = 0;
+    if (stage_hours_ > 0) 
+    {
+        const char *files[] = {"", ".idx_", ".uidx_"};
+        for (int i = 0; i < 3; i++) 
         {
-            ReloadMeta(); 
-            last_mtime_ = sb.st_mtime;
+            string fname = prefix_ + "/" + files[i] + name;
+            string sname = prefix_ + "/.stage_" + files[i] + name;
+            // never over a day that already has data
+            if (0 != access(fname.c_str(), F_OK) 
+                && 0 == rename(sname.c_str(), fname.c_str())) 
+            {
+                staged++;
+            }
         }
     }
-}
 
-void BloomMgr::ReloadMeta()
-{
-    string fname = prefix_ + "/.meta";
-    fstream fin(fname, ios::binary | ios::in | ios::out);
-    if (!fin.is_open() || !fin.good()) 
+    BloomDayPtr day(new bloom_day_t);
+    day->name = name;
+
+    day->bloom.reset(new MapBloom);
+    day->bloom->SetBacking(mem_backing_, hugetlb_dir_);
+    day->bloom->SetTiers(tiers_);
+    if (!day->bloom->Init(bloom_num_, capacity_, fail_rate_, hash_type_, 
+        layout_, bfname)) 
     {
-        return;
+        return false;
     }
+    day->bloom->SetAtomicAdd(atomic_add_);
 
-    while (!fin.eof()) 
+    day->idx.reset(new bloom_index_t);
+    day->idx->fname = biname;
+    day->idx->fsize = bloom_index_t::byte_size(bloom_num_, tiers_);
+    day->idx->slot_len = day->bloom->GetBitNum() / 8;
+    day->idx->max_adds = max_adds_;
+
+    day->uidx.reset(new UidIndex);
+
+    if (!CreateIndex(day->idx, day->uidx)) 
     {
-        string line;
-        getline(fin, line);
-        if (line.empty()) 
-        {
-            continue;
-        } 
+        return false;
+    }
 
-        vector<string> bloom_info;
-        boost::split(bloom_info, line, boost::is_any_of("\t"));
-        if (META_ITEMS != bloom_info.size()) 
+    // the fingerprints of a frozen day can't beat a tighter fail rate, 
+    // nor keep up with removes
+    if (freeze_days_ && hDouble == hash_type_ && fail_rate_ >= FUSE_FAIL_RATE 
+        && lCuckoo != layout_) 
+    {
+        string vname = prefix_ + "/" + VLOG_PREFIX + name;
+        day->vlog.reset(new VidLog);
+        if (!day->vlog->Init(vname, VidLogCap())) 
         {
-            continue;
+            LOG(ERROR) << "AddNewBloom\tcreate vid log failed\tfname=" 
+                << vname;
+            day->vlog.reset();
+        }
+    }
+
+    bloom_meta_t meta;
+    meta.name = name;
+    meta.bloom_num = bloom_num_;
+    meta.capacity = capacity_;
+    meta.fail_rate = fail_rate_;
+    meta.bit_num = day->bloom->GetBitNum();
+    meta.hash_type = hash_type_;
+    meta.layout = layout_;
+    meta.tiers = tiers_;
+    day->finfo = FormatMeta(meta);
+
+    // a flush pass starting after the swap must find the closed day 
+    // already synced, the add logs are dropped on its word
+    boost::mutex::scoped_lock flush_lock(flush_mutex_);
+
+    BloomDayPtr last;
+    vector<string> expired;
+    {
+        boost::mutex::scoped_lock lock(update_mutex_);
+
+        if (set_ && !set_->days.empty()) 
+        {
+            last = set_->days[0];
+            for (size_t i = days_ - 1; i < set_->days.size(); i++) 
+            {
+                expired.push_back(set_->days[i]->name);
+            }
+        }
+
+        PushDay(day);
+        WriteMeta();
+    }
+
+    for (auto &name : expired) 
+    {
+        ExpireDay(name);
+    }
+
+    // the swap is done, write back the day that was just closed
+    if (last) 
+    {
+        last->bloom->Sync2File();
+        last->bloom->StopFlush();
+
+        last->idx->sync2file();
+        last->idx->need_sync = false;
+
+        last->uidx->Sync2File();
+        last->uidx->Checkpoint(last->idx->slot_num());
+        last->uidx->StopFlush();
+
+        // frozen once the late adds of the workers are surely in
+        if (last->vlog) 
+        {
+            last->vlog->Sync2File();
+
+            reclaim_file_t rf;
+            rf.fname = last->name;
+            rf.ready = time(NULL) + RECLAIM_GRACE_SEC;
+
+            boost::mutex::scoped_lock lock(reclaim_mutex_);
+            freeze_.push_back(rf);
+        }
+
+        // late adds of the workers still land in the hugetlbfs copy, it 
+        // is written back once more when they are surely past the swap
+        if (mHugetlb == last->bloom->GetBacking()) 
+        {
+            reclaim_file_t rf;
+            rf.fname = last->name;
+            rf.ready = time(NULL) + RECLAIM_GRACE_SEC;
+
+            boost::mutex::scoped_lock lock(reclaim_mutex_);
+            settle_.push_back(rf);
         }
+    }
+    flush_lock.unlock();
 
-        string fname = bloom_info[0];
+    LOG(INFO) << "AddNewBloom\tbloom_name=" << bfname 
+        << "\tlast_hour=" << last_hour_ << "\tstaged=" << staged;
+
+    return true;
+}
 
-        MapBloomPtr newest_bloom;
+// Preallocates, zeroes and so pre-faults into the page cache the three 
+// files of the day named name, at stage_mb_per_sec, stopping at deadline. 
+// Whatever was done by then is still used, the files are valid from the 
+// first step on.
+void BloomMgr::StageDay(const string &name, time_t deadline)
+{
+    // leftovers of a rotation that did not happen
+    DIR *dir = opendir(prefix_.c_str());
+    if (dir) 
+    {
+        struct dirent *ent = NULL;
+        while (NULL != (ent = readdir(dir))) 
         {
-            boost::shared_lock<boost::shared_mutex> lock(mutex_);
-            newest_bloom = *(blooms_.begin());
+            string fname = ent->d_name;
+            if (0 == fname.compare(0, 7, ".stage_") 
+                && fname.size() >= name.size() 
+                && 0 != fname.compare(fname.size() - name.size(), 
+                name.size(), name)) 
+            {
+                unlink((prefix_ + "/" + fname).c_str());
+            }
         }
+        closedir(dir);
+    }
+
+    int64_t begin = now_ms();
+    int64_t bytes = 0;
+
+    bool done = StageFile(prefix_ + "/.stage_" + name, 
+            MapBloom::ByteSize(bloom_num_, capacity_, fail_rate_, 
+                hash_type_, layout_, tiers_), deadline, bytes) 
+        && StageFile(prefix_ + "/.stage_.idx_" + name, 
+            bloom_index_t::byte_size(bloom_num_, tiers_), deadline, bytes) 
+        && StageFile(prefix_ + "/.stage_.uidx_" + name, 
+            UidIndex::ByteSize(bloom_num_), deadline, bytes);
+
+    LOG(INFO) << "StageDay\tname=" << name << "\tdone=" << done 
+        << "\tbytes=" << bytes << "\tcost_ms=" << now_ms() - begin;
+}
+
+bool BloomMgr::StageFile(const string &fname, int64_t size, 
+    time_t deadline, int64_t &bytes)
+{
+    int fd = open(fname.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0744);
+    if (fd < 0) 
+    {
+        return false;
+    }
+
+    // the blocks are reserved before any write, the day can't hit ENOSPC
+    if (0 != posix_fallocate(fd, 0, size)) 
+    {
+        LOG(ERROR) << "StageFile\tfallocate failed\tfname=" << fname 
+            << "\tsize=" << size;
+        close(fd);
+        unlink(fname.c_str());
 
-        if (0 == fname.compare(newest_bloom->GetFileName())) 
+        return false;
+    }
+
+    const int64_t chunk = 1 << 20;
+    vector<char> zeros(chunk, 0x00);
+    int64_t rate = (int64_t)stage_mb_per_sec_ * chunk;
+    int64_t begin = now_ms();
+    int64_t off = 0;
+
+    for (; off < size; off += chunk) 
+    {
+        if (time(NULL) >= deadline) 
         {
             break;
-        } 
+        }
 
-        MapBloomPtr bloom(new MapBloom);
-        if (!bloom) 
+        int64_t n = min(chunk, size - off);
+        if (n != pwrite(fd, &zeros[0], n, off)) 
         {
             break;
         }
+        bytes += n;
+
+        if (rate > 0) 
+        {
+            int64_t ahead = (off + n) * 1000 / rate - (now_ms() - begin);
+            if (ahead > 0) 
+            {
+                usleep(ahead * 1000);
+            }
+        }
+    }
+
+    close(fd);
+
+    return off >= size;
+}
+
+// .meta no longer lists the day, move its files aside for the reclaim 
+// thread. Processes still mapping them are not affected by the rename.
+void BloomMgr::ExpireDay(const string &name)
+{
+    time_t ready = time(NULL);
+    if (reclaim_mb_per_sec_ > 0) 
+    {
+        ready += RECLAIM_GRACE_SEC;
+    }
+
+    const char *files[] = {"", ".idx_", ".uidx_", VLOG_PREFIX, FUSE_PREFIX};
+    for (int i = 0; i < 5; i++) 
+    {
+        TrashFile(files[i] + name, ready);
+    }
+
+    LOG(INFO) << "ExpireDay\tname=" << name << "\tready=" << ready;
+}
+
+// moves the file of prefix_ named file aside, released from ready on
+void BloomMgr::TrashFile(const string &file, time_t ready)
+{
+    reclaim_file_t rf;
+    rf.fname = prefix_ + "/" + TRASH_PREFIX + file;
+    rf.ready = ready;
+
+    string fname = prefix_ + "/" + file;
+    if (0 != rename(fname.c_str(), rf.fname.c_str())) 
+    {
+        return;
+    }
+
+    boost::mutex::scoped_lock lock(reclaim_mutex_);
+    reclaim_.push_back(rf);
+}
+
+// room for every slot of a day filled up to its max adds
+int64_t BloomMgr::VidLogCap()
+{
+    vector<bloom_tier_t> tiers;
+    MapBloom::MakeTiers(bloom_num_, capacity_, fail_rate_, hash_type_, 
+        layout_, tiers_, tiers);
+    if (tiers.empty()) 
+    {
+        return bloom_num_ * max_adds_;
+    }
+
+    int64_t cap = 0;
+    for (size_t t = 0; t < tiers.size(); t++) 
+    {
+        cap += tiers[t].slot_num * (max_adds_ << t);
+    }
+
+    return cap;
+}
+
+void BloomMgr::ReclaimHandle()
+{
+    // left over by a previous master, they wait a full grace period again
+    DIR *dir = opendir(prefix_.c_str());
+    if (dir) 
+    {
+        struct dirent *ent = NULL;
+        while (NULL != (ent = readdir(dir))) 
+        {
+            string fname = ent->d_name;
+            if (0 != fname.compare(0, strlen(TRASH_PREFIX), TRASH_PREFIX)) 
+            {
+                continue;
+            }
+
+            reclaim_file_t rf;
+            rf.fname = prefix_ + "/" + fname;
+            rf.ready = time(NULL) 
+                + (reclaim_mb_per_sec_ > 0 ? RECLAIM_GRACE_SEC : 0);
+
+            boost::mutex::scoped_lock lock(reclaim_mutex_);
+            reclaim_.push_back(rf);
+        }
+        closedir(dir);
+    }
+
+    while (true) 
+    {
+        string name;
+        string fname;
+        {
+            boost::mutex::scoped_lock lock(reclaim_mutex_);
+            if (!settle_.empty() && settle_.front().ready <= time(NULL)) 
+            {
+                name = settle_.front().fname;
+                settle_.pop_front();
+            }
+
+            if (!reclaim_.empty() && reclaim_.front().ready <= time(NULL)) 
+            {
+                fname = reclaim_.front().fname;
+            }
+        }
+
+        if (!name.empty()) 
+        {
+            SettleDay(name, true);
+        }
+
+        if (fname.empty()) 
+        {
+            sleep(1);
+
+            continue;
+        }
+
+        ReclaimFile(fname);
+
+        boost::mutex::scoped_lock lock(reclaim_mutex_);
+        reclaim_.pop_front();
+    }
+}
+
+// Shrinks the file from the end by reclaim_mb_per_sec every second, so 
+// the filesystem frees its blocks a few at a time instead of in one 
+// unlink of the whole day.
+bool BloomMgr::ReclaimFile(const string &fname)
+{
+    int64_t begin = now_ms();
+
+    int fd = open(fname.c_str(), O_RDWR);
+    if (fd < 0) 
+    {
+        return false;
+    }
+
+    struct stat sb;
+    if (0 != fstat(fd, &sb)) 
+    {
+        close(fd);
 
-        string bfname = prefix_ + "/" + fname;
-        int64_t bloom_num = boost::lexical_cast<int64_t>(bloom_info[1]);    
-        int64_t capacity = boost::lexical_cast<int64_t>(bloom_info[2]);    
-        double fail_rate = boost::lexical_cast<double>(bloom_info[3]);    
-        int64_t bit_num = boost::lexical_cast<int64_t>(bloom_info[4]);    
+        return false;
+    }
 
-        if (!bloom->Init(bloom_num, capacity, fail_rate, bfname, bit_num)) 
+    int64_t size = sb.st_size;
+    int64_t chunk = (int64_t)reclaim_mb_per_sec_ << 20;
+    while (chunk > 0 && size > chunk) 
+    {
+        size -= chunk;
+        if (0 != ftruncate(fd, size)) 
         {
             break;
         }
+        sleep(1);
+    }
+
+    close(fd);
+    unlink(fname.c_str());
+
+    LOG(INFO) << "ReclaimFile\tfname=" << fname << "\tbytes=" 
+        << sb.st_size << "\tcost_ms=" << now_ms() - begin;
+
+    return true;
+}
+
+void BloomMgr::FreezeHandle()
+{
+    while (true) 
+    {
+        string name;
+        {
+            boost::mutex::scoped_lock lock(reclaim_mutex_);
+            if (!freeze_.empty() && freeze_.front().ready <= time(NULL)) 
+            {
+                name = freeze_.front().fname;
+                freeze_.pop_front();
+            }
+        }
+
+        if (name.empty()) 
+        {
+            sleep(1);
+
+            continue;
+        }
+
+        if (!FreezeDay(name) && IsLoading(name)) 
+        {
+            reclaim_file_t rf;
+            rf.fname = name;
+            rf.ready = time(NULL) + FREEZE_RETRY_SEC;
+
+            boost::mutex::scoped_lock lock(reclaim_mutex_);
+            freeze_.push_back(rf);
+        }
+    }
+}
+
+// Builds the .fuse_ file of a closed day from its .vlog_, three passes 
+// over the log: the vids per slot, then per chain, then the vids put in 
+// place by slot, after which every user's filter is built from the vids 
+// of its chain. The day is then served from it, marked frozen in .meta 
+// for the workers and its bloom file goes to the reclaim thread.
+bool BloomMgr::FreezeDay(const string &name)
+{
+    BloomDayPtr old;
+    {
+        EpochGuard guard(epoch_);
+        const bloom_set_t *set = CurrSet();
+        for (size_t i = 1; i < set->days.size(); i++) 
+        {
+            if (0 == set->days[i]->name.compare(name) && set->days[i]->bloom) 
+            {
+                old = set->days[i];
+            }
+        }
+    }
+
+    bloom_meta_t meta;
+    if (!old || !ParseMeta(old->finfo, meta) || hDouble != meta.hash_type 
+        || meta.fail_rate < FUSE_FAIL_RATE || lCuckoo == meta.layout) 
+    {
+        return false;
+    }
+
+    int64_t begin = now_ms();
+    VidLog vlog;
+    if (!vlog.Init(prefix_ + "/" + VLOG_PREFIX + name, 0, false) 
+        || vlog.IsFull()) 
+    {
+        LOG(ERROR) << "FreezeDay\tno complete vid log\tname=" << name;
+
+        return false;
+    }
+
+    bloom_index_t *idx = old->idx.get();
+    UidIndex *uidx = old->uidx.get();
+    int64_t max_slot = idx->max_slot();
+    int64_t slot_num = idx->slot_num();
+    int64_t rec_num = vlog.GetNum();
+
+    vector<int64_t> key_nums(max_slot, 0);
+    for (int64_t i = 0; i < rec_num; i++) 
+    {
+        int64_t slot = 0;
+        vid_key_t key;
+        if (vlog.Get(i, slot, key) && slot < max_slot) 
+        {
+            key_nums[slot]++;
+        }
+    }
+
+    // a user's filter sits at its newest slot, sized by its whole chain
+    vector<int64_t> chain_keys(max_slot, 0);
+    int64_t users = 0;
+    for (int64_t s = 0; s < slot_num; s++) 
+    {
+        if (!idx->published(s) || s != uidx->Find(idx->fp(s))) 
+        {
+            continue;
+        }
+
+        for (int64_t slot = s; slot >= 0; slot = uidx->Next(slot)) 
+        {
+            chain_keys[s] += key_nums[slot];
+        }
+        users++;
+    }
+
+    string fname = prefix_ + "/" + FUSE_PREFIX + name;
+    FrozenDay out;
+    // out drops its .tmp unless Finish renamed it, and fname goes on 
+    // every failure below: nothing of a failed freeze is left to load
+    if (!out.Create(fname, key_nums, chain_keys)) 
+    {
+        LOG(ERROR) << "FreezeDay\tcreate failed\tfname=" << fname;
+        unlink(fname.c_str());
+
+        return false;
+    }
+
+    vector<int64_t> &filled = key_nums;
+    fill(filled.begin(), filled.end(), 0);
+    for (int64_t i = 0; i < rec_num; i++) 
+    {
+        int64_t slot = 0;
+        vid_key_t key;
+        int64_t num = 0;
+        if (vlog.Get(i, slot, key) && out.GetKeys(slot, num) 
+            && filled[slot] < num) 
+        {
+            out.KeysOf(slot)[filled[slot]++] = key;
+        }
+    }
+
+    vector<uint64_t> keys;
+    for (int64_t s = 0; s < max_slot; s++) 
+    {
+        if (0 == chain_keys[s]) 
+        {
+            continue;
+        }
+
+        keys.clear();
+        for (int64_t slot = s; slot >= 0; slot = uidx->Next(slot)) 
+        {
+            const vid_key_t *ks = out.KeysOf(slot);
+            for (int64_t j = 0; j < filled[slot]; j++) 
+            {
+                keys.push_back(ks[j].key);
+            }
+        }
+
+        if (!FuseFilter::Build(keys, chain_keys[s], out.FilterOf(s))) 
+        {
+            LOG(ERROR) << "FreezeDay\tbuild failed\tname=" << name 
+                << "\tslot=" << s << "\tkeys=" << keys.size();
+            unlink(fname.c_str());
+
+            return false;
+        }
+    }
+
+    if (!out.Finish(users)) 
+    {
+        LOG(ERROR) << "FreezeDay\tfinish failed\tfname=" << fname;
+        unlink(fname.c_str());
+
+        return false;
+    }
+
+    BloomDayPtr day(new bloom_day_t(*old));
+    day->bloom.reset();
+    day->vlog.reset();
+    day->frozen = LoadFrozen(meta);
+    meta.frozen = 1;
+    day->finfo = FormatMeta(meta);
+    if (!day->frozen || !InstallDay(day)) 
+    {
+        unlink(fname.c_str());
+
+        return false;
+    }
+
+    {
+        boost::mutex::scoped_lock lock(update_mutex_);
+        WriteMeta();
+    }
+
+    // the workers move over on the .meta change, the mappings they 
+    // still hold are not affected by the rename
+    if (mHugetlb == old->bloom->GetBacking()) 
+    {
+        old->bloom->UnlinkHuge();
+    }
+
+    time_t ready = time(NULL);
+    if (reclaim_mb_per_sec_ > 0) 
+    {
+        ready += RECLAIM_GRACE_SEC;
+    }
+    TrashFile(name, ready);
+    TrashFile(VLOG_PREFIX + name, ready);
+
+    int64_t bloom_bytes = MapBloom::ByteSize(meta.bloom_num, meta.capacity, 
+        meta.fail_rate, meta.hash_type, meta.layout, meta.tiers);
+
+    LOG(INFO) << "FreezeDay\tname=" << name << "\tusers=" << users 
+        << "\tvids=" << rec_num << "\tbloom_bytes=" << bloom_bytes 
+        << "\tfrozen_bytes=" << day->frozen->GetHotBytes() 
+        << "\tcost_ms=" << now_ms() - begin;
+
+    return true;
+}
+
+int64_t BloomMgr::RequestSync()
+{
+    return __sync_add_and_fetch(&sync_->request, 1);
+}
+
+int64_t BloomMgr::GetSyncedGen()
+{
+    return __atomic_load_n(&sync_->done, __ATOMIC_ACQUIRE);
+}
+
+void BloomMgr::FlushHandle()
+{
+    int64_t since = 0;
+    int64_t last_flush = now_ms();
+
+    while (true) 
+    {
+        usleep(100000);
+
+        int64_t req = __atomic_load_n(&sync_->request, __ATOMIC_ACQUIRE);
+        bool due = flush_sec_ > 0 && now_ms() - last_flush >= flush_sec_ * 1000;
+        if (req <= GetSyncedGen() && !due) 
+        {
+            continue;
+        }
+
+        boost::mutex::scoped_lock lock(flush_mutex_);
+
+        // an Add touches its slot after setting the bits, a slot touched 
+        // from here on is flushed by the next pass
+        last_flush = now_ms();
+        int64_t bytes = FlushDirty(since);
+        since = last_flush - FLUSH_OVERLAP_MS;
+
+        __atomic_store_n(&sync_->flushed, since, __ATOMIC_RELEASE);
+        __atomic_store_n(&sync_->done, req, __ATOMIC_RELEASE);
+
+        LOG(INFO) << "FlushDirty\tsynced_gen=" << req << "\tbytes=" << bytes 
+            << "\tcost_ms=" << now_ms() - last_flush;
+    }
+}
+
+// Writes back the slots of the newest day touched at or after since, as 
+// runs of adjacent slots, at flush_mb_per_sec. Older days are synced in 
+// full when they are rotated out of the newest place, and after removes.
+int64_t BloomMgr::FlushDirty(int64_t since)
+{
+    // the days are held by their own references, a throttled pass must 
+    // not keep a Synchronize of the master waiting
+    BloomDayPtr day;
+    vector<BloomDayPtr> olds;
+    {
+        EpochGuard guard(epoch_);
+        const bloom_set_t *set = CurrSet();
+        day = set->days[0];
+        for (size_t i = 1; lCuckoo == layout_ && i < set->days.size(); i++) 
+        {
+            if (set->days[i]->bloom) 
+            {
+                olds.push_back(set->days[i]);
+            }
+        }
+    }
+
+    int64_t bloom_size = day->bloom->GetBitNum() / 8;
+    int64_t slot_num = day->idx->slot_num();
+    string name = day->bloom->GetFileName();
+    int64_t rate = (int64_t)flush_mb_per_sec_ << 20;
+    int64_t begin_ms = now_ms();
+    int64_t bytes = 0;
+
+    for (int64_t slot = 0; slot < slot_num; ) 
+    {
+        if (day->uidx->GetVersion(slot) < since) 
+        {
+            slot++;
+
+            continue;
+        }
+
+        int64_t end = slot + 1;
+        while (end < slot_num && day->uidx->GetVersion(end) >= since) 
+        {
+            end++;
+        }
+
+        // a legacy slot's last bits may spill into the next byte
+        if (0 == day->bloom->GetTiers()) 
+        {
+            bytes += day->bloom->SyncRange(bloom_size * slot, 
+                bloom_size * (end - slot) + 1);
+        } 
+        else 
+        {
+            // the slots of a tiered day lie in the regions of their tiers
+            for (int64_t s = slot; s < end; s++) 
+            {
+                int tier = 0;
+                int64_t offset = SlotOffset(day.get(), s, tier);
+                if (offset >= 0) 
+                {
+                    bytes += day->bloom->SyncRange(offset, 
+                        day->bloom->GetBitNum(tier) / 8);
+                }
+            }
+        }
+        bytes += day->idx->sync_slots(slot, end);
+        bytes += day->uidx->SyncSlots(slot, end);
+        slot = end;
+
+        if (rate > 0) 
+        {
+            int64_t ahead = bytes * 1000 / rate - (now_ms() - begin_ms);
+            if (ahead > 0) 
+            {
+                usleep(ahead * 1000);
+            }
+        }
+    }
+
+    bytes += day->uidx->SyncBuckets();
+
+    // removes also change the older days of a cuckoo window, their 
+    // dirty pages go in full
+    for (auto &old : olds) 
+    {
+        old->bloom->ForceSync();
+    }
+
+    // the vids logged meanwhile, a flushed add must not be missing from 
+    // the day once it is frozen
+    if (day->vlog) 
+    {
+        bytes += day->vlog->SyncNew();
+    }
+
+    // a slot is counted before it is inserted, the inserts of the slots 
+    // counted one pass ago are done and now written back
+    if (0 == ckpt_day_.compare(name)) 
+    {
+        day->uidx->Checkpoint(ckpt_slots_);
+    }
+    ckpt_day_ = name;
+    ckpt_slots_ = slot_num;
+
+    return bytes;
+}
+
+bool BloomMgr::CreateIndex(BloomIdxPtr bloom_idx, UidIndexPtr uid_idx)
+{
+    bloom_idx->fd = open(bloom_idx->fname.c_str(), O_CREAT | O_RDWR, 0744);
+    if (bloom_idx->fd < 0) 
+    {
+        return false;
+    }
+
+    if (-1 == ftruncate(bloom_idx->fd, bloom_idx->fsize)) 
+    {
+        return false;
+    }
+
+    bloom_idx->mptr = (char *)mmap(NULL, bloom_idx->fsize, 
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, bloom_idx->fd, 0);
+    if (MAP_FAILED == bloom_idx->mptr) 
+    {
+        return false;
+    }
+
+    if (mPage != mem_backing_) 
+    {
+        MapBloom::AdviseHuge(bloom_idx->mptr, bloom_idx->fsize);
+    }
+
+    bloom_idx->format(bloom_num_, tiers_);
+    bloom_idx->attach();
+
+    string uname = bloom_idx->fname;
+    uname.replace(uname.rfind("/.idx_"), 6, "/.uidx_");
+
+    return uid_idx->Init(bloom_idx->max_slot(), uname);
+}
+
+bool BloomMgr::LoadIndex(BloomIdxPtr bloom_idx, UidIndexPtr uid_idx, 
+    string &bloom_name, bool rw, bool image_only)
+{
+    bloom_idx->fd = open(bloom_idx->fname.c_str(), 
+        (rw ? O_RDWR : O_RDONLY), 0744);
+    if (bloom_idx->fd < 0) 
+    {
+        return false;
+    }
+
+    // v1 and v2 files differ in size, map what is there
+    struct stat sb;
+    if (0 != fstat(bloom_idx->fd, &sb)) 
+    {
+        return false;
+    }
+    bloom_idx->fsize = sb.st_size;
+
+    bloom_idx->mptr = (char *)mmap(NULL, bloom_idx->fsize, 
+        (rw ? (PROT_READ | PROT_WRITE) : PROT_READ), 
+        MAP_SHARED | (rw ? MAP_POPULATE : 0), bloom_idx->fd, 0);
+    if (MAP_FAILED == bloom_idx->mptr) 
+    {
+        bloom_idx->mptr = NULL;
+
+        return false;
+    }
+
+    if (!bloom_idx->attach()) 
+    {
+        return false;
+    }
+
+    if (mPage != mem_backing_) 
+    {
+        MapBloom::AdviseHuge(bloom_idx->mptr, bloom_idx->fsize);
+    }
+
+    // the uid index is always opened writable: days from before it 
+    // existed get it built here once, from the .idx_ records
+    string uname = prefix_ + "/.uidx_" + bloom_name;
+    if (image_only) 
+    {
+        return uid_idx->Init(bloom_idx->max_slot(), uname, false, false) 
+            && uid_idx->GetCheckpoint() >= bloom_idx->slot_num();
+    }
+
+    if (!uid_idx->Init(bloom_idx->max_slot(), uname, true, rw)) 
+    {
+        return false;
+    }
+
+    // a checkpointed image is used as is, only the slots past its 
+    // checkpoint (those of a crash before the next flush) are looked at
+    int64_t from = uid_idx->IsNew() ? 0 : uid_idx->GetCheckpoint();
+    int64_t curr_bloom_num = bloom_idx->slot_num();
+    if (from >= curr_bloom_num) 
+    {
+        return true;
+    }
+
+    // slot versions are lost, mark them all as changed now
+    int64_t ver = now_ms();
+    int64_t inserted = 0;
+    for (int64_t i = from; i < curr_bloom_num; i++) 
+    {
+        if (!bloom_idx->published(i)) 
+        {
+            continue;
+        }
+
+        uint64_t key = bloom_idx->fp(i);
+        if (!uid_idx->IsNew() && uid_idx->Contains(key, i)) 
+        {
+            continue;
+        }
+
+        uid_idx->Insert(key, i);
+        uid_idx->Touch(i, ver);
+        inserted++;
+    }
+
+    // nothing writes to a closed day any more, checkpoint it once here
+    if (!rw) 
+    {
+        uid_idx->Sync2File();
+        uid_idx->Checkpoint(curr_bloom_num);
+    }
+
+    LOG(INFO) << "BuildUidIndex\tbloom_name=" << bloom_name 
+        << "\tfrom=" << from << "\tbloom_num=" << curr_bloom_num 
+        << "\tinserted=" << inserted << "\tuid_num=" << uid_idx->GetUidNum();
+
+    return true;
+}
+
+void BloomMgr::WriteMeta()
+{
+    // written aside and renamed, so a worker woken by the rename never 
+    // reads a half written file
+    string fname = prefix_ + "/.meta";
+    string tmp_fname = fname + ".tmp";
+    fstream fout(tmp_fname, ios::binary | ios::out | ios::trunc);
+
+    // callers hold update_mutex_
+    for (auto &day : set_->days) 
+    {
+        string line = day->finfo + "\n";
+        fout.write(line.c_str(), line.size());  
+    }
+
+    fout.close();
+
+    if (0 != rename(tmp_fname.c_str(), fname.c_str())) 
+    {
+        LOG(ERROR) << "WriteMeta\trename failed\tfname=" << fname;
+    }
+}
+
+void BloomMgr::CreateBloomHandle()
+{
+    while (1) 
+    {
+        // wake at the start of the next create_bloom_at hour, or right 
+        // away when started inside it and the day is not there yet, 
+        // with the day there the next one is that of tomorrow
+        time_t curr_time = time(NULL);
+        struct tm tmstru;
+        localtime_r(&curr_time, &tmstru);
+        tmstru.tm_hour = create_bloom_at_;
+        tmstru.tm_min = 0;
+        tmstru.tm_sec = 0;
+        tmstru.tm_isdst = -1;
+        time_t next_time = mktime(&tmstru);
+        if (next_time + 3600 <= curr_time 
+            || (next_time <= curr_time 
+                && 0 == last_hour_.compare(day_name(next_time)))) 
+        {
+            tmstru.tm_mday += 1;
+            tmstru.tm_isdst = -1;
+            next_time = mktime(&tmstru);
+        }
+
+        if (stage_hours_ > 0) 
+        {
+            time_t stage_time = next_time - stage_hours_ * 3600;
+            while ((curr_time = time(NULL)) < stage_time) 
+            {
+                sleep(min((int)(stage_time - curr_time), 60));
+            }
+
+            if (curr_time < next_time) 
+            {
+                StageDay(day_name(next_time), next_time);
+            }
+        }
+
+        // short steps, a clock jump can't make us oversleep by much
+        while ((curr_time = time(NULL)) < next_time) 
+        {
+            sleep(min((int)(next_time - curr_time), 60));
+        }
+
+        localtime_r(&curr_time, &tmstru);
+        if (0 == last_hour_.compare(day_name(curr_time))) 
+        {
+            sleep(1);
+
+            continue;
+        }
+
+        if (create_bloom_at_ != tmstru.tm_hour) 
+        {
+            continue;
+        }
+
+        if (AddNewBloom()) 
+        {
+            UpdateRotation(now_ms() - (int64_t)next_time * 1000);
+        }
+    }
+}
+
+void BloomMgr::StartReloadMeta()
+{
+    reload_meta_thread_.reset(new boost::thread(tr1::bind(
+        &BloomMgr::ReloadMetaHandle, this)));
+    reload_meta_thread_->detach();
+
+    // the loader threads of the master are gone after the fork, this 
+    // worker maps the days still missing on its own
+    if (load_threads_ > 0) 
+    {
+        LoadDaysAsync(true);
+    }
+
+    if (wal_commit_ms_ <= 0) 
+    {
+        return;
+    }
+
+    stringstream fname;
+    fname << prefix_ << "/" << WAL_PREFIX << getpid();
+    if (!wal_.Open(fname.str(), (int64_t)wal_segment_mb_ << 20)) 
+    {
+        LOG(ERROR) << "StartReloadMeta\topen add log failed\tfname=" 
+            << fname.str();
+
+        return;
+    }
+
+    wal_thread_.reset(new boost::thread(tr1::bind(
+        &BloomMgr::WalHandle, this)));
+    wal_thread_->detach();
+}
+
+// group commit of this worker's adds
+void BloomMgr::WalHandle()
+{
+    while (true) 
+    {
+        usleep(wal_commit_ms_ * 1000);
+
+        if (wal_.Commit() < 0) 
+        {
+            LOG(ERROR) << "WalHandle\tcommit failed\terrno=" << errno;
+        }
+        wal_.Purge(__atomic_load_n(&sync_->flushed, __ATOMIC_ACQUIRE));
+    }
+}
+
+// The add logs left by the last run hold what may not have reached the 
+// files yet. Replayed into the newest day before any worker runs, then 
+// made durable and dropped. Adding is idempotent, replaying a record 
+// that did reach the files changes nothing. The logs are not in time 
+// order across processes, so the removes of a cuckoo window are read 
+// first: an add older than the remove of its vid is left out, and the 
+// removes not undone by a later add are made again after the adds.
+void BloomMgr::ReplayLogs()
+{
+    vector<string> fnames;
+    DIR *dir = opendir(prefix_.c_str());
+    if (dir) 
+    {
+        struct dirent *ent = NULL;
+        while (NULL != (ent = readdir(dir))) 
+        {
+            string fname = ent->d_name;
+            if (0 == fname.compare(0, strlen(WAL_PREFIX), WAL_PREFIX)) 
+            {
+                fnames.push_back(prefix_ + "/" + fname);
+            }
+        }
+        closedir(dir);
+    }
+
+    if (fnames.empty()) 
+    {
+        return;
+    }
+    sort(fnames.begin(), fnames.end(), wal_before);
+
+    int64_t begin = now_ms();
+    BloomDayPtr day = CurrSet()->days[0];
+    set<int64_t> fresh;
+    int64_t recs = 0;
+    int64_t skipped = 0;
+
+    map<string, int64_t> removes;
+    for (size_t i = 0; lCuckoo == layout_ && i < fnames.size(); i++) 
+    {
+        AddLog::Replay(fnames[i], tr1::bind(&BloomMgr::ReplayRemove, this, 
+            tr1::ref(removes), tr1::placeholders::_1));
+    }
+
+    for (auto &fname : fnames) 
+    {
+        recs += AddLog::Replay(fname, tr1::bind(&BloomMgr::ReplayAdd, this, 
+            day, tr1::ref(fresh), tr1::ref(skipped), tr1::ref(removes), 
+            tr1::placeholders::_1));
+    }
+
+    // key is uid \t vid
+    for (auto &rm : removes) 
+    {
+        size_t pos = rm.first.find('\t');
+        VidView v;
+        v.ptr = rm.first.c_str() + pos + 1;
+        v.len = rm.first.size() - pos - 1;
+        RemoveVids(CurrSet(), rm.first.substr(0, pos), 
+            vector<VidView>(1, v));
+    }
+
+    const bloom_set_t *set = CurrSet();
+    for (size_t i = 1; !removes.empty() && i < set->days.size(); i++) 
+    {
+        if (set->days[i]->bloom) 
+        {
+            set->days[i]->bloom->ForceSync();
+        }
+    }
+
+    day->bloom->Sync2File();
+    day->idx->sync2file();
+    day->uidx->Sync2File();
+    day->uidx->Checkpoint(day->idx->slot_num());
+    if (day->vlog) 
+    {
+        day->vlog->Sync2File();
+    }
+
+    for (auto &fname : fnames) 
+    {
+        unlink(fname.c_str());
+    }
+
+    LOG(INFO) << "ReplayLogs\tfiles=" << fnames.size() << "\trecs=" << recs 
+        << "\tskipped=" << skipped << "\trestored=" << fresh.size() 
+        << "\tremoves=" << removes.size() << "\tcost_ms=" << now_ms() - begin;
+}
+
+// the newest remove of each vid of a user
+void BloomMgr::ReplayRemove(map<string, int64_t> &removes, 
+    const add_rec_t &rec)
+{
+    if (WAL_REMOVE_SLOT != rec.slot) 
+    {
+        return;
+    }
+
+    for (auto &v : rec.vids) 
+    {
+        int64_t &ver = removes[rec.uid + "\t" + string(v.ptr, v.len)];
+        ver = max(ver, rec.ver);
+    }
+}
+
+void BloomMgr::ReplayAdd(BloomDayPtr day, set<int64_t> &fresh, 
+    int64_t &skipped, map<string, int64_t> &removes, const add_rec_t &rec)
+{
+    if (WAL_REMOVE_SLOT == rec.slot) 
+    {
+        return;
+    }
+
+    // older days were synced in full when they were rotated out
+    bloom_index_t *idx = day->idx.get();
+    if (0 != rec.name.compare(day->bloom->GetFileName()) 
+        || rec.slot < 0 || rec.slot >= idx->max_slot()) 
+    {
+        skipped++;
+
+        return;
+    }
+
+    int tier = 0;
+    bool tiered = day->bloom->GetTiers() > 0;
+    if (!idx->published(rec.slot)) 
+    {
+        // the record itself was lost, the counter may have been too
+        int64_t *counter = (int64_t *)idx->mptr;
+        if (*counter <= rec.slot) 
+        {
+            *counter = rec.slot + 1;
+        }
+
+        int64_t prev = day->uidx->Find(rec.uid);
+        if (tiered && !PlaceSlot(day.get(), rec.slot, 
+            NextTier(day.get(), prev))) 
+        {
+            skipped++;
+
+            return;
+        }
+
+        idx->publish(rec.slot, rec.uid, 0, prev < 0);
+        fresh.insert(rec.slot);
+
+        if (!day->uidx->Contains(rec.uid, rec.slot)) 
+        {
+            day->uidx->Insert(rec.uid, rec.slot);
+        }
+    } 
+    else if (tiered && SlotOffset(day.get(), rec.slot, tier) < 0) 
+    {
+        // the record made it and its place did not, the bits go to a 
+        // new place
+        if (!PlaceSlot(day.get(), rec.slot, 
+            NextTier(day.get(), day->uidx->Next(rec.slot)))) 
+        {
+            skipped++;
+
+            return;
+        }
+
+        idx->set_adds(rec.slot, 0);
+        fresh.insert(rec.slot);
+    }
+
+    if (fresh.count(rec.slot)) 
+    {
+        idx->add_adds(rec.slot, rec.vids.size());
+    }
+
+    int64_t offset = SlotOffset(day.get(), rec.slot, tier);
+    int hash_type = day->bloom->GetHashType();
+    int hash_num = day->bloom->GetHashNum(tier);
+    vector<int64_t> hashs;
+    hashs.reserve(hash_num);
+    // logged again, the copy that may have made it is dropped on freezing
+    vector<vid_key_t> keys;
+    for (auto &v : rec.vids) 
+    {
+        if (!removes.empty()) 
+        {
+            auto it = removes.find(rec.uid + "\t" + string(v.ptr, v.len));
+            if (removes.end() != it && it->second >= rec.ver) 
+            {
+                continue;
+            }
+
+            // added again since, the remove is void
+            if (removes.end() != it) 
+            {
+                removes.erase(it);
+            }
+        }
+
+        Hash::CalcHash(v.ptr, v.len, hash_type, hash_num, hashs);
+        day->bloom->Add(offset, hashs, tier);
+        if (day->vlog) 
+        {
+            keys.push_back(VidLog::KeyOf(hashs));
+        }
+        hashs.clear();
+    }
+
+    if (day->vlog) 
+    {
+        day->vlog->Append(rec.slot, keys);
+    }
+
+    day->uidx->Touch(rec.slot, rec.ver);
+}
+
+void BloomMgr::ReloadMetaHandle()
+{
+    string fname = prefix_ + "/.meta";
+    last_mtime_ = mtime_ms(fname);
+
+    // WriteMeta renames .meta into place, watch the directory for it
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd >= 0 && inotify_add_watch(fd, prefix_.c_str(), 
+        IN_MOVED_TO | IN_CLOSE_WRITE) < 0) 
+    {
+        close(fd);
+        fd = -1;
+    }
+
+    if (fd < 0) 
+    {
+        LOG(ERROR) << "ReloadMetaHandle\tinotify failed, polling .meta"
+            << "\tprefix=" << prefix_ << "\terrno=" << errno;
+    }
+
+    // the master removes a closed day's hugetlbfs copy once it is 
+    // written back, this worker then moves the day onto the file too
+    if (fd >= 0 && mHugetlb == mem_backing_ && inotify_add_watch(fd, 
+        hugetlb_dir_.c_str(), IN_DELETE) < 0) 
+    {
+        LOG(ERROR) << "ReloadMetaHandle\tinotify failed\thugetlb_dir=" 
+            << hugetlb_dir_ << "\terrno=" << errno;
+    }
+
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (1) 
+    {
+        if (fd >= 0) 
+        {
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            if (poll(&pfd, 1, META_POLL_SEC * 1000) > 0) 
+            {
+                // only a wakeup, the mtime check below decides
+                if (read(fd, buf, sizeof(buf)) < 0 && EINTR != errno) 
+                {
+                    sleep(1);
+                }
+            }
+        } 
+        else 
+        {
+            sleep(META_POLL_SEC);
+        }
+
+        int64_t mtime = mtime_ms(fname);
+        if (last_mtime_ != mtime) 
+        {
+            if (ReloadMeta()) 
+            {
+                UpdateRotation(now_ms() - mtime);
+            }
+            last_mtime_ = mtime;
+        }
+
+        if (mHugetlb == mem_backing_) 
+        {
+            SettleDays();
+        }
+    }
+}
+
+void BloomMgr::UpdateRotation(int64_t lag_ms)
+{
+    __atomic_store_n(&rotation_lag_ms_, lag_ms, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&rotations_, 1, __ATOMIC_RELAXED);
+
+    LOG(INFO) << "Rotation\tpid=" << getpid() << "\tlast_hour=" << last_hour_
+        << "\trotation_lag_ms=" << lag_ms;
+}
+
+string BloomMgr::GetStats()
+{
+    EpochGuard guard(epoch_);
+    const bloom_set_t *set = CurrSet();
+
+    size_t ready_days = 0;
+    size_t frozen_days = 0;
+    for (auto &day : set->days) 
+    {
+        if (day_ready(day.get())) 
+        {
+            ready_days++;
+        }
+
+        if (day->frozen) 
+        {
+            frozen_days++;
+        }
+    }
+
+    // places taken in each size class of the newest day
+    stringstream tier_slots;
+    bloom_day_t *newest = set->days[0].get();
+    for (int t = 0; t < newest->bloom->GetTiers(); t++) 
+    {
+        tier_slots << (t > 0 ? "," : "") << newest->idx->places(t);
+    }
+
+    stringstream ss;
+    ss << "pid=" << getpid() 
+        << "\tdays=" << set->days.size()
+        << "\tready_days=" << ready_days
+        << "\tfrozen_days=" << frozen_days
+        << "\tnewest=" << set->days[0]->bloom->GetFileName()
+        << "\tuid_num=" << set->days[0]->uidx->GetUidNum()
+        << "\tbloom_num=" << set->days[0]->idx->slot_num()
+        << "\tmem_backing=" << set->days[0]->bloom->GetBacking()
+        << "\ttier_slots=" << tier_slots.str()
+        << "\trotations=" << __atomic_load_n(&rotations_, __ATOMIC_RELAXED)
+        << "\trotation_lag_ms=" 
+        << __atomic_load_n(&rotation_lag_ms_, __ATOMIC_RELAXED);
+
+    // read off the directory, so any process can tell how much of the 
+    // expired days the master still has to release
+    int64_t reclaim_files = 0;
+    int64_t reclaim_bytes = 0;
+    DIR *dir = opendir(prefix_.c_str());
+    if (dir) 
+    {
+        struct dirent *ent = NULL;
+        while (NULL != (ent = readdir(dir))) 
+        {
+            struct stat sb;
+            string fname = ent->d_name;
+            if (0 == fname.compare(0, strlen(TRASH_PREFIX), TRASH_PREFIX) 
+                && 0 == stat((prefix_ + "/" + fname).c_str(), &sb)) 
+            {
+                reclaim_files++;
+                reclaim_bytes += (int64_t)sb.st_blocks * 512;
+            }
+        }
+        closedir(dir);
+    }
+
+    ss << "\treclaim_files=" << reclaim_files 
+        << "\treclaim_bytes=" << reclaim_bytes
+        << "\tsync_gen=" << __atomic_load_n(&sync_->request, __ATOMIC_ACQUIRE)
+        << "\tsynced_gen=" << GetSyncedGen();
+
+    return ss.str();
+}
+
+bool BloomMgr::ReloadMeta()
+{
+    bool reloaded = false;
+    string fname = prefix_ + "/.meta";
+    fstream fin(fname, ios::binary | ios::in);
+    if (!fin.is_open() || !fin.good()) 
+    {
+        return false;
+    }
+
+    bool newest = true;
+    while (!fin.eof()) 
+    {
+        string line;
+        getline(fin, line);
+        if (line.empty()) 
+        {
+            continue;
+        } 
+
+        bloom_meta_t meta;
+        if (!ParseMeta(line, meta)) 
+        {
+            continue;
+        }
+
+        if (!newest) 
+        {
+            if (meta.frozen) 
+            {
+                ReloadFrozen(meta);
+            }
+
+            continue;
+        }
+        newest = false;
 
-        BloomIdxPtr bloom_idx(new bloom_index_t);
-        if (!bloom_idx) 
+        boost::mutex::scoped_lock lock(update_mutex_);
+
+        if (0 == meta.name.compare(set_->days[0]->name)) 
         {
-            break;
-        }
-        bloom_idx->fname = prefix_ + "/.idx_" + fname;
-        bloom_idx->fsize = sizeof(int64_t) 
-            + sizeof(bloom_offset_t) * bloom_num_;
+            continue;
+        } 
 
-        if (!LoadIndex(bloom_idx, fname)) 
+        BloomDayPtr day = LoadDay(meta, true);
+        if (!day) 
         {
             break;
         }
 
-        boost::unique_lock<boost::shared_mutex> lock(mutex_); 
-        {
-            blooms_.push_front(bloom);
-            bloom_idxs_.push_front(bloom_idx);
-            if (blooms_.size() > days_) 
-            {
-                MapBloomPtr oldest_bloom = blooms_.back();
-                oldest_bloom->SetDelete(true);
-                string bloom_name = oldest_bloom->GetFileName();
+        PushDay(day);
+        last_hour_ = meta.name;
+        reloaded = true;
+
+        LOG(INFO) << "ReloadMeta\tbloom_name=" << prefix_ << "/" << meta.name 
+            << "\tuid_num=" << day->uidx->GetUidNum()
+            << "\tbloom_num=" << day->idx->slot_num();
+    }
 
-                blooms_.pop_back();
+    fin.close();
 
-                BloomIdxPtr oldest_idx = bloom_idxs_.back();
-                oldest_idx->need_del = true;
-                bloom_idxs_.pop_back();
+    return reloaded;
+}
 
-                StartDeleteBloomIdx(bloom_name);
+// a closed day the master has frozen since, or one still loading here 
+// that was frozen before it got its turn
+bool BloomMgr::ReloadFrozen(const bloom_meta_t &meta)
+{
+    {
+        EpochGuard guard(epoch_);
+        bool found = false;
+        for (auto &day : CurrSet()->days) 
+        {
+            if (0 == day->name.compare(meta.name) && !day->frozen) 
+            {
+                found = true;
             }
         }
 
-        LOG(INFO) << "ReloadMeta\tbloom_name=" << bfname 
-            << "\toffset_num=" << uid2offset_.size()
-            << "\tbloom_num=" << bloom2uid_[fname].size()
-            << "\tlast_idx=" << last_idxs_;
+        if (!found) 
+        {
+            return false;
+        }
+    }
+
+    BloomDayPtr day = LoadDay(meta, false, true);
+    if (!day) 
+    {
+        LOG(ERROR) << "ReloadFrozen\tload failed\tbloom_name=" << prefix_ 
+            << "/" << meta.name;
 
-        break;
+        return false;
     }
+    day->idx->need_sync = false;
+    day->uidx->StopFlush();
 
-    fin.close();
+    bool installed = InstallDay(day);
+
+    LOG(INFO) << "ReloadFrozen\tbloom_name=" << prefix_ << "/" << meta.name 
+        << "\tinstalled=" << installed << "\tuser_num=" 
+        << day->frozen->GetUserNum();
+
+    return installed;
 }
 
 bool BloomMgr::Add(ContextPtr ctx)
 {
-    SyncBloomIndex();
-
-    string key;
-    string bloom_name;
     bool new_bloom = false;
-    char *pIdx = NULL;
-    int64_t valid_idx = 0;
-    int64_t bloom_size = 0;
+    bool new_uid = false;
+    int64_t slot = -1;
+    int64_t offset = -1;
+    int tier = 0;
     int vid_num = ctx->finfo_.vid_size;
 
-    BloomOffsetPtr newest_offset;
-    MapBloomPtr newest_bloom; 
-    BloomIdxPtr newest_idx;
-    {
-        boost::shared_lock<boost::shared_mutex> lock(mutex_);
-        newest_bloom = *(blooms_.begin());
-        newest_idx = *(bloom_idxs_.begin());
+    EpochGuard guard(epoch_);
+    const bloom_set_t *set = CurrSet();
+    bloom_day_t *newest = set->days[0].get();
+    MapBloom *newest_bloom = newest->bloom.get(); 
+    bloom_index_t *newest_idx = newest->idx.get();
+    UidIndex *newest_uidx = newest->uidx.get();
 
-        bloom_size = newest_bloom->GetBitNum() / 8;
-        bloom_name = newest_bloom->GetFileName();
-        key = bloom_name + "_" + ctx->uid_;
-        auto it = uid2offset_.find(key);
-        if (it != uid2offset_.end()) 
+    slot = newest_uidx->Find(ctx->uid_);
+    if (slot >= 0) 
+    {
+        offset = SlotOffset(newest, slot, tier);
+        int64_t max_adds = SlotMaxAdds(newest, tier);
+        int64_t adds = newest_idx->get_adds(slot);
+        if (offset < 0 || (adds + vid_num) > max_adds) 
         {
-            newest_offset = *(it->second.begin());
-            if ((newest_offset->adds + vid_num) > max_adds_) 
-            {
-                valid_idx = newest_offset->offset / bloom_size;
-                pIdx = newest_idx->mptr + (sizeof(int64_t) 
-                    + sizeof(bloom_offset_t) * valid_idx);
-
-                memcpy(pIdx + UID_LEN + sizeof(int64_t) * 3, &max_adds_, 
-                    sizeof(int64_t));
-                newest_offset->adds = max_adds_;
+            newest_idx->set_adds(slot, max_adds);
 
-                new_bloom = true;
-            }
-        } 
-        else 
-        {
             new_bloom = true;
         }
+    } 
+    else 
+    {
+        new_bloom = true;
+        new_uid = true;
     }
 
     if (new_bloom) 
     {
-        ScopedLock plock(proc_mutex_);
+        slot = NewSlot(newest, ctx->uid_, slot, vid_num, new_uid);
+        if (slot < 0) 
+        {
+            ctx->err_ = eForbid;
+
+            LOG(ERROR) << "bloom_overflow"
+                << "\tbloom_num=" << bloom_num_ << "\tuid=" << ctx->uid_
+                << "\tsid=" << ctx->sid_;
+
+            return false;
+        }
+        offset = SlotOffset(newest, slot, tier);
+    } 
+    else 
+    {
+        newest_idx->add_adds(slot, vid_num);
+    }
+
+    int hash_type = newest_bloom->GetHashType();
+    int hash_num = newest_bloom->GetHashNum(tier);
+    vector<int64_t> hashs;
+    hashs.reserve(hash_num);
+    vector<vid_key_t> keys;
+    auto &finfo = ctx->finfo_;
+    // the vids from here on go to slot
+    uint32_t from = 0;
+    for (uint32_t i = 0, g = 0; i < finfo.vids.size(); i++) 
+    {
+        const VidView &v = finfo.vids[i];
+        Hash::CalcHash(v.ptr, v.len, hash_type, hash_num, hashs);
+        while (!newest_bloom->Add(offset, hashs, tier)) 
         {
-            valid_idx = *(int64_t *)(newest_idx->mptr);
-            valid_idx += 1;
-            if (valid_idx > bloom_num_) 
+            // a cuckoo slot full ahead of its count, the vids left go to 
+            // a new slot of the user, the hash values are the same
+            LogAdd(newest, slot, ctx->uid_, vector<VidView>(
+                finfo.vids.begin() + from, finfo.vids.begin() + i));
+            newest_idx->set_adds(slot, SlotMaxAdds(newest, tier));
+
+            slot = NewSlot(newest, ctx->uid_, slot, vid_num - i, false);
+            if (slot < 0) 
             {
                 ctx->err_ = eForbid;
 
@@ -642,117 +2367,173 @@ bool BloomMgr::Add(ContextPtr ctx)
 
                 return false;
             }
-
-            memcpy(newest_idx->mptr, &valid_idx, sizeof(int64_t));
+            offset = SlotOffset(newest, slot, tier);
+            from = i;
+        }
+        if (newest->vlog) 
+        {
+            keys.push_back(VidLog::KeyOf(hashs));
         }
+        hashs.clear();
 
-        pIdx = newest_idx->mptr + (sizeof(int64_t) 
-            + sizeof(bloom_offset_t) * (valid_idx - 1));
+        if (i > 0) 
+        {
+            ctx->add_vids_ << ((i == finfo.groups[g]) ? "|" : ",");
+        }
+        if (i == finfo.groups[g]) 
+        {
+            g++;
+        }
+        ctx->add_vids_.write(v.ptr, v.len);
+    }
 
-        newest_offset.reset(new bloom_offset_t);
-        strncpy(newest_offset->uid, ctx->uid_.c_str(), ctx->uid_.size());
-        memcpy(pIdx, newest_offset->uid, UID_LEN);
-        pIdx += UID_LEN;
+    // a full log only keeps the day from being frozen
+    if (newest->vlog && !newest->vlog->Append(slot, keys)) 
+    {
+        LOG(ERROR) << "vid_log_full\tname=" << newest->name;
+    }
 
-        newest_offset->offset = bloom_size * (valid_idx - 1);
-        memcpy(pIdx, &newest_offset->offset, sizeof(int64_t));
-        pIdx += sizeof(int64_t);
+    if (0 == from) 
+    {
+        LogAdd(newest, slot, ctx->uid_, finfo.vids);
+    } 
+    else 
+    {
+        LogAdd(newest, slot, ctx->uid_, vector<VidView>(
+            finfo.vids.begin() + from, finfo.vids.end()));
+    }
 
-        newest_offset->len = bloom_size;
-        memcpy(pIdx, &newest_offset->len, sizeof(int64_t));
-        pIdx += sizeof(int64_t);
+    return true;
+}
 
-        newest_offset->max_adds = max_adds_;
-        memcpy(pIdx, &newest_offset->max_adds, sizeof(int64_t));
-        pIdx += sizeof(int64_t);
+// a new slot at the head of the chain of uid in day, -1 once the day 
+// is out of slots
+int64_t BloomMgr::NewSlot(bloom_day_t *day, const string &uid, 
+    int64_t prev, int64_t adds, bool intern)
+{
+    int tier = NextTier(day, prev);
+    int64_t slot = day->idx->alloc_slot();
+    if (slot >= day->idx->max_slot() 
+        || (day->bloom->GetTiers() > 0 && !PlaceSlot(day, slot, tier))) 
+    {
+        return -1;
+    }
 
-        newest_offset->adds = vid_num; 
-        memcpy(pIdx, &newest_offset->adds, sizeof(int64_t));
-        pIdx += sizeof(int64_t);
+    day->idx->publish(slot, uid, adds, intern);
+    day->uidx->Insert(uid, slot);
 
-        boost::unique_lock<boost::shared_mutex> lock(mutex_); 
-        {
-            last_idxs_ = valid_idx;
+    return slot;
+}
 
-            auto it_off = uid2offset_.find(key);
-            if (it_off != uid2offset_.end()) 
-            {
-                it_off->second.push_front(newest_offset);
-            } 
-            else 
-            {
-                list<BloomOffsetPtr> boffset;
-                boffset.push_front(newest_offset);
-                uid2offset_[key] = boffset;
-            }
+// logged before the version moves, so a flush that covers the version 
+// covers the record
+void BloomMgr::LogAdd(bloom_day_t *day, int64_t slot, const string &uid, 
+    const vector<VidView> &vids)
+{
+    int64_t ver = now_ms();
+    wal_.Append(day->bloom->GetFileName(), slot, ver, uid, vids);
+    day->uidx->Touch(slot, ver);
+}
 
-            auto it_bloom = bloom2uid_.find(bloom_name);
-            if (it_bloom != bloom2uid_.end()) 
-            {
-                it_bloom->second.push_back(ctx->uid_); 
-            } 
-            else 
-            {
-                list<string> uids;
-                uids.push_back(ctx->uid_);
-                bloom2uid_[bloom_name] = uids;
-            }
-        }
-    } 
-    else 
+bool BloomMgr::Remove(ContextPtr ctx)
+{
+    EpochGuard guard(epoch_);
+    const bloom_set_t *set = CurrSet();
+    bloom_day_t *newest = set->days[0].get();
+    // a day from before "layout" : 2, or one still loading, would keep 
+    // the vids, the remove is refused until all the window is cuckoo
+    for (auto &day : set->days) 
     {
-        valid_idx = newest_offset->offset / bloom_size;
-        pIdx = newest_idx->mptr + (sizeof(int64_t) 
-            + sizeof(bloom_offset_t) * valid_idx);
+        if (NULL == day->bloom || lCuckoo != day->bloom->GetLayout()) 
+        {
+            ctx->err_ = eForbid;
 
-        int64_t off = UID_LEN + sizeof(int64_t) * 3;
-        int64_t adds = *(int64_t *)(pIdx + off);
-        adds += vid_num;
-        memcpy(pIdx + off, &adds, sizeof(int64_t));
-        newest_offset->adds = adds;
+            return false;
+        }
     }
 
-    vector<int64_t> hashs;
-    hashs.reserve(8);
-    for (int i = 0; i < ctx->finfo_.vids.size(); i++) 
-    {
-        list<string> lv = ctx->finfo_.vids[i];
-        auto itl = lv.begin();
-        for (int j = 0; itl != lv.end(); ++itl, j++) 
-        {
-            CalcHash(*itl, hashs);
-            newest_bloom->Add(newest_offset->offset, hashs);
-            hashs.clear();
-            ctx->add_vids_ << *itl; 
-            if (j < lv.size() - 1)
-            {
-                ctx->add_vids_ << ",";
-            }
+    auto &finfo = ctx->finfo_;
+    int64_t removed = RemoveVids(set, ctx->uid_, finfo.vids);
+    for (uint32_t i = 0, g = 0; i < finfo.vids.size(); i++) 
+    {
+        if (i > 0) 
+        {
+            ctx->add_vids_ << ((i == finfo.groups[g]) ? "|" : ",");
         }
-
-        if (i < ctx->finfo_.vids.size() - 1)
+        if (i == finfo.groups[g]) 
         {
-            ctx->add_vids_ << "|";
+            g++;
         }
+        ctx->add_vids_.write(finfo.vids[i].ptr, finfo.vids[i].len);
+    }
+
+    if (0 == removed) 
+    {
+        return true;
+    }
+
+    // the slots of the newest day go with the next flush, the older 
+    // days are written back in full by it
+    int64_t ver = now_ms();
+    wal_.Append(newest->bloom->GetFileName(), WAL_REMOVE_SLOT, ver, 
+        ctx->uid_, finfo.vids);
+    for (int64_t slot = newest->uidx->Find(ctx->uid_); slot >= 0; 
+        slot = newest->uidx->Next(slot)) 
+    {
+        newest->uidx->Touch(slot, ver);
     }
 
     return true;
 }
 
-void BloomMgr::CalcHash(string &vid, vector<int64_t> &hashs)
+// drops vids from every cuckoo slot of uid in the days of set, returns 
+// the fingerprints dropped
+int64_t BloomMgr::RemoveVids(const bloom_set_t *set, const string &uid, 
+    const vector<VidView> &vids)
 {
-    for (auto h : hash_handles_) 
+    vector<user_bloom_t> ubs;
+    FindUser(set, uid, set->days.size(), ubs);
+
+    int64_t removed = 0;
+    vector<int64_t> hashs[2];
+    for (auto &v : vids) 
     {
-        hashs.push_back(h(vid));
+        if (v.empty()) 
+        {
+            continue;
+        }
+
+        hashs[hLegacy].clear();
+        hashs[hDouble].clear();
+        for (auto &ub : ubs) 
+        {
+            if (NULL == ub.bloom || lCuckoo != ub.bloom->GetLayout()) 
+            {
+                continue;
+            }
+
+            int t = (hDouble == ub.bloom->GetHashType()) ? hDouble : hLegacy;
+            if (hashs[t].empty()) 
+            {
+                Hash::CalcHash(v.ptr, v.len, t, 1, hashs[t]);
+            }
+
+            for (size_t i = 0; i < ub.offsets.size(); i++) 
+            {
+                if (ub.bloom->Remove(ub.offsets[i], hashs[t], ub.tiers[i])) 
+                {
+                    removed++;
+                }
+            }
+        }
     }
+
+    return removed;
 }
 
 void BloomMgr::Get(ContextPtr ctx)
 {
-    SyncBloomIndex();
-
     auto &finfo = ctx->finfo_;
-    auto &res_infos = finfo.res_infos;
     auto &filtered_vids = ctx->filtered_vids_;
     if (filtered_vids.str().size() > 0)
     {
@@ -760,359 +2541,353 @@ void BloomMgr::Get(ContextPtr ctx)
     }
     int days = ctx->days_ < 0 ? days_ : ctx->days_;
 
-    for (int i = 0; i < finfo.vids.size(); i++) 
+    EpochGuard guard(epoch_);
+    vector<user_bloom_t> ubs;
+    FindUser(CurrSet(), ctx->uid_, days, ubs);
+
+    finfo.hits.assign(finfo.vids.size(), 0);
+    for (uint32_t i = 0, g = 0; i < finfo.vids.size(); i++) 
     {
-        ResInfo res_info;
-        list<string> lv = finfo.vids[i];
-        auto itl = lv.begin();
-        for (int j = 0; itl != lv.end(); ++itl, j++)
+        if (i == finfo.groups[g]) 
+        {
+            filtered_vids << "|";
+            g++;
+        }
+
+        const VidView &v = finfo.vids[i];
+        if (!v.empty() && Lookup(ubs, v)) 
         {
-            if (!(*itl).empty()) 
+            finfo.hits[i] = 1;
+            filtered_vids.write(v.ptr, v.len);
+            if (i + 1 < finfo.groups[g])
             {
-                if (Lookup(ctx->uid_, *itl, days)) 
-                {
-                    filtered_vids << *itl;
-                    if (j < lv.size() - 1)
-                    {
-                        filtered_vids << ",";
-                    }
-                } 
-                else 
-                {
-                    res_info.vids.push_back(*itl);
-                }
+                filtered_vids << ",";
             }
         }
+    }
+}
 
-        if (res_infos.size() > i) 
-        { 
-            res_infos[i].push_back(res_info);  
-        } 
-        else 
+void BloomMgr::FindUser(const bloom_set_t *set, const string &uid, 
+    int days, vector<user_bloom_t> &ubs)
+{
+    for (int i = 0; i < set->days.size() && i < days; i++) 
+    {
+        bloom_day_t *day = set->days[i].get();
+        if (!day_ready(day)) 
         {
-            vector<ResInfo> res;
-            res.push_back(res_info);
-            res_infos[i] = res;
+            continue;
         }
 
-        if (i < finfo.vids.size() - 1)
+        int64_t slot = day->uidx->Find(uid);
+        if (slot < 0) 
         {
-            filtered_vids << "|";
+            continue;
         }
-    }
-}
-
-bool BloomMgr::Lookup(string &uid, string &vid, int days)
-{
-    vector<int64_t> hashs;
-    hashs.reserve(8);
-    CalcHash(vid, hashs);
-    bool found = false;
-    bool ret = false;
-    
-    boost::shared_lock<boost::shared_mutex> lock(mutex_);
 
-    auto it = blooms_.begin();
-    for (int i = 0; (it != blooms_.end() && !found && i < days); ++it, i++) 
-    {
-        string key = (*it)->GetFileName() + "_" + uid;
-        auto it_off_m = uid2offset_.find(key);
-        if (it_off_m == uid2offset_.end()) 
+        // one filter for the whole chain, kept at its newest slot
+        if (day->frozen) 
         {
+            user_bloom_t ub;
+            ub.fuse = day->frozen->GetFilter(slot);
+            if (ub.fuse) 
+            {
+                ubs.push_back(ub);
+            }
+
             continue;
         }
 
-        auto it_off_l = it_off_m->second.begin();
-        for (; it_off_l != it_off_m->second.end() && !found; ++it_off_l) 
+        user_bloom_t ub;
+        ub.bloom = day->bloom.get();
+        for (; slot >= 0; slot = day->uidx->Next(slot)) 
         {
-            ret = (*it)->Lookup((*it_off_l)->offset, hashs);
-            found = found || ret;
+            int tier = 0;
+            int64_t offset = SlotOffset(day, slot, tier);
+            if (offset >= 0) 
+            {
+                ub.offsets.push_back(offset);
+                ub.tiers.push_back(tier);
+            }
         }
+        ubs.push_back(ub);
+    }
+}
+
+// where the bits of slot are, -1 for a slot of a tiered day that was 
+// never placed
+int64_t BloomMgr::SlotOffset(bloom_day_t *day, int64_t slot, int &tier)
+{
+    tier = 0;
+    if (NULL == day->idx->locs) 
+    {
+        return day->idx->slot_len * slot;
     }
 
-    return found;
+    return day->idx->get_loc(slot, tier);
 }
 
-void BloomMgr::GetBloom(ContextPtr ctx)
+int64_t BloomMgr::SlotBitNum(bloom_day_t *day, int tier)
 {
-    SyncBloomIndex();
+    if (day->frozen) 
+    {
+        return day->frozen->GetBitNum(tier);
+    }
 
-    // type,ts,bits,len
-    int head_sz = sizeof(int32_t) + BLOOM_NAME_SZ + sizeof(int64_t) * 2;
-    int32_t bloom_num = 0;
-    char *last_bloom_ptr = NULL;
-    int last_bloom_len = 0;
+    return day->bloom->GetBitNum(tier);
+}
 
-    boost::shared_lock<boost::shared_mutex> lock(mutex_);
+// a tier holds twice the vids of the one below, its extra bits go to 
+// the tighter fail rate
+int64_t BloomMgr::SlotMaxAdds(bloom_day_t *day, int tier)
+{
+    return max_adds_ << tier;
+}
 
-    for (auto &b : blooms_) 
+// the tier of the slot that follows prev in a user's chain, one up
+int BloomMgr::NextTier(bloom_day_t *day, int64_t prev)
+{
+    int tier = 0;
+    if (prev < 0 || 0 == day->bloom->GetTiers() 
+        || SlotOffset(day, prev, tier) < 0) 
     {
-        string bloom_name = b->GetFileName();
-        if (0 == bloom_name.compare(ctx->ts_)) 
-        {
-            break;
-        }
+        return 0;
+    }
+
+    return min(tier + 1, day->bloom->GetTiers() - 1);
+}
 
-        string key = bloom_name + "_" + ctx->uid_;
-        auto off = uid2offset_.find(key);
-        if (off == uid2offset_.end()) 
+// takes a free place in the region of tier for slot, or of the next 
+// tier up, or down once the top one is full too
+bool BloomMgr::PlaceSlot(bloom_day_t *day, int64_t slot, int tier)
+{
+    MapBloom *bloom = day->bloom.get();
+    int tiers = bloom->GetTiers();
+    for (int i = 0; i < tiers; i++) 
+    {
+        int t = (tier + i < tiers) ? tier + i : tiers - 1 - i;
+        const bloom_tier_t &bt = bloom->GetTier(t);
+        if (day->idx->places(t) >= bt.slot_num) 
         {
             continue;
         }
 
-        char *last_ptr = NULL;
-        int last_len = 0;
-
-        for (auto &o : off->second) 
+        int64_t pos = day->idx->alloc_place(t);
+        if (pos < bt.slot_num) 
         {
-            bloom_num++;
+            day->idx->set_loc(slot, t, bt.base + (bt.bit_num / 8) * pos);
 
-            int offset = 0;
-            int len = head_sz + o->len;
-            char *ptr = (char *)calloc(1, len);
-
-            memcpy(ptr + offset, &type_, sizeof(int32_t));
-            offset += sizeof(int32_t);
-
-            strncpy(ptr + offset, bloom_name.c_str(), bloom_name.size());
-            offset += BLOOM_NAME_SZ;
-
-            int64_t bit_num = b->GetBitNum();
-            memcpy(ptr + offset, &bit_num, sizeof(int64_t));
-            offset += sizeof(int64_t);
+            return true;
+        }
+    }
 
-            memcpy(ptr + offset, &o->len, sizeof(int64_t));
-            offset += sizeof(int64_t);
+    return false;
+}
 
-            char *mptr = b->GetMapPtr();
-            memcpy(ptr + offset, mptr + o->offset, o->len);
-            offset += o->len;
+bool BloomMgr::Lookup(vector<user_bloom_t> &ubs, const VidView &vid)
+{
+    // days of different hash schemes may be mixed inside the window, 
+    // hash the vid lazily once per scheme
+    vector<int64_t> hashs[2];
+    int hash_nums[2] = {0, 0};
 
-            if (NULL == last_ptr && 0 == last_len) 
-            {
-                last_ptr = ptr;
-                last_len = len;
-            } 
-            else 
+    for (auto &ub : ubs) 
+    {
+        // a frozen day keeps the first double hash of each vid, the same 
+        // for any hash_num
+        if (ub.fuse) 
+        {
+            if (0 == hash_nums[hDouble]) 
             {
-                int new_len = last_len + len;
-                char *new_ptr = (char *)calloc(1, new_len);
-                memcpy(new_ptr, last_ptr, last_len);
-                memcpy(new_ptr + last_len, ptr, len);
-                free(ptr);
-                free(last_ptr);
-                last_ptr = new_ptr;
-                last_len = new_len;
+                hash_nums[hDouble] = 1;
+                Hash::CalcHash(vid.ptr, vid.len, hDouble, 1, hashs[hDouble]);
             }
-        }
-
-        if (NULL == last_bloom_ptr && 0 == last_bloom_len) 
-        {
-            last_bloom_ptr = last_ptr;
-            last_bloom_len = last_len;
-        } 
-        else 
-        {
-            int new_bloom_len = last_bloom_len + last_len;
-            char *new_bloom_ptr = (char *)calloc(1, new_bloom_len);
-            memcpy(new_bloom_ptr, last_bloom_ptr, last_bloom_len);
-            memcpy(new_bloom_ptr + last_bloom_len, last_ptr, last_len);
-            free(last_ptr);
-            free(last_bloom_ptr);
-            last_bloom_ptr = new_bloom_ptr;
-            last_bloom_len = new_bloom_len;
-        }
-    }
 
-    if (NULL == ctx->total_ptr_ && 0 == ctx->total_len_) 
-    {
-        int total_len = sizeof(int32_t) + last_bloom_len;
-        char *total_ptr = (char *)calloc(1, total_len);
-
-        memcpy(total_ptr, &bloom_num, sizeof(int32_t));
+            if (FuseFilter::Contains(ub.fuse, hashs[hDouble][0])) 
+            {
+                return true;
+            }
 
-        if (last_bloom_len > 0) 
-        {
-            memcpy(total_ptr + sizeof(int32_t), 
-                last_bloom_ptr, last_bloom_len);
-            free(last_bloom_ptr);
+            continue;
         }
 
-        ctx->total_ptr_ = total_ptr;
-        ctx->total_len_ = total_len; 
-        ctx->blooms_ = string(ctx->total_ptr_, ctx->total_len_);
-    } 
-    else 
-    {
-        if (last_bloom_len > 0) 
+        int t = (hDouble == ub.bloom->GetHashType()) ? hDouble : hLegacy;
+        for (size_t i = 0; i < ub.offsets.size(); i++) 
         {
-            int32_t tmp = *(int32_t *)ctx->total_ptr_;
-            tmp += bloom_num;
-            memcpy(ctx->total_ptr_, &tmp, sizeof(int32_t));
+            // the tiers of a chain differ in hash_num too
+            int hash_num = ub.bloom->GetHashNum(ub.tiers[i]);
+            if (hash_nums[t] != hash_num) 
+            {
+                hash_nums[t] = hash_num;
+                hashs[t].clear();
+                Hash::CalcHash(vid.ptr, vid.len, t, hash_nums[t], hashs[t]);
+            }
 
-            int total_len = ctx->total_len_ + last_bloom_len;
-            char *total_ptr = (char *)calloc(1, total_len);
-            memcpy(total_ptr, ctx->total_ptr_, ctx->total_len_);
-            memcpy(total_ptr + ctx->total_len_, 
-                last_bloom_ptr, last_bloom_len);
-            free(last_bloom_ptr);
-            free(ctx->total_ptr_);
-            ctx->total_ptr_ = total_ptr;
-            ctx->total_len_ = total_len; 
-            ctx->blooms_ = string(ctx->total_ptr_, ctx->total_len_);
+            if (ub.bloom->Lookup(ub.offsets[i], hashs[t], ub.tiers[i])) 
+            {
+                return true;
+            }
         }
     }
+
+    return false;
 }
 
-void BloomMgr::Sync2File()
+void BloomMgr::GetBloom(ContextPtr ctx)
 {
-    SyncBloomIndex();
-
-    MapBloomPtr newest_bloom; 
-    BloomIdxPtr newest_idx;
+    // cuckoo slots are no bits a client could test
+    if (lCuckoo == layout_) 
     {
-        boost::shared_lock<boost::shared_mutex> lock(mutex_);
-        newest_bloom = *(blooms_.begin());
-        newest_idx = *(bloom_idxs_.begin());
+        ctx->err_ = eForbid;
+
+        return;
     }
 
-    newest_bloom->Sync2File();
-    newest_idx->sync2file();
-}
+    if (eDelta == ctx->mode_) 
+    {
+        GetBloomDelta(ctx);
 
-void BloomMgr::SyncBloomIndex()
-{
-    int64_t new_idx = 0;
-    int64_t old_idx = 0;
+        return;
+    }
 
-    MapBloomPtr newest_bloom; 
-    BloomIdxPtr newest_idx;
+    // the days up to ts, newest first, they stay mapped until the 
+    // guard is left even if one expires meanwhile
+    EpochGuard guard(epoch_);
+    const bloom_set_t *set = CurrSet();
+    size_t day_num = 0;
+    for (; day_num < set->days.size(); day_num++) 
     {
-        boost::shared_lock<boost::shared_mutex> lock(mutex_);
-        newest_bloom = *(blooms_.begin());
-        newest_idx = *(bloom_idxs_.begin());
-
-        int64_t curr_idx = *(int64_t *)(newest_idx->mptr);
-        if (curr_idx == last_idxs_) 
+        if (0 == set->days[day_num]->name.compare(ctx->ts_)) 
         {
-            return;
+            break;
         }
-
-        new_idx = curr_idx - last_idxs_;
-        old_idx = last_idxs_;
-        last_idxs_ = curr_idx;
     }
 
-    if (new_idx > 0) 
+    // a day of another scheme, a tiered or a frozen one would be tested 
+    // wrong, mode=1 carries them
+    for (size_t i = 0; i < day_num; i++) 
     {
-        string bloom_name = newest_bloom->GetFileName();
-        char *pIdx = newest_idx->mptr + (sizeof(int64_t) 
-            + sizeof(bloom_offset_t) * old_idx);
-
-        for (int i = 0; i < new_idx; i++) 
+        if (day_exported(set->days[i].get()) 
+            && !legacy_day(set->days[i].get())) 
         {
-            BloomOffsetPtr bloom_offset(new bloom_offset_t);
-            strncpy(bloom_offset->uid, pIdx, UID_LEN);
-            pIdx += UID_LEN;
+            ctx->err_ = eForbid;
 
-            bloom_offset->offset = *(int64_t *)pIdx;
-            pIdx += sizeof(int64_t);
-
-            bloom_offset->len = *(int64_t *)pIdx;
-            pIdx += sizeof(int64_t);
-
-            bloom_offset->max_adds = *(int64_t *)pIdx;
-            pIdx += sizeof(int64_t);
+            return;
+        }
+    }
 
-            bloom_offset->adds = *(int64_t *)pIdx; 
-            pIdx += sizeof(int64_t);
+    // the bits are copied before the guard is left
+    vector<export_slot_t> slots;
+    for (size_t i = 0; i < day_num; i++) 
+    {
+        // not loaded yet, left out, as are cuckoo days
+        bloom_day_t *day = set->days[i].get();
+        if (!day_exported(day)) 
+        {
+            continue;
+        }
 
-            if (bloom_offset->len > 0) 
+        for (int64_t slot = day->uidx->Find(ctx->uid_); slot >= 0; 
+            slot = day->uidx->Next(slot)) 
+        {
+            int tier = 0;
+            int64_t offset = SlotOffset(day, slot, tier);
+            if (offset < 0) 
             {
-                string uid = string(bloom_offset->uid);
-                string key = bloom_name + "_" + uid;
-                {
-                    boost::unique_lock<boost::shared_mutex> lock(mutex_); 
-                    auto it_off = uid2offset_.find(key);
-                    if (it_off != uid2offset_.end()) 
-                    {
-                        it_off->second.push_front(bloom_offset);
-                    } 
-                    else 
-                    {
-                        list<BloomOffsetPtr> boffset;
-                        boffset.push_front(bloom_offset);
-                        uid2offset_[key] = boffset;
-                    }
-
-                    auto it_bloom = bloom2uid_.find(bloom_name);
-                    if (it_bloom != bloom2uid_.end()) 
-                    {
-                        it_bloom->second.push_back(uid); 
-                    } 
-                    else 
-                    {
-                        list<string> uids;
-                        uids.push_back(uid);
-                        bloom2uid_[bloom_name] = uids;
-                    }
-                }
-
-                //LOG(INFO) << "SyncBloomIndex\tbloom_name=" << bloom_name 
-                //    << "\tlast_idxs=" << last_idxs_ << "\toffset_num=" 
-                //    << uid2offset_.size() << "\tkey=" << key;
+                continue;
             }
+
+            export_slot_t s;
+            s.name = day->name;
+            s.bits = day->bloom->GetMapPtr() + offset;
+            s.bit_num = SlotBitNum(day, tier);
+            s.slot = slot;
+            s.version = 0;
+            s.hash_type = day->bloom->GetHashType();
+            s.hash_num = day->bloom->GetHashNum(tier);
+            s.layout = day->bloom->GetLayout();
+            slots.push_back(s);
         }
     }
-}
 
-void BloomMgr::StartDeleteBloomIdx(string &bloom_name)
-{
-    boost::shared_ptr<boost::thread> delete_idx_thread;
-    delete_idx_thread.reset(new boost::thread(tr1::bind(
-        &BloomMgr::DeleteBloomIdxHandle, this, bloom_name)));
-    delete_idx_thread->detach();
+    BloomExport::PutFull(type_, slots, ctx->blooms_);
 }
 
-void BloomMgr::DeleteBloomIdxHandle(string &bloom_name)
+void BloomMgr::GetBloomDelta(ContextPtr ctx)
 {
-    list<string> uids;
+    // taken before any bit is read, an Add racing with the copy below 
+    // stamps its slot at or after it and is sent again next time
+    int64_t version = now_ms();
+
+    EpochGuard guard(epoch_);
+    const bloom_set_t *set = CurrSet();
+    size_t day_num = 0;
+    for (; day_num < set->days.size(); day_num++) 
     {
-        boost::unique_lock<boost::shared_mutex> lock(mutex_); 
-        auto it = bloom2uid_.find(bloom_name);
-        if (it == bloom2uid_.end()) 
+        if (0 == set->days[day_num]->name.compare(ctx->ts_)) 
         {
-            return;
+            break;
         }
-        uids = it->second;
-        bloom2uid_.erase(it);
     }
 
-    struct timeval tv; 
-    gettimeofday(&tv, NULL); 
-    int64_t start = tv.tv_sec * 1000000 + tv.tv_usec; 
-
-    auto it = uids.begin();
-    for (; it != uids.end(); ++it) 
+    // the changed slots, a frozen one is set again from its vids
+    vector<export_slot_t> slots;
+    vector<string> days;
+    list<string> rebuilt;
+    for (size_t i = 0; i < day_num; i++) 
     {
-        string key = bloom_name + "_" + *it;
+        bloom_day_t *day = set->days[i].get();
+        days.push_back(day->name);
+
+        // a day not loaded yet keeps the version where the client has 
+        // it, so its slots are sent once it is
+        if (!day_ready(day)) 
         {
-            boost::unique_lock<boost::shared_mutex> lock(mutex_); 
-            auto it_off = uid2offset_.find(key);
-            if (it_off != uid2offset_.end()) 
+            version = min(version, ctx->ver_);
+            continue;
+        }
+
+        if (!day_exported(day)) 
+        {
+            continue;
+        }
+
+        for (int64_t slot = day->uidx->Find(ctx->uid_); slot >= 0; 
+            slot = day->uidx->Next(slot)) 
+        {
+            int tier = 0;
+            int64_t offset = SlotOffset(day, slot, tier);
+            if (day->uidx->GetVersion(slot) < ctx->ver_ || offset < 0) 
             {
-                it_off->second.clear();
-                uid2offset_.erase(it_off);
+                continue;
             }
+
+            export_slot_t s;
+            s.name = day->name;
+            s.bit_num = SlotBitNum(day, tier);
+            s.slot = slot;
+            s.version = day->uidx->GetVersion(slot);
+            if (day->frozen) 
+            {
+                s.hash_type = hDouble;
+                s.hash_num = day->frozen->GetHashNum(tier);
+                s.layout = day->frozen->GetLayout();
+
+                rebuilt.push_back(string(s.bit_num / 8, 0x00));
+                day->frozen->GetBits(slot, tier, &rebuilt.back()[0]);
+                s.bits = rebuilt.back().c_str();
+            } 
+            else 
+            {
+                s.hash_type = day->bloom->GetHashType();
+                s.hash_num = day->bloom->GetHashNum(tier);
+                s.layout = day->bloom->GetLayout();
+                s.bits = day->bloom->GetMapPtr() + offset;
+            }
+            slots.push_back(s);
         }
     }
 
-    gettimeofday(&tv, NULL);
-    int64_t end =  tv.tv_sec * 1000000 + tv.tv_usec;
-
-    LOG(INFO) << "DeleteBloomIdx\tbloom_name=" << bloom_name 
-        << "\tbloom_num=" << uids.size() << "\ttype=" << type_
-        << "\tcost=" << double(end - start) / 1000 << "ms";
+    BloomExport::PutDelta(type_, version, days, slots, ctx->blooms_);
 }
 
 NAME_SPACE_ES
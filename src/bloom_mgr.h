@@ -1,7 +1,6 @@
 #ifndef BLOOM_MGR_H
 #define BLOOM_MGR_H
 
-#include <boost/interprocess/sync/interprocess_mutex.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/mutex.hpp>
@@ -10,7 +9,15 @@
 #include <vector>
 #include <list>
 #include <map>
+#include <set>
 #include "map_bloom.h"
+#include "uid_index.h"
+#include "vid_log.h"
+#include "frozen_day.h"
+#include "bloom_export.h"
+#include "bloom_engine.h"
+#include "add_log.h"
+#include "epoch.h"
 #include "hash.h"
 #include "common.h"
 #include "context.h"
@@ -22,6 +29,59 @@ using namespace std;
 
 NAME_SPACE_BS
 
+// v1 .idx_ record, still read and written for the days made before v2
+typedef struct bloom_offset_s 
+{
+    char uid[UID_LEN];
+    int64_t offset;
+    int64_t len;
+    int64_t max_adds;
+    int64_t adds; 
+
+    bloom_offset_s()
+    {
+        memset(uid, 0x00, UID_LEN);
+        offset = 0;
+        len = 0;
+        max_adds = 0;
+        adds = 0; 
+    }
+} bloom_offset_t;
+
+#define IDX_MAGIC 0x0032584449464253LL
+// uid pool bytes per slot of a v2 .idx_, uids run 10-20 chars and are 
+// interned once per day
+#define IDX_POOL_PER_SLOT 16
+// a placed slot of a tiered day: set bit | tier << 56 | byte offset
+#define IDX_LOC_SET (1ULL << 63)
+#define IDX_LOC_SHIFT 56
+
+// v2 .idx_ head, the slot counter stays first as in v1
+typedef struct idx_head_s 
+{
+    int64_t counter;
+    int64_t magic;
+    int64_t max_slot;
+    // a slot's bloom starts at slot * slot_len
+    int64_t slot_len;
+    int64_t max_adds;
+    int64_t pool_size;
+    int64_t pool_used;
+    // size classes of the bloom, 0 for one size
+    int64_t tiers;
+} idx_head_t;
+
+// .idx_ file, v1: int64_t slot counter followed by bloom_num 
+// bloom_offset_t records. v2: idx_head_t | uint64_t fp[max_slot] 
+// | uint32_t adds[max_slot] | uid pool, fp is the UidIndex key of the 
+// slot's uid, the pool holds every uid of the day once as uint8 len 
+// + bytes. A tiered day follows with int64_t counter[MAX_TIERS], the 
+// places taken in each tier's region, and uint64_t loc[max_slot], where 
+// each slot was placed. Every process allocates slots with an atomic 
+// fetch-add on the counter, and a slot is published by storing its len 
+// (v1) or fp (v2) last, so a reader treats 0 as "allocated but not yet 
+// written". Lookups go through the day's UidIndex, the slots are only 
+// read to rebuild it.
 typedef struct bloom_index_s 
 {
     bool need_sync;
@@ -30,6 +90,18 @@ typedef struct bloom_index_s
     int64_t fsize;
     char *mptr;
     string fname;
+    int version;
+    // what v1 records repeat in every slot, from the day
+    int64_t slot_len;
+    int64_t max_adds;
+    // v2 parts of the mapping
+    idx_head_t *head;
+    uint64_t *fps;
+    uint32_t *add_nums;
+    char *pool;
+    int64_t pool_synced;
+    int64_t *tier_counters;
+    uint64_t *locs;
 
     bloom_index_s()
     {
@@ -38,6 +110,16 @@ typedef struct bloom_index_s
         fd = -1;
         fsize = 0;
         mptr = NULL;
+        version = 1;
+        slot_len = 0;
+        max_adds = 0;
+        head = NULL;
+        fps = NULL;
+        add_nums = NULL;
+        pool = NULL;
+        pool_synced = 0;
+        tier_counters = NULL;
+        locs = NULL;
     }
 
     ~bloom_index_s()
@@ -65,67 +147,515 @@ typedef struct bloom_index_s
         }
     }
 
+    // v2 file size of a day of max_slot slots
+    static int64_t byte_size(int64_t max_slot, int64_t tiers = 0)
+    {
+        int64_t size = sizeof(idx_head_t) + (sizeof(uint64_t) 
+            + sizeof(uint32_t) + IDX_POOL_PER_SLOT) * max_slot;
+        if (0 == tiers) 
+        {
+            return size;
+        }
+
+        return (size + 7) / 8 * 8 + sizeof(int64_t) * MAX_TIERS 
+            + sizeof(uint64_t) * max_slot;
+    }
+
+    // writes the head of a new, zeroed v2 file
+    void format(int64_t max_slot, int64_t tiers = 0)
+    {
+        idx_head_t *h = (idx_head_t *)mptr;
+        h->counter = 0;
+        h->max_slot = max_slot;
+        h->slot_len = slot_len;
+        h->max_adds = max_adds;
+        h->pool_size = IDX_POOL_PER_SLOT * max_slot;
+        h->pool_used = 0;
+        h->tiers = tiers;
+        __atomic_store_n(&h->magic, IDX_MAGIC, __ATOMIC_RELEASE);
+    }
+
+    // tells the version of the mapped file, v1 has no head
+    bool attach()
+    {
+        idx_head_t *h = (idx_head_t *)mptr;
+        if (fsize >= (int64_t)sizeof(idx_head_t) && IDX_MAGIC == h->magic 
+            && fsize == byte_size(h->max_slot, h->tiers)) 
+        {
+            version = 2;
+            head = h;
+            fps = (uint64_t *)(mptr + sizeof(idx_head_t));
+            add_nums = (uint32_t *)(fps + h->max_slot);
+            pool = (char *)(add_nums + h->max_slot);
+            slot_len = h->slot_len;
+            max_adds = h->max_adds;
+            if (h->tiers > 0) 
+            {
+                int64_t tail = fsize - sizeof(uint64_t) * h->max_slot;
+                locs = (uint64_t *)(mptr + tail);
+                tier_counters = (int64_t *)locs - MAX_TIERS;
+            }
+
+            return true;
+        }
+
+        version = 1;
+
+        return fsize > (int64_t)sizeof(int64_t) 
+            && 0 == (fsize - sizeof(int64_t)) % sizeof(bloom_offset_t);
+    }
+
     void sync2file()
     {
         msync(mptr, fsize, MS_SYNC);
     }
+
+    int64_t sync_range(char *ptr, int64_t len)
+    {
+        if (len <= 0) 
+        {
+            return 0;
+        }
+
+        int64_t page = sysconf(_SC_PAGESIZE);
+        char *begin = mptr + (ptr - mptr) / page * page;
+        msync(begin, ptr + len - begin, MS_SYNC);
+
+        return ptr + len - begin;
+    }
+
+    // the counter page and the slots [begin, end), with the uids the pool 
+    // took since the last call, returns the bytes covered
+    int64_t sync_slots(int64_t begin, int64_t end)
+    {
+        int64_t page = sysconf(_SC_PAGESIZE);
+        msync(mptr, page, MS_SYNC);
+
+        if (1 == version) 
+        {
+            char *ptr = mptr + sizeof(int64_t) + sizeof(bloom_offset_t) * begin;
+
+            return page + sync_range(ptr, sizeof(bloom_offset_t) * (end - begin));
+        }
+
+        int64_t used = min(__atomic_load_n(&head->pool_used, __ATOMIC_ACQUIRE), 
+            head->pool_size);
+        int64_t bytes = page 
+            + sync_range((char *)(fps + begin), sizeof(uint64_t) * (end - begin))
+            + sync_range((char *)(add_nums + begin), 
+                sizeof(uint32_t) * (end - begin))
+            + sync_range(pool + pool_synced, used - pool_synced);
+        pool_synced = used;
+
+        // where the slots went, one published but never placed is skipped 
+        // by readers and placed again by ReplayAdd
+        if (locs) 
+        {
+            bytes += sync_range((char *)tier_counters, 
+                    sizeof(int64_t) * MAX_TIERS) 
+                + sync_range((char *)(locs + begin), 
+                    sizeof(uint64_t) * (end - begin));
+        }
+
+        return bytes;
+    }
+
+    int64_t max_slot() const
+    {
+        if (2 == version) 
+        {
+            return head->max_slot;
+        }
+
+        return (fsize - sizeof(int64_t)) / sizeof(bloom_offset_t);
+    }
+
+    // the counter may run past max_slot() on overflow
+    int64_t slot_num() const
+    {
+        int64_t num = __atomic_load_n((int64_t *)mptr, __ATOMIC_ACQUIRE);
+
+        return num < max_slot() ? num : max_slot();
+    }
+
+    int64_t alloc_slot()
+    {
+        return __sync_fetch_and_add((int64_t *)mptr, 1);
+    }
+
+    bloom_offset_t *record(int64_t slot) const
+    {
+        return (bloom_offset_t *)(mptr + sizeof(int64_t)) + slot;
+    }
+
+    // intern: the uid is new to the day and goes to the pool (v2)
+    void publish(int64_t slot, const string &uid, int64_t adds, bool intern)
+    {
+        if (2 == version) 
+        {
+            if (intern) 
+            {
+                intern_uid(uid);
+            }
+
+            __atomic_store_n(add_nums + slot, (uint32_t)adds, __ATOMIC_RELAXED);
+            __atomic_store_n(fps + slot, UidIndex::UidHash(uid), 
+                __ATOMIC_RELEASE);
+
+            return;
+        }
+
+        bloom_offset_t *rec = record(slot);
+        memset(rec->uid, 0x00, UID_LEN);
+        strncpy(rec->uid, uid.c_str(), UID_LEN - 1);
+        rec->offset = slot_len * slot;
+        rec->max_adds = max_adds;
+        rec->adds = adds;
+
+        __atomic_store_n(&rec->len, slot_len, __ATOMIC_RELEASE);
+    }
+
+    // a full pool takes no more uids, the slots keep their fp
+    void intern_uid(const string &uid)
+    {
+        int64_t len = min(uid.size(), (size_t)255);
+        int64_t off = __sync_fetch_and_add(&head->pool_used, len + 1);
+        if (off + len + 1 > head->pool_size) 
+        {
+            return;
+        }
+
+        memcpy(pool + off + 1, uid.c_str(), len);
+        __atomic_store_n((uint8_t *)pool + off, (uint8_t)len, __ATOMIC_RELEASE);
+    }
+
+    bool published(int64_t slot) const
+    {
+        if (2 == version) 
+        {
+            return 0 != __atomic_load_n(fps + slot, __ATOMIC_ACQUIRE);
+        }
+
+        return 0 != __atomic_load_n(&record(slot)->len, __ATOMIC_ACQUIRE);
+    }
+
+    // the UidIndex key of a published slot
+    uint64_t fp(int64_t slot) const
+    {
+        if (2 == version) 
+        {
+            return __atomic_load_n(fps + slot, __ATOMIC_ACQUIRE);
+        }
+
+        return UidIndex::UidHash(string(record(slot)->uid));
+    }
+
+    int64_t get_adds(int64_t slot) const
+    {
+        if (2 == version) 
+        {
+            return __atomic_load_n(add_nums + slot, __ATOMIC_RELAXED);
+        }
+
+        return __atomic_load_n(&record(slot)->adds, __ATOMIC_RELAXED);
+    }
+
+    void set_adds(int64_t slot, int64_t adds)
+    {
+        if (2 == version) 
+        {
+            __atomic_store_n(add_nums + slot, (uint32_t)adds, __ATOMIC_RELAXED);
+
+            return;
+        }
+
+        __atomic_store_n(&record(slot)->adds, adds, __ATOMIC_RELAXED);
+    }
+
+    // the next free place of tier, may run past the tier's slot_num
+    int64_t alloc_place(int tier)
+    {
+        return __sync_fetch_and_add(tier_counters + tier, 1);
+    }
+
+    int64_t places(int tier) const
+    {
+        return __atomic_load_n(tier_counters + tier, __ATOMIC_RELAXED);
+    }
+
+    // before the slot is published
+    void set_loc(int64_t slot, int tier, int64_t offset)
+    {
+        __atomic_store_n(locs + slot, IDX_LOC_SET 
+            | ((uint64_t)tier << IDX_LOC_SHIFT) | offset, __ATOMIC_RELEASE);
+    }
+
+    // byte offset of slot in a tiered day and its tier, -1 if the slot 
+    // was never placed (lost in a crash)
+    int64_t get_loc(int64_t slot, int &tier) const
+    {
+        uint64_t loc = __atomic_load_n(locs + slot, __ATOMIC_ACQUIRE);
+        if (0 == (loc & IDX_LOC_SET)) 
+        {
+            return -1;
+        }
+
+        tier = (loc & ~IDX_LOC_SET) >> IDX_LOC_SHIFT;
+
+        return loc & ((1ULL << IDX_LOC_SHIFT) - 1);
+    }
+
+    void add_adds(int64_t slot, int64_t num)
+    {
+        if (2 == version) 
+        {
+            __sync_fetch_and_add(add_nums + slot, (uint32_t)num);
+
+            return;
+        }
+
+        __sync_fetch_and_add(&record(slot)->adds, num);
+    }
 } bloom_index_t;
 
 typedef boost::shared_ptr<bloom_index_t> BloomIdxPtr;
 
-typedef struct bloom_offset_s 
+// one line of .meta, tab separated, newest day first:
+// name bloom_num capacity fail_rate bit_num [hash_type] [layout] [tiers] 
+// [frozen]
+typedef struct bloom_meta_s 
 {
-    char uid[UID_LEN];
-    int64_t offset;
-    int64_t len;
-    int64_t max_adds;
-    int64_t adds; 
+    string name;
+    int64_t bloom_num;
+    int64_t capacity;
+    double fail_rate;
+    int64_t bit_num;
+    int hash_type;
+    int layout;
+    int tiers;
+    // 1 once the day is served from its .fuse_ file
+    int frozen;
 
-    bloom_offset_s()
+    bloom_meta_s()
     {
-        memset(uid, 0x00, UID_LEN);
-        offset = 0;
-        len = 0;
-        max_adds = 0;
-        adds = 0; 
+        bloom_num = 0;
+        capacity = 0;
+        fail_rate = 0.0;
+        bit_num = 0;
+        hash_type = hLegacy;
+        layout = lStandard;
+        tiers = 0;
+        frozen = 0;
     }
-} bloom_offset_t;
+} bloom_meta_t;
+
+// one engine section of the config json
+typedef struct bloom_conf_s 
+{
+    string prefix;
+    int64_t bloom_num;
+    int64_t capacity;
+    double fail_rate;
+    int days;
+    int create_bloom_at;
+    int32_t type;
+    int hash_type;
+    int layout;
+    bool atomic_add;
+    // 0 disables staging of the next day's files
+    int stage_hours;
+    int stage_mb_per_sec;
+    // 0 releases an expired day's files in one go
+    int reclaim_mb_per_sec;
+    // seconds between two flushes of the dirty slots, 0 flushes only 
+    // on /sbf/sync
+    int flush_sec;
+    int flush_mb_per_sec;
+    // 0 turns the add log off
+    int wal_commit_ms;
+    int wal_segment_mb;
+    // 0 loads every day before serving, otherwise only the newest one 
+    // and the others on this many threads in the background
+    int load_threads;
+    // a MemBacking, hugetlb_dir is the hugetlbfs directory of mHugetlb
+    int mem_backing;
+    string hugetlb_dir;
+    // 0 gives every slot of a user capacity and fail_rate, otherwise a 
+    // user's next slot is one size class up, capacity is the first one's
+    int grow_tiers;
+    // a StoreType
+    int store;
+    // 0 keeps closed days as they are, otherwise the vids of a day are 
+    // logged and it is frozen once the workers are past it, see FrozenDay
+    int freeze_days;
 
-typedef boost::shared_ptr<bloom_offset_t> BloomOffsetPtr;
+    bloom_conf_s()
+    {
+        bloom_num = 0;
+        capacity = 0;
+        fail_rate = 0.0;
+        days = 0;
+        create_bloom_at = 0;
+        type = TYPE_SHOW;
+        hash_type = hLegacy;
+        layout = lStandard;
+        atomic_add = false;
+        stage_hours = 0;
+        stage_mb_per_sec = 0;
+        reclaim_mb_per_sec = 0;
+        flush_sec = 0;
+        flush_mb_per_sec = 0;
+        wal_commit_ms = 0;
+        wal_segment_mb = 0;
+        load_threads = 0;
+        mem_backing = mPage;
+        grow_tiers = 0;
+        store = sDays;
+        freeze_days = 0;
+    }
+} bloom_conf_t;
 
-class BloomMgr
+// shared by the master and the forked workers: a worker bumps request 
+// on /sbf/sync, the master's flusher sets done to the request it has 
+// seen before a flush pass once that pass is written back. Adds with a 
+// version older than flushed are in the files, the workers drop their 
+// add log up to there.
+typedef struct sync_state_s 
+{
+    int64_t request;
+    int64_t done;
+    int64_t flushed;
+} sync_state_t;
+
+// one day of the window and its .meta line. A frozen day has no bloom 
+// but its frozen filters, a day still being loaded in the background 
+// has neither yet, readers skip it.
+typedef struct bloom_day_s 
+{
+    string name;
+    string finfo;
+    MapBloomPtr bloom;
+    BloomIdxPtr idx;
+    UidIndexPtr uidx;
+    // the written day's, with freeze_days
+    VidLogPtr vlog;
+    FrozenDayPtr frozen;
+} bloom_day_t;
+
+typedef boost::shared_ptr<bloom_day_t> BloomDayPtr;
+
+// a file of an expired day, renamed to .trash_<name> and released by 
+// the reclaim thread from ready on
+typedef struct reclaim_file_s 
+{
+    string fname;
+    time_t ready;
+} reclaim_file_t;
+
+// the active days, newest first. A published set is never changed, 
+// rotation publishes a new one and frees the old one once the readers 
+// that may hold it have left their epoch.
+typedef struct bloom_set_s 
+{
+    vector<BloomDayPtr> days;
+} bloom_set_t;
+
+// the slots of one user in one day, newest first, only valid inside 
+// the epoch it was found in
+typedef struct user_bloom_s 
+{
+    MapBloom *bloom;
+    vector<int64_t> offsets;
+    // of each offset
+    vector<int> tiers;
+    // the user's filter instead in a frozen day
+    const char *fuse;
+
+    user_bloom_s()
+    {
+        bloom = NULL;
+        fuse = NULL;
+    }
+} user_bloom_t;
+
+class BloomMgr : public BloomEngine
 {
 public:
-    explicit BloomMgr(string &prefix, int64_t bloom_num, int64_t capacity, 
-        double fail_rate, int days, int create_bloom_at, int32_t type); 
+    explicit BloomMgr(const bloom_conf_t &conf); 
     virtual ~BloomMgr();
 
-    // call it in InitInMaster
     bool InitBlooms();
-    // call it in InitInWorker
     void StartReloadMeta();
 
     bool Add(ContextPtr ctx);
+    bool Remove(ContextPtr ctx);
     void Get(ContextPtr ctx);
     void GetBloom(ContextPtr ctx);
 
-    void Sync2File();
+    int64_t RequestSync();
+    int64_t GetSyncedGen();
+    string GetStats();
 
 private:
-    bool ReadMeta();
-    bool ResetBlooms();
+    bool ReadMeta(vector<string> &lines);
+    bool ParseMeta(const string &line, bloom_meta_t &meta);
+    string FormatMeta(const bloom_meta_t &meta);
+    bool ResetBlooms(const vector<string> &lines);
     bool AddNewBloom();
-    bool CreateIndex(BloomIdxPtr bloom_idx);
-    bool LoadIndex(BloomIdxPtr bloom_idx, string &bloom_name, bool rw = true);
+    BloomDayPtr LoadDay(const bloom_meta_t &meta, bool rw, 
+        bool image_only = false);
+    void LoadDaysAsync(bool image_only);
+    void LoadDaysHandle(vector<bloom_meta_t> metas, bool image_only);
+    bool InstallDay(BloomDayPtr day);
+    bool IsLoading(const string &name);
+    bool SettleDay(const string &name, bool write_back);
+    void SettleDays();
+    void DropHugeLeftovers();
+    void PushDay(BloomDayPtr day);
+    void PublishSet(bloom_set_t *set);
+    const bloom_set_t *CurrSet();
+    bool CreateIndex(BloomIdxPtr bloom_idx, UidIndexPtr uid_idx);
+    bool LoadIndex(BloomIdxPtr bloom_idx, UidIndexPtr uid_idx, 
+        string &bloom_name, bool rw = true, bool image_only = false);
     void WriteMeta();
     void CreateBloomHandle();
+    void StageDay(const string &name, time_t deadline);
+    bool StageFile(const string &fname, int64_t size, time_t deadline, 
+        int64_t &bytes);
+    void ExpireDay(const string &name);
+    void TrashFile(const string &fname, time_t ready);
+    int64_t VidLogCap();
+    void FreezeHandle();
+    bool FreezeDay(const string &name);
+    FrozenDayPtr LoadFrozen(const bloom_meta_t &meta);
+    void ReclaimHandle();
+    bool ReclaimFile(const string &fname);
+    void FlushHandle();
+    int64_t FlushDirty(int64_t since);
+    void WalHandle();
+    void ReplayLogs();
+    void ReplayAdd(BloomDayPtr day, set<int64_t> &fresh, int64_t &skipped, 
+        map<string, int64_t> &removes, const add_rec_t &rec);
+    void ReplayRemove(map<string, int64_t> &removes, const add_rec_t &rec);
     void ReloadMetaHandle();
-    void ReloadMeta();
-    void CalcHash(string &vid, vector<int64_t> &hashs);
-    bool Lookup(string &uid, string &vid, int days);
-    void SyncBloomIndex();
-    void StartDeleteBloomIdx(string &bloom_name);
-    void DeleteBloomIdxHandle(string &bloom_name);
+    bool ReloadMeta();
+    bool ReloadFrozen(const bloom_meta_t &meta);
+    void UpdateRotation(int64_t lag_ms);
+    void GetBloomDelta(ContextPtr ctx);
+    void FindUser(const bloom_set_t *set, const string &uid, int days, 
+        vector<user_bloom_t> &ubs);
+    int64_t NewSlot(bloom_day_t *day, const string &uid, int64_t prev, 
+        int64_t adds, bool intern);
+    void LogAdd(bloom_day_t *day, int64_t slot, const string &uid, 
+        const vector<VidView> &vids);
+    int64_t RemoveVids(const bloom_set_t *set, const string &uid, 
+        const vector<VidView> &vids);
+    int64_t SlotOffset(bloom_day_t *day, int64_t slot, int &tier);
+    int64_t SlotBitNum(bloom_day_t *day, int tier);
+    int64_t SlotMaxAdds(bloom_day_t *day, int tier);
+    int NextTier(bloom_day_t *day, int64_t prev);
+    bool PlaceSlot(bloom_day_t *day, int64_t slot, int tier);
+    bool Lookup(vector<user_bloom_t> &ubs, const VidView &vid);
 
 private:
     string last_hour_;
@@ -137,19 +667,52 @@ private:
     int64_t max_adds_;
     int create_bloom_at_;
     int32_t type_;
+    int hash_type_;
+    int layout_;
+    bool atomic_add_;
+    int stage_hours_;
+    int stage_mb_per_sec_;
+    int reclaim_mb_per_sec_;
+    int flush_sec_;
+    int flush_mb_per_sec_;
+    int wal_commit_ms_;
+    int wal_segment_mb_;
+    int load_threads_;
+    int mem_backing_;
+    string hugetlb_dir_;
+    int tiers_;
+    bool freeze_days_;
+    sync_state_t *sync_;
+    // flush thread only, the newest day's slot count at the last pass
+    string ckpt_day_;
+    int64_t ckpt_slots_;
+    // a flush pass and the sync of the day rotated out never overlap
+    boost::mutex flush_mutex_;
+    AddLog wal_;
+    // ms, of .meta
     int64_t last_mtime_;
-    volatile int64_t last_idxs_;
-
-    vector<HashHandle> hash_handles_;
-    list<string> bloom_finfos_;
-    list<MapBloomPtr> blooms_;
-    list<BloomIdxPtr> bloom_idxs_;
-    map<string, list<BloomOffsetPtr>> uid2offset_;
-    map<string, list<string>> bloom2uid_;
+    // ms from the rotation (scheduled time in the master, .meta write 
+    // in workers) to this process serving the new day
+    int64_t rotation_lag_ms_;
+    int64_t rotations_;
+
+    // readers load set_ inside an epoch and take no lock, writers are 
+    // serialized by update_mutex_
+    bloom_set_t *set_;
+    Epoch epoch_;
+    boost::mutex update_mutex_;
+    list<reclaim_file_t> reclaim_;
+    // closed days still on hugetlbfs, by day name, see SettleDay
+    list<reclaim_file_t> settle_;
+    // closed days to freeze, by day name, see FreezeDay
+    list<reclaim_file_t> freeze_;
+    boost::mutex reclaim_mutex_;
     boost::shared_ptr<boost::thread> create_bloom_thread_;
     boost::shared_ptr<boost::thread> reload_meta_thread_;
-    mutable boost::shared_mutex mutex_;
-    mutable boost::interprocess::interprocess_mutex proc_mutex_;
+    boost::shared_ptr<boost::thread> reclaim_thread_;
+    boost::shared_ptr<boost::thread> flush_thread_;
+    boost::shared_ptr<boost::thread> wal_thread_;
+    boost::shared_ptr<boost::thread> freeze_thread_;
 };
 
 typedef boost::shared_ptr<BloomMgr> BloomMgrPtr;
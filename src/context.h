@@ -1,6 +1,7 @@
 #ifndef CONTEXT_H
 #define CONTEXT_H
 
+#include <string.h>
 #include <string>
 #include <sstream>
 #include <vector>
@@ -20,13 +21,27 @@ enum FilterType
 {
     tGet,
     tAdd,
+    tRemove,
     tNone
 };
 
-typedef struct _ResInfo 
+// a vid inside the "vids" query value, it points into ctx->params_ 
+// and is only valid as long as the context lives
+typedef struct _VidView 
 {
-    vector<string> vids;
-} ResInfo;
+    const char *ptr;
+    uint32_t len;
+
+    bool empty() const
+    {
+        return 0 == len;
+    }
+
+    bool equals(const _VidView &v) const
+    {
+        return len == v.len && 0 == memcmp(ptr, v.ptr, len);
+    }
+} VidView;
 
 typedef struct _FilterInfo 
 {
@@ -39,8 +54,11 @@ typedef struct _FilterInfo
     FilterType type;
     uint32_t req_group_size;
     uint32_t vid_size;
-    vector<list<string> > vids;
-    map<int, vector<ResInfo> > res_infos;
+    // all vids flattened, groups[i] is the end of group i in vids
+    vector<VidView> vids;
+    vector<uint32_t> groups;
+    // filled by Get, 1 if the vid was seen by the user
+    vector<uint8_t> hits;
 } FilterInfo;
 
 class Context 
@@ -58,12 +76,12 @@ public:
     string resp_;
 
     int days_;
+    // /sbf/get export mode and the version the client already has
+    int mode_;
+    int64_t ver_;
     double ar_que_t_;
     double in_que_t_;
 
-    int total_len_;
-    char *total_ptr_;
-
     stringstream add_vids_;
     stringstream filtered_vids_;
     map<string, string> params_;
@@ -0,0 +1,255 @@
+#include "cuckoo_filter.h"
+#include <math.h>
+#include <algorithm>
+#include "util.h"
+
+NAME_SPACE_BS
+
+// the hash values of hLegacy are weak in the high bits, mixed first
+static inline uint64_t cuckoo_mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+// 0 marks an empty entry
+static inline uint16_t cuckoo_fp(uint64_t h)
+{
+    uint16_t fp = (uint16_t)h;
+
+    return (0 == fp) ? 1 : fp;
+}
+
+// the other bucket of fp in bucket b, (x - b) mod n leads back to b 
+// for any bucket_num, not only powers of 2
+static inline uint64_t cuckoo_alt(uint64_t b, uint16_t fp, uint64_t n)
+{
+    uint64_t x = (fp * 0x5bd1e995ULL) % n;
+
+    return (x + n - b) % n;
+}
+
+static inline uint16_t *cuckoo_bucket(const char *slot, uint64_t b)
+{
+    return (uint16_t *)(slot + sizeof(cuckoo_head_t)) + b * CUCKOO_WAYS;
+}
+
+// all four entries with one aligned load, a bucket is 8 bytes
+static inline bool cuckoo_has(const char *slot, uint64_t b, uint16_t fp)
+{
+    uint64_t v = __atomic_load_n((uint64_t *)cuckoo_bucket(slot, b), 
+        __ATOMIC_ACQUIRE);
+    v ^= fp * 0x0001000100010001ULL;
+
+    return 0 != ((v - 0x0001000100010001ULL) & ~v & 0x8000800080008000ULL);
+}
+
+static inline int cuckoo_free(const char *slot, uint64_t b)
+{
+    uint16_t *bucket = cuckoo_bucket(slot, b);
+    for (int e = 0; e < CUCKOO_WAYS; e++) 
+    {
+        if (0 == bucket[e]) 
+        {
+            return e;
+        }
+    }
+
+    return -1;
+}
+
+static inline void cuckoo_set(char *slot, uint64_t b, int e, uint16_t fp)
+{
+    __atomic_store_n(cuckoo_bucket(slot, b) + e, fp, __ATOMIC_RELEASE);
+}
+
+int64_t CuckooFilter::ByteSize(int64_t capacity)
+{
+    int64_t bucket_num = (int64_t)ceil(capacity 
+        / (CUCKOO_WAYS * CUCKOO_LOAD));
+    bucket_num = max(bucket_num, (int64_t)2);
+
+    return sizeof(cuckoo_head_t) 
+        + sizeof(uint16_t) * CUCKOO_WAYS * bucket_num;
+}
+
+// A full pair of buckets starts a random walk: an entry of the bucket 
+// is to make way for its fingerprint's other bucket, and so on until 
+// a bucket has a free entry. The walk is only planned, the moves are 
+// then made from its end, each fingerprint written to its new place 
+// before its old one is taken, and a walk that runs out of steps 
+// leaves the slot as it was.
+bool CuckooFilter::Insert(char *slot, int64_t byte_size, uint64_t hash)
+{
+    uint64_t h = cuckoo_mix(hash);
+    uint16_t fp = cuckoo_fp(h);
+    uint64_t n = (byte_size - sizeof(cuckoo_head_t)) 
+        / (sizeof(uint16_t) * CUCKOO_WAYS);
+    uint64_t i1 = (h >> 16) % n;
+    uint64_t i2 = cuckoo_alt(i1, fp, n);
+
+    cuckoo_head_t *head = (cuckoo_head_t *)slot;
+    Lock(head);
+
+    if (cuckoo_has(slot, i1, fp) || cuckoo_has(slot, i2, fp)) 
+    {
+        Unlock(head);
+
+        return true;
+    }
+
+    uint64_t b = i1;
+    int e = cuckoo_free(slot, i1);
+    if (e < 0) 
+    {
+        b = i2;
+        e = cuckoo_free(slot, i2);
+    }
+
+    if (e >= 0) 
+    {
+        cuckoo_set(slot, b, e, fp);
+        head->num++;
+        Unlock(head);
+
+        return true;
+    }
+
+    if (head->num >= n * CUCKOO_WAYS) 
+    {
+        Unlock(head);
+
+        return false;
+    }
+
+    uint64_t path_b[CUCKOO_MAX_KICKS];
+    int path_e[CUCKOO_MAX_KICKS];
+    uint16_t path_fp[CUCKOO_MAX_KICKS];
+    int steps = 0;
+    uint64_t rnd = h;
+    b = (h >> 63) ? i2 : i1;
+
+    while (steps < CUCKOO_MAX_KICKS) 
+    {
+        rnd ^= rnd << 13;
+        rnd ^= rnd >> 7;
+        rnd ^= rnd << 17;
+
+        // an entry not yet on the walk, its move is planned once
+        e = -1;
+        for (int k = 0; k < CUCKOO_WAYS && e < 0; k++) 
+        {
+            e = (rnd + k) % CUCKOO_WAYS;
+            for (int s = 0; s < steps; s++) 
+            {
+                if (path_b[s] == b && path_e[s] == e) 
+                {
+                    e = -1;
+                    break;
+                }
+            }
+        }
+        if (e < 0) 
+        {
+            break;
+        }
+
+        uint16_t kicked = cuckoo_bucket(slot, b)[e];
+        path_b[steps] = b;
+        path_e[steps] = e;
+        path_fp[steps] = kicked;
+        steps++;
+
+        b = cuckoo_alt(b, kicked, n);
+        int free_e = cuckoo_free(slot, b);
+        if (free_e < 0) 
+        {
+            continue;
+        }
+
+        cuckoo_set(slot, b, free_e, kicked);
+        for (int s = steps - 1; s > 0; s--) 
+        {
+            cuckoo_set(slot, path_b[s], path_e[s], path_fp[s - 1]);
+        }
+        cuckoo_set(slot, path_b[0], path_e[0], fp);
+        head->num++;
+        Unlock(head);
+
+        return true;
+    }
+
+    Unlock(head);
+
+    return false;
+}
+
+bool CuckooFilter::Contains(const char *slot, int64_t byte_size, 
+    uint64_t hash) 
+{
+    uint64_t h = cuckoo_mix(hash);
+    uint16_t fp = cuckoo_fp(h);
+    uint64_t n = (byte_size - sizeof(cuckoo_head_t)) 
+        / (sizeof(uint16_t) * CUCKOO_WAYS);
+    uint64_t i1 = (h >> 16) % n;
+
+    return cuckoo_has(slot, i1, fp) 
+        || cuckoo_has(slot, cuckoo_alt(i1, fp, n), fp);
+}
+
+// a vid of the slot with the same fingerprint in the same bucket goes 
+// along, it is then a miss for its user like a vid never added
+bool CuckooFilter::Remove(char *slot, int64_t byte_size, uint64_t hash)
+{
+    uint64_t h = cuckoo_mix(hash);
+    uint16_t fp = cuckoo_fp(h);
+    uint64_t n = (byte_size - sizeof(cuckoo_head_t)) 
+        / (sizeof(uint16_t) * CUCKOO_WAYS);
+    uint64_t i1 = (h >> 16) % n;
+    uint64_t i2 = cuckoo_alt(i1, fp, n);
+
+    cuckoo_head_t *head = (cuckoo_head_t *)slot;
+    Lock(head);
+
+    bool found = false;
+    for (int i = 0; i < 2; i++) 
+    {
+        uint64_t b = (0 == i) ? i1 : i2;
+        if (1 == i && i1 == i2) 
+        {
+            break;
+        }
+
+        uint16_t *bucket = cuckoo_bucket(slot, b);
+        for (int e = 0; e < CUCKOO_WAYS; e++) 
+        {
+            if (fp == bucket[e]) 
+            {
+                cuckoo_set(slot, b, e, 0);
+                head->num -= (head->num > 0) ? 1 : 0;
+                found = true;
+            }
+        }
+    }
+
+    Unlock(head);
+
+    return found;
+}
+
+void CuckooFilter::Lock(cuckoo_head_t *head)
+{
+    pid_lock(&head->owner);
+}
+
+void CuckooFilter::Unlock(cuckoo_head_t *head)
+{
+    pid_unlock(&head->owner);
+}
+
+NAME_SPACE_ES
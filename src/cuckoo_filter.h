@@ -0,0 +1,57 @@
+#ifndef CUCKOO_FILTER_H
+#define CUCKOO_FILTER_H
+
+#include "common.h"
+
+using namespace std;
+
+NAME_SPACE_BS
+
+// Cuckoo filter (Fan et al., "Cuckoo Filter: Practically Better Than 
+// Bloom") over one slot of a mapped file, the slot format of lCuckoo. 
+// A vid is a 16 bit fingerprint in one of two 4-way buckets, so it can 
+// be removed again, false positives run at about 8 / 2^16 whatever the 
+// fail_rate, and a slot refuses a vid instead of degrading once full. 
+// 
+// slot: cuckoo_head_t | uint16_t fp[bucket_num][CUCKOO_WAYS] 
+// Writers of all processes take the slot's lock, readers take none: a 
+// kick-out first copies a fingerprint to its other bucket and only then 
+// overwrites it, so a lookup never misses a vid of the slot. A lock 
+// left by a dead process is taken over.
+
+#define CUCKOO_WAYS 4
+// the load a slot is sized for, 4-way buckets still insert reliably 
+// a few percent above it
+#define CUCKOO_LOAD 0.9
+// steps of one kick-out walk before the slot counts as full
+#define CUCKOO_MAX_KICKS 128
+
+typedef struct cuckoo_head_s 
+{
+    // pid of the writer holding the slot, 0 for none
+    int32_t owner;
+    // fingerprints held
+    uint32_t num;
+} cuckoo_head_t;
+
+class CuckooFilter
+{
+public:
+    // bytes of a slot for capacity vids, 8 aligned
+    static int64_t ByteSize(int64_t capacity);
+
+    // adds the vid of hash unless it is already there, false if the 
+    // slot of byte_size has no room for it
+    static bool Insert(char *slot, int64_t byte_size, uint64_t hash);
+    static bool Contains(const char *slot, int64_t byte_size, uint64_t hash);
+    // drops every copy of the fingerprint of hash, false if none
+    static bool Remove(char *slot, int64_t byte_size, uint64_t hash);
+
+private:
+    static void Lock(cuckoo_head_t *head);
+    static void Unlock(cuckoo_head_t *head);
+};
+
+NAME_SPACE_ES
+
+#endif
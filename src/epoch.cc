@@ -0,0 +1,140 @@
+#include "epoch.h"
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+
+NAME_SPACE_BS
+
+static int next_slot = 0;
+static __thread int thread_slot = -1;
+
+static pthread_mutex_t epochs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t epochs_once = PTHREAD_ONCE_INIT;
+static Epoch *epochs = NULL;
+
+Epoch::Epoch()
+{
+    memset(readers_, 0x00, sizeof(readers_));
+    phase_ = 0;
+    pthread_mutex_init(&sync_lock_, NULL);
+
+    pthread_once(&epochs_once, RegisterFork);
+
+    pthread_mutex_lock(&epochs_lock);
+    prev_ = NULL;
+    next_ = epochs;
+    if (epochs) 
+    {
+        epochs->prev_ = this;
+    }
+    epochs = this;
+    pthread_mutex_unlock(&epochs_lock);
+}
+
+Epoch::~Epoch()
+{
+    pthread_mutex_lock(&epochs_lock);
+    if (prev_) 
+    {
+        prev_->next_ = next_;
+    } 
+    else 
+    {
+        epochs = next_;
+    }
+    if (next_) 
+    {
+        next_->prev_ = prev_;
+    }
+    pthread_mutex_unlock(&epochs_lock);
+
+    pthread_mutex_destroy(&sync_lock_);
+}
+
+void Epoch::RegisterFork()
+{
+    pthread_atfork(PrepareFork, ParentFork, ChildFork);
+}
+
+// the list is held across the fork, the child gets it consistent
+void Epoch::PrepareFork()
+{
+    pthread_mutex_lock(&epochs_lock);
+}
+
+void Epoch::ParentFork()
+{
+    pthread_mutex_unlock(&epochs_lock);
+}
+
+// only the forking thread runs in the child, the read sections and a 
+// Synchronize of the others never leave there
+void Epoch::ChildFork()
+{
+    for (Epoch *e = epochs; e; e = e->next_) 
+    {
+        memset(e->readers_, 0x00, sizeof(e->readers_));
+        pthread_mutex_init(&e->sync_lock_, NULL);
+    }
+    __sync_synchronize();
+
+    pthread_mutex_unlock(&epochs_lock);
+}
+
+int Epoch::Slot()
+{
+    if (thread_slot < 0) 
+    {
+        // threads past MAX_EPOCH_READERS share slots, the counter keeps 
+        // that correct
+        thread_slot = __sync_fetch_and_add(&next_slot, 1) % MAX_EPOCH_READERS;
+    }
+
+    return thread_slot;
+}
+
+int Epoch::Enter()
+{
+    int phase = __atomic_load_n(&phase_, __ATOMIC_ACQUIRE) & 1;
+    // full barrier, the load of the published pointer can't move above it
+    __sync_fetch_and_add(&readers_[Slot()].active[phase], 1);
+
+    return phase;
+}
+
+void Epoch::Leave(int phase)
+{
+    __sync_fetch_and_sub(&readers_[Slot()].active[phase], 1);
+}
+
+void Epoch::Drain(int phase)
+{
+    for (int i = 0; i < MAX_EPOCH_READERS; i++) 
+    {
+        while (0 != __atomic_load_n(&readers_[i].active[phase], 
+            __ATOMIC_ACQUIRE)) 
+        {
+            sched_yield();
+        }
+    }
+}
+
+// a reader may read the phase just before a flip and count itself in it 
+// once its drain is past: it holds the new pointer then, but sits in the 
+// phase the next call flips to, so every call drains both
+void Epoch::Synchronize()
+{
+    pthread_mutex_lock(&sync_lock_);
+
+    // the caller has already published the new pointer, a reader counted 
+    // in a phase after it is drained can only see that one
+    for (int i = 0; i < 2; i++) 
+    {
+        int phase = __sync_fetch_and_add(&phase_, 1) & 1;
+        Drain(phase);
+    }
+
+    pthread_mutex_unlock(&sync_lock_);
+}
+
+NAME_SPACE_ES
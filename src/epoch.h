@@ -0,0 +1,86 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <pthread.h>
+#include "common.h"
+
+NAME_SPACE_BS
+
+// Read side of a read-copy-update scheme. Readers mark themselves active 
+// in a per-thread, cache line sized slot around their use of a published 
+// pointer; a writer swaps the pointer, calls Synchronize() to wait out 
+// every reader that may still hold the old one, and then frees it. 
+// Readers never wait on a writer. 
+// 
+// A reader counts itself in the phase current when it enters. Synchronize 
+// flips the phase and waits for the old one to drain, twice, so it only 
+// waits for sections entered before it was called: readers that keep 
+// coming, or share a slot with one that stays, go to the other phase. 
+// 
+// The slots are process-local. A fork copies the counters of the read 
+// sections other threads had open, which are not running in the child, 
+// so the child starts with all of them cleared: the thread calling 
+// fork must not be inside a read section itself.
+
+#define MAX_EPOCH_READERS 256
+
+class Epoch
+{
+public:
+    Epoch();
+    virtual ~Epoch();
+
+    // returns the phase to pass to Leave
+    int Enter();
+    void Leave(int phase);
+
+    // returns once every read section running at the time of the call 
+    // has left, one writer at a time
+    void Synchronize();
+
+private:
+    static int Slot();
+    void Drain(int phase);
+    static void RegisterFork();
+    static void PrepareFork();
+    static void ParentFork();
+    static void ChildFork();
+
+private:
+    typedef struct reader_s 
+    {
+        // sections open in each phase
+        int64_t active[2];
+        char pad[64 - sizeof(int64_t) * 2];
+    } reader_t;
+
+    reader_t readers_[MAX_EPOCH_READERS];
+    // flipped by Synchronize, the low bit is the phase readers enter in
+    int64_t phase_;
+    pthread_mutex_t sync_lock_;
+    // every Epoch of the process, for ChildFork
+    Epoch *prev_;
+    Epoch *next_;
+};
+
+class EpochGuard
+{
+public:
+    explicit EpochGuard(Epoch &epoch) : epoch_(epoch)
+    {
+        phase_ = epoch_.Enter();
+    }
+
+    ~EpochGuard()
+    {
+        epoch_.Leave(phase_);
+    }
+
+private:
+    Epoch &epoch_;
+    int phase_;
+};
+
+NAME_SPACE_ES
+
+#endif
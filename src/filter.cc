@@ -1,7 +1,5 @@
 #include "filter.h"
 #include <boost/lexical_cast.hpp>
-#include <boost/algorithm/string/split.hpp>
-#include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/format.hpp>  
 #include "comm/logging.h"
@@ -65,6 +63,10 @@ void Filter::CheckFilterInfo(ContextPtr ctx)
     {
         ctx->finfo_.type = tAdd;
     }
+    else if ("2" == action) 
+    {
+        ctx->finfo_.type = tRemove;
+    }
     else 
     {
         ctx->finfo_.type = tNone;
@@ -73,52 +75,71 @@ void Filter::CheckFilterInfo(ContextPtr ctx)
         return;
     }
 
-    string vid = get_param(ctx->params_, "vids");
-    if ("" == vid || vid.empty()) 
+    auto ite = ctx->params_.find("vids");
+    if (ite == ctx->params_.end() || ite->second.empty()) 
     {
         ctx->err_ = eVidEmpty;
 
         return;
     }
 
-    vector<string> vids;
-    boost::split(vids, vid, boost::is_any_of("|"));
-    if (0 == vids.size()) 
-    {
-        ctx->err_ = eVidEmpty;
+    ParseVids(ite->second, ctx->finfo_);
+}
 
-        return;
+// tokenise "0,1,2|5,6" in place into views on the query value, empty 
+// tokens are kept, so "1||2," gives 3 groups and 4 vids
+void Filter::ParseVids(const string &vid, FilterInfo &finfo)
+{
+    const char *p = vid.c_str();
+    const char *end = p + vid.size();
+
+    uint32_t group_num = 1;
+    uint32_t vid_num = 1;
+    for (const char *c = p; c < end; c++) 
+    {
+        if ('|' == *c) 
+        {
+            group_num++;
+            vid_num++;
+        } 
+        else if (',' == *c) 
+        {
+            vid_num++;
+        }
     }
 
-    int vEmpty = 0;
-    ctx->finfo_.req_group_size = vids.size();
-    for (auto &v : vids)
+    finfo.vids.clear();
+    finfo.groups.clear();
+    finfo.vids.reserve(vid_num);
+    finfo.groups.reserve(group_num);
+
+    const char *start = p;
+    for (const char *c = p; ; c++) 
     {
-        vector<string> vv;
-        boost::split(vv, v, boost::is_any_of(","));
-        list<string> lv;
-        for (auto &vvv : vv)
+        if (c < end && '|' != *c && ',' != *c) 
         {
-            lv.push_back(vvv);            
-            ctx->finfo_.vid_size++;
+            continue;
         }
 
-        if (lv.size() > 0)
+        VidView v;
+        v.ptr = start;
+        v.len = c - start;
+        finfo.vids.push_back(v);
+        start = c + 1;
+
+        if (c == end || '|' == *c) 
         {
-            ctx->finfo_.vids.push_back(lv);
+            finfo.groups.push_back(finfo.vids.size());
         }
-        else
+
+        if (c == end) 
         {
-            vEmpty++;
+            break;
         }
     }
 
-    if (ctx->finfo_.req_group_size == vEmpty) 
-    {
-        ctx->err_ = eVidEmpty;
-
-        return;
-    }
+    finfo.req_group_size = group_num;
+    finfo.vid_size = vid_num;
 }
 
 void Filter::CheckGetBloomInfo(ContextPtr ctx)
@@ -131,6 +152,24 @@ void Filter::CheckGetBloomInfo(ContextPtr ctx)
     ctx->sid_ = get_param(ctx->params_, "sid"); 
     ctx->ts_ = get_param(ctx->params_, "ts");
 
+    string mode = get_param(ctx->params_, "mode");
+    if ("" != mode) 
+    {
+        ctx->mode_ = atoi(mode.c_str());
+        if (eFull != ctx->mode_ && eDelta != ctx->mode_) 
+        {
+            ctx->err_ = eParam;
+
+            return;
+        }
+    }
+
+    string ver = get_param(ctx->params_, "ver");
+    if ("" != ver) 
+    {
+        ctx->ver_ = atoll(ver.c_str());
+    }
+
     if ("" == ctx->uid_ || ctx->uid_.empty()) 
     {
         ctx->err_ = eUidEmpty;
@@ -162,6 +201,15 @@ void Filter::StartAdd(ContextPtr ctx)
     ctx->timers_.Timer("add")->Stop();
 }
 
+void Filter::StartRemove(ContextPtr ctx)
+{
+    ctx->timers_.Timer("add")->Start();
+
+    bloom_mgr_->Remove(ctx);
+
+    ctx->timers_.Timer("add")->Stop();
+}
+
 void Filter::StartGet(ContextPtr ctx)
 {
     ctx->timers_.Timer("get")->Start();
@@ -224,7 +272,7 @@ void Filter::Logging(ContextPtr ctx)
         << "\tar_que_t=" << ctx->ar_que_t_
         << "\tin_que_t=" << ctx->in_que_t_
         << "\tall_t=" << ctx->timers_.Timer("total")->Elapsed() * 1000
-        << "\tadd_t=" << ((tAdd == ctx->finfo_.type) ? (ctx->timers_.Timer("add")->Elapsed() * 1000) : 0)
+        << "\tadd_t=" << ((tAdd == ctx->finfo_.type || tRemove == ctx->finfo_.type) ? (ctx->timers_.Timer("add")->Elapsed() * 1000) : 0)
         << "\tget_t=" << ((tGet == ctx->finfo_.type) ? (ctx->timers_.Timer("get")->Elapsed() * 1000) : 0)
         << "\tpkg_t=" << ((tGet == ctx->finfo_.type) ? (ctx->timers_.Timer("pkg")->Elapsed() * 1000) : 0)
         << "\tadd_vid=" << ctx->add_vids_.str()
@@ -3,7 +3,9 @@
 
 #include "common.h"
 #include "context.h"
-#include "bloom_mgr.h"
+#include "bloom_engine.h"
+#include "bloom_export.h"
+#include "hash.h"
 
 NAME_SPACE_BS
 
@@ -18,13 +20,17 @@ public:
     void CheckFilterInfo(ContextPtr ctx);
     void CheckGetBloomInfo(ContextPtr ctx);
     void StartAdd(ContextPtr ctx);
+    void StartRemove(ContextPtr ctx);
     void StartGet(ContextPtr ctx);
     void StartGetBloom(ContextPtr ctx);
     void DoAck(ContextPtr ctx, const string& type = "");
     void Logging(ContextPtr ctx);
 
 protected:
-    BloomMgrPtr bloom_mgr_;
+    void ParseVids(const string &vid, FilterInfo &finfo);
+
+protected:
+    BloomEnginePtr bloom_mgr_;
 };
 
 typedef boost::shared_ptr<Filter> FilterPtr;
@@ -1,8 +1,9 @@
 #include "filter_show.h"
+#include <stdio.h>
 
 NAME_SPACE_BS
 
-FilterShow::FilterShow(BloomMgrPtr bloom_mgr)
+FilterShow::FilterShow(BloomEnginePtr bloom_mgr)
 {
     bloom_mgr_ = bloom_mgr;
 }
@@ -20,6 +21,11 @@ void FilterShow::StartFilter(ContextPtr ctx)
         StartAdd(ctx);
         ResponseAddAck(ctx);
     } 
+    else if (eOk == ctx->err_ && tRemove == ctx->finfo_.type) 
+    {
+        StartRemove(ctx);
+        ResponseAddAck(ctx);
+    } 
     else if (eOk == ctx->err_ && tGet == ctx->finfo_.type) 
     {
         StartGet(ctx);
@@ -57,40 +63,75 @@ void FilterShow::ResponseGetAck(ContextPtr ctx)
     ctx->timers_.Timer("pkg")->Start();
 
     auto &finfo = ctx->finfo_;
-    auto &res_infos = finfo.res_infos; 
-    vector<string> pass_vec;
-    stringstream ss;
 
-    for (int i = 0; i < finfo.req_group_size; i++) 
+    // size the response for the worst case, "group<n>:" and a separator 
+    // per group plus every vid and its comma
+    size_t cap = finfo.req_group_size * (sizeof("group:\n") + 10);
+    for (auto &v : finfo.vids) 
+    {
+        cap += v.len + 1;
+    }
+
+    // open addressing set of vids already written, it keeps the index 
+    // of the vid plus 1 so that 0 is an empty bucket
+    uint32_t mask = 16;
+    while (mask < finfo.vids.size() * 2) 
     {
-        ss << "group" << i << ":";
+        mask <<= 1;
+    }
+    mask -= 1;
+    vector<uint32_t> pass_set(mask + 1, 0);
+
+    string &resp = ctx->resp_;
+    resp.resize(cap);
+    char *out = &resp[0];
+    char *p = out;
 
-        vector<ResInfo> res = res_infos[i];
-        for (int j = 0; j < res.size(); j++) 
+    uint32_t i = 0;
+    for (uint32_t g = 0; g < finfo.req_group_size; g++) 
+    {
+        if (g > 0) 
         {
-            for (int x = 0; x < res[j].vids.size(); x++) 
+            *p++ = '\n';
+        }
+        p += sprintf(p, "group%u:", g);
+
+        bool first = true;
+        for (; i < finfo.groups[g]; i++) 
+        {
+            const VidView &v = finfo.vids[i];
+            if (v.empty() || finfo.hits[i]) 
+            {
+                continue;
+            }
+
+            uint32_t pos = Hash::BKDR_hash(v.ptr, v.len) & mask;
+            bool passed = false;
+            for (; 0 != pass_set[pos]; pos = (pos + 1) & mask) 
             {
-                auto it = find(pass_vec.begin(), 
-                    pass_vec.end(), res[j].vids[x]);
-                if (it == pass_vec.end()) 
+                if (finfo.vids[pass_set[pos] - 1].equals(v)) 
                 {
-                    ss << res[j].vids[x];
-                    if (x < res[j].vids.size() - 1)
-                    {
-                        ss << ",";
-                    }
-                    pass_vec.push_back(res[j].vids[x]);
+                    passed = true;
+                    break;
                 }
             }
-        }
+            if (passed) 
+            {
+                continue;
+            }
+            pass_set[pos] = i + 1;
 
-        if (i < finfo.req_group_size - 1)
-        {
-            ss << "\n";
+            if (!first) 
+            {
+                *p++ = ',';
+            }
+            memcpy(p, v.ptr, v.len);
+            p += v.len;
+            first = false;
         }
     }
 
-    ctx->resp_ = ss.str();
+    resp.resize(p - out);
 
     ctx->timers_.Timer("pkg")->Stop();
 
@@ -8,7 +8,7 @@ NAME_SPACE_BS
 class FilterShow : public Filter 
 {
 public:
-    FilterShow(BloomMgrPtr bloom_mgr);
+    FilterShow(BloomEnginePtr bloom_mgr);
     virtual ~FilterShow();
 
     void StartFilter(ContextPtr ctx);
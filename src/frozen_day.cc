@@ -0,0 +1,306 @@
+#include "frozen_day.h"
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include "fuse_filter.h"
+
+NAME_SPACE_BS
+
+FrozenDay::FrozenDay()
+{
+    fd_ = -1;
+    byte_size_ = 0;
+    need_delete_ = false;
+    building_ = false;
+    mptr_ = NULL;
+    head_ = NULL;
+    filter_off_ = NULL;
+    key_off_ = NULL;
+    keys_ = NULL;
+    layout_ = lStandard;
+    bit_num_ = 0;
+    hash_num_ = 0;
+}
+
+FrozenDay::~FrozenDay()
+{
+    if (mptr_) 
+    {
+        munmap(mptr_, byte_size_);
+        mptr_ = NULL;
+    }
+
+    if (fd_ > 0) 
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+
+    // a build that did not finish leaves nothing behind
+    if (building_) 
+    {
+        unlink((path_name_ + ".tmp").c_str());
+    }
+
+    if (need_delete_) 
+    {
+        unlink(path_name_.c_str());
+    }
+}
+
+bool FrozenDay::Init(const string &fname)
+{
+    path_name_ = fname;
+
+    fd_ = open(fname.c_str(), O_RDONLY);
+    if (fd_ < 0) 
+    {
+        return false;
+    }
+
+    struct stat sb;
+    if (0 != fstat(fd_, &sb) || sb.st_size < sysconf(_SC_PAGESIZE)) 
+    {
+        return false;
+    }
+    byte_size_ = sb.st_size;
+
+    if (!Map(false)) 
+    {
+        return false;
+    }
+
+    if (FROZEN_MAGIC != head_->magic || !Attach() 
+        || byte_size_ != head_->keys_off 
+            + (int64_t)sizeof(vid_key_t) * head_->key_num) 
+    {
+        return false;
+    }
+
+    // the filters are what lookups touch, the keys stay on disk
+    madvise(mptr_, head_->keys_off, MADV_WILLNEED);
+
+    return true;
+}
+
+bool FrozenDay::Create(const string &fname, const vector<int64_t> &key_nums, 
+    const vector<int64_t> &chain_keys) 
+{
+    path_name_ = fname;
+    string tmp_fname = fname + ".tmp";
+    int64_t max_slot = key_nums.size();
+    int64_t page = sysconf(_SC_PAGESIZE);
+
+    int64_t off = page + sizeof(uint64_t) * max_slot 
+        + sizeof(int64_t) * (max_slot + 1);
+    vector<uint64_t> filter_off(max_slot, 0);
+    for (int64_t s = 0; s < max_slot; s++) 
+    {
+        if (chain_keys[s] > 0) 
+        {
+            filter_off[s] = off;
+            off += FuseFilter::ByteSize(chain_keys[s]);
+        }
+    }
+
+    int64_t keys_off = (off + page - 1) / page * page;
+    int64_t key_num = 0;
+    for (auto n : key_nums) 
+    {
+        key_num += n;
+    }
+    byte_size_ = keys_off + sizeof(vid_key_t) * key_num;
+
+    fd_ = open(tmp_fname.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0744);
+    if (fd_ < 0) 
+    {
+        return false;
+    }
+    building_ = true;
+
+    if (-1 == ftruncate(fd_, byte_size_) || !Map(true)) 
+    {
+        return false;
+    }
+
+    head_->max_slot = max_slot;
+    head_->key_num = key_num;
+    head_->keys_off = keys_off;
+    Attach();
+
+    memcpy(filter_off_, &filter_off[0], sizeof(uint64_t) * max_slot);
+    key_off_[0] = 0;
+    for (int64_t s = 0; s < max_slot; s++) 
+    {
+        key_off_[s + 1] = key_off_[s] + key_nums[s];
+    }
+
+    return true;
+}
+
+bool FrozenDay::Finish(int64_t user_num)
+{
+    head_->user_num = user_num;
+    msync(mptr_, byte_size_, MS_SYNC);
+
+    // last, a torn file is never taken for a finished one
+    head_->magic = FROZEN_MAGIC;
+    msync(mptr_, sysconf(_SC_PAGESIZE), MS_SYNC);
+
+    munmap(mptr_, byte_size_);
+    mptr_ = NULL;
+    close(fd_);
+    fd_ = -1;
+
+    string tmp_fname = path_name_ + ".tmp";
+    if (0 != rename(tmp_fname.c_str(), path_name_.c_str())) 
+    {
+        return false;
+    }
+    building_ = false;
+
+    return true;
+}
+
+bool FrozenDay::Map(bool rw)
+{
+    void *mptr = mmap(NULL, byte_size_, 
+        (rw ? (PROT_READ | PROT_WRITE) : PROT_READ), MAP_SHARED, fd_, 0);
+    if (MAP_FAILED == mptr) 
+    {
+        return false;
+    }
+
+    mptr_ = (char *)mptr;
+    head_ = (frozen_head_t *)mptr_;
+
+    return true;
+}
+
+// the parts of the mapping after the head
+bool FrozenDay::Attach()
+{
+    int64_t max_slot = head_->max_slot;
+    if (max_slot < 0 || head_->keys_off > byte_size_ 
+        || sysconf(_SC_PAGESIZE) + (int64_t)sizeof(uint64_t) 
+            * (2 * max_slot + 1) > head_->keys_off)
+    {
+        return false;
+    }
+
+    filter_off_ = (uint64_t *)(mptr_ + sysconf(_SC_PAGESIZE));
+    key_off_ = (int64_t *)(filter_off_ + max_slot);
+    keys_ = (vid_key_t *)(mptr_ + head_->keys_off);
+
+    return true;
+}
+
+vid_key_t *FrozenDay::KeysOf(int64_t slot)
+{
+    return keys_ + key_off_[slot];
+}
+
+char *FrozenDay::FilterOf(int64_t head)
+{
+    return mptr_ + filter_off_[head];
+}
+
+const char *FrozenDay::GetFilter(int64_t head)
+{
+    if (head < 0 || head >= head_->max_slot || 0 == filter_off_[head]) 
+    {
+        return NULL;
+    }
+
+    return mptr_ + filter_off_[head];
+}
+
+const vid_key_t *FrozenDay::GetKeys(int64_t slot, int64_t &num)
+{
+    if (slot < 0 || slot >= head_->max_slot) 
+    {
+        num = 0;
+
+        return NULL;
+    }
+
+    num = key_off_[slot + 1] - key_off_[slot];
+
+    return keys_ + key_off_[slot];
+}
+
+void FrozenDay::SetShape(int layout, int64_t bit_num, int hash_num, 
+    const vector<bloom_tier_t> &tiers) 
+{
+    layout_ = layout;
+    bit_num_ = bit_num;
+    hash_num_ = hash_num;
+    tiers_ = tiers;
+}
+
+int FrozenDay::GetTiers()
+{
+    return tiers_.size();
+}
+
+int64_t FrozenDay::GetBitNum(int tier)
+{
+    return tiers_.empty() ? bit_num_ : tiers_[tier].bit_num;
+}
+
+int FrozenDay::GetHashNum(int tier)
+{
+    return tiers_.empty() ? hash_num_ : tiers_[tier].hash_num;
+}
+
+int FrozenDay::GetLayout()
+{
+    return layout_;
+}
+
+void FrozenDay::GetBits(int64_t slot, int tier, char *bits)
+{
+    int64_t num = 0;
+    const vid_key_t *keys = GetKeys(slot, num);
+    int64_t bit_num = GetBitNum(tier);
+    int hash_num = GetHashNum(tier);
+
+    vector<int64_t> hashs;
+    hashs.reserve(hash_num);
+    for (int64_t i = 0; i < num; i++) 
+    {
+        hashs.clear();
+        VidLog::HashsOf(keys[i], hash_num, hashs);
+        MapBloom::Set(bits, bit_num, layout_, hashs);
+    }
+}
+
+int64_t FrozenDay::GetUserNum()
+{
+    return head_->user_num;
+}
+
+int64_t FrozenDay::GetKeyNum()
+{
+    return head_->key_num;
+}
+
+int64_t FrozenDay::GetHotBytes()
+{
+    return head_->keys_off;
+}
+
+void FrozenDay::SetDelete(bool del)
+{
+    need_delete_ = del;
+}
+
+string FrozenDay::GetFileName()
+{
+    return path_name_;
+}
+
+NAME_SPACE_ES
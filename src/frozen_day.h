@@ -0,0 +1,111 @@
+#ifndef FROZEN_DAY_H
+#define FROZEN_DAY_H
+
+#include <boost/shared_ptr.hpp>
+#include <string>
+#include <vector>
+#include "map_bloom.h"
+#include "vid_log.h"
+#include "common.h"
+
+using namespace std;
+
+NAME_SPACE_BS
+
+// A closed day after freezing, the .fuse_ file taking the place of its 
+// bloom file. Every user has one FuseFilter over the vids of all its 
+// slots, found at the user's newest slot, a lookup is 3 byte probes and 
+// the filter is sized by the vids the user really added, not by the 
+// capacity of its slots. The vids stay at the end of the file grouped 
+// by slot, so the bloom bits of a slot can still be exported, that part 
+// is only read by /sbf/get. 
+// 
+// file: frozen_head_t (one page) | uint64_t filter_off[max_slot] 
+//     | int64_t key_off[max_slot + 1] | filters | vid_key_t keys[key_num] 
+// filter_off is the file offset of the filter of the user whose newest 
+// slot it is, 0 for other slots, key_off indexes keys. Built aside and 
+// renamed into place, a file with the magic is complete.
+
+#define FROZEN_MAGIC 0x315a4f5246464253LL
+
+typedef struct frozen_head_s 
+{
+    int64_t magic;
+    int64_t max_slot;
+    int64_t user_num;
+    int64_t key_num;
+    // file offset of keys, the mapping up to it is read on lookups
+    int64_t keys_off;
+} frozen_head_t;
+
+class FrozenDay
+{
+public:
+    FrozenDay();
+    virtual ~FrozenDay();
+
+    // maps a finished fname, read only
+    bool Init(const string &fname);
+    // lays out fname aside for max_slot slots and maps it writable: 
+    // key_nums are the vids logged per slot, chain_keys those of the 
+    // chain a slot heads, 0 for a slot that heads none
+    bool Create(const string &fname, const vector<int64_t> &key_nums, 
+        const vector<int64_t> &chain_keys);
+    // writes the file back and renames it into place, a build dropped 
+    // before it removes the file aside
+    bool Finish(int64_t user_num);
+
+    // of a created file, the keys of slot and the place of the filter 
+    // headed by slot
+    vid_key_t *KeysOf(int64_t slot);
+    char *FilterOf(int64_t head);
+
+    // NULL if no user has head as its newest slot
+    const char *GetFilter(int64_t head);
+    const vid_key_t *GetKeys(int64_t slot, int64_t &num);
+
+    // the bloom the day was frozen from, before Init; tiers empty for 
+    // one slot size
+    void SetShape(int layout, int64_t bit_num, int hash_num, 
+        const vector<bloom_tier_t> &tiers);
+    int GetTiers();
+    int64_t GetBitNum(int tier = 0);
+    int GetHashNum(int tier = 0);
+    int GetLayout();
+    // the bloom bits of slot of tier again, or-ed into bits
+    void GetBits(int64_t slot, int tier, char *bits);
+
+    int64_t GetUserNum();
+    int64_t GetKeyNum();
+    // the part read on lookups
+    int64_t GetHotBytes();
+    void SetDelete(bool del);
+    string GetFileName();
+
+private:
+    bool Map(bool rw);
+    bool Attach();
+
+private:
+    int fd_;
+    int64_t byte_size_;
+    bool need_delete_;
+    // Create done, Finish not yet
+    bool building_;
+    char *mptr_;
+    frozen_head_t *head_;
+    uint64_t *filter_off_;
+    int64_t *key_off_;
+    vid_key_t *keys_;
+    string path_name_;
+    int layout_;
+    int64_t bit_num_;
+    int hash_num_;
+    vector<bloom_tier_t> tiers_;
+};
+
+typedef boost::shared_ptr<FrozenDay> FrozenDayPtr;
+
+NAME_SPACE_ES
+
+#endif
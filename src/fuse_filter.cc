@@ -0,0 +1,279 @@
+#include "fuse_filter.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+// seeds tried before giving up, one nearly always does
+#define FUSE_MAX_TRIES 100
+// segments are kept short enough for the three probes to stay close
+#define FUSE_MAX_SEGMENT 262144
+
+NAME_SPACE_BS
+
+static inline uint64_t fuse_mix(uint64_t key, uint64_t seed)
+{
+    uint64_t h = key + seed;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+static inline uint64_t fuse_next_seed(uint64_t &state)
+{
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+    return z ^ (z >> 31);
+}
+
+static inline uint8_t fuse_fingerprint(uint64_t hash)
+{
+    return (uint8_t)(hash ^ (hash >> 32));
+}
+
+// position of the hash in segment index + 0, 1 or 2 of its window
+static inline uint32_t fuse_pos(int index, uint64_t hash, 
+    const fuse_head_t *head) 
+{
+    uint64_t h = (uint64_t)(((unsigned __int128)hash 
+        * head->segment_count_length) >> 64);
+    h += index * head->segment_length;
+    uint64_t hh = hash & ((1ULL << 36) - 1);
+    h ^= (hh >> (36 - 18 * index)) & (head->segment_length - 1);
+
+    return (uint32_t)h;
+}
+
+// the sizes of a filter for size keys
+static void fuse_geometry(uint32_t size, fuse_head_t *head)
+{
+    int64_t segment_length = 4;
+    if (size > 0) 
+    {
+        segment_length = 1LL << (int)floor(log(size) / log(3.33) + 2.25);
+    }
+    segment_length = min(segment_length, (int64_t)FUSE_MAX_SEGMENT);
+
+    double factor = (size <= 1) ? 0 
+        : max(1.125, 0.875 + 0.25 * log(1000000.0) / log(size));
+    int64_t capacity = (size <= 1) ? 0 : (int64_t)round(size * factor);
+    int64_t init_count = (capacity + segment_length - 1) / segment_length - 2;
+    int64_t array_length = (init_count + 2) * segment_length;
+    int64_t segment_count = (array_length + segment_length - 1) 
+        / segment_length;
+    segment_count = (segment_count <= 2) ? 1 : segment_count - 2;
+
+    head->segment_length = segment_length;
+    head->segment_count_length = segment_count * segment_length;
+    head->array_length = (segment_count + 2) * segment_length;
+    head->key_num = 0;
+    head->seed = 0;
+}
+
+int64_t FuseFilter::ByteSize(uint32_t key_num)
+{
+    fuse_head_t head;
+    fuse_geometry(key_num, &head);
+
+    return (sizeof(fuse_head_t) + head.array_length + 7) / 8 * 8;
+}
+
+// Peeling as in the reference construction: hashes are placed in 
+// segment order for locality, every position keeps the count and xor 
+// of the hashes mapped to it, and positions with one hash left are 
+// peeled off until none is left (success) or some are stuck (new seed).
+bool FuseFilter::Build(vector<uint64_t> &keys, uint32_t size, char *out)
+{
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+
+    fuse_head_t *head = (fuse_head_t *)out;
+    fuse_geometry(size, head);
+    uint8_t *fps = (uint8_t *)(out + sizeof(fuse_head_t));
+    memset(fps, 0x00, head->array_length);
+
+    uint32_t key_num = keys.size();
+    head->key_num = key_num;
+    if (0 == key_num) 
+    {
+        return true;
+    }
+
+    uint32_t capacity = head->array_length;
+    uint32_t segment_count = head->segment_count_length 
+        / head->segment_length;
+    int block_bits = 1;
+    while ((1U << block_bits) < segment_count) 
+    {
+        block_bits++;
+    }
+    uint32_t block = 1U << block_bits;
+
+    vector<uint64_t> order(key_num + 1, 0);
+    vector<uint32_t> alone(capacity);
+    vector<uint8_t> t2count(capacity, 0);
+    vector<uint64_t> t2hash(capacity, 0);
+    vector<uint8_t> reverse_h(key_num);
+    vector<uint32_t> start(block);
+    uint32_t h012[5];
+
+    uint64_t state = 0x726b2b9d438b9d4dULL;
+    uint64_t seed = fuse_next_seed(state);
+    uint32_t peeled = 0;
+    bool built = false;
+
+    for (int tries = 0; tries < FUSE_MAX_TRIES && !built; tries++) 
+    {
+        if (tries > 0) 
+        {
+            fill(order.begin(), order.end() - 1, 0);
+            fill(t2count.begin(), t2count.end(), 0);
+            fill(t2hash.begin(), t2hash.end(), 0);
+            seed = fuse_next_seed(state);
+        }
+        order[key_num] = 1;
+
+        for (uint32_t i = 0; i < block; i++) 
+        {
+            start[i] = ((uint64_t)i * key_num) >> block_bits;
+        }
+
+        for (uint32_t i = 0; i < key_num; i++) 
+        {
+            uint64_t hash = fuse_mix(keys[i], seed);
+            uint32_t seg = hash >> (64 - block_bits);
+            while (0 != order[start[seg]]) 
+            {
+                seg = (seg + 1) & (block - 1);
+            }
+            order[start[seg]] = hash;
+            start[seg]++;
+        }
+
+        bool error = false;
+        uint32_t duplicates = 0;
+        for (uint32_t i = 0; i < key_num; i++) 
+        {
+            uint64_t hash = order[i];
+            uint32_t h0 = fuse_pos(0, hash, head);
+            uint32_t h1 = fuse_pos(1, hash, head);
+            uint32_t h2 = fuse_pos(2, hash, head);
+            t2count[h0] += 4;
+            t2hash[h0] ^= hash;
+            t2count[h1] += 4;
+            t2count[h1] ^= 1;
+            t2hash[h1] ^= hash;
+            t2count[h2] += 4;
+            t2count[h2] ^= 2;
+            t2hash[h2] ^= hash;
+
+            // two keys with the same hash cancel out, counted and undone
+            if (0 == (t2hash[h0] & t2hash[h1] & t2hash[h2]) 
+                && ((0 == t2hash[h0] && 8 == t2count[h0]) 
+                    || (0 == t2hash[h1] && 8 == t2count[h1]) 
+                    || (0 == t2hash[h2] && 8 == t2count[h2]))) 
+            {
+                duplicates++;
+                t2count[h0] -= 4;
+                t2hash[h0] ^= hash;
+                t2count[h1] -= 4;
+                t2count[h1] ^= 1;
+                t2hash[h1] ^= hash;
+                t2count[h2] -= 4;
+                t2count[h2] ^= 2;
+                t2hash[h2] ^= hash;
+            }
+
+            // a count wrapped past 63 hashes on one position
+            error = error || t2count[h0] < 4 || t2count[h1] < 4 
+                || t2count[h2] < 4;
+        }
+
+        if (error) 
+        {
+            continue;
+        }
+
+        uint32_t queue = 0;
+        for (uint32_t i = 0; i < capacity; i++) 
+        {
+            alone[queue] = i;
+            queue += (1 == (t2count[i] >> 2)) ? 1 : 0;
+        }
+
+        peeled = 0;
+        while (queue > 0) 
+        {
+            uint32_t index = alone[--queue];
+            if (1 != (t2count[index] >> 2)) 
+            {
+                continue;
+            }
+
+            uint64_t hash = t2hash[index];
+            h012[1] = fuse_pos(1, hash, head);
+            h012[2] = fuse_pos(2, hash, head);
+            h012[3] = fuse_pos(0, hash, head);
+            h012[4] = h012[1];
+            uint8_t found = t2count[index] & 3;
+            reverse_h[peeled] = found;
+            order[peeled] = hash;
+            peeled++;
+
+            for (int j = 1; j <= 2; j++) 
+            {
+                uint32_t other = h012[found + j];
+                alone[queue] = other;
+                queue += (2 == (t2count[other] >> 2)) ? 1 : 0;
+                t2count[other] -= 4;
+                t2count[other] ^= (found + j) % 3;
+                t2hash[other] ^= hash;
+            }
+        }
+
+        built = (peeled + duplicates == key_num);
+    }
+
+    if (!built) 
+    {
+        return false;
+    }
+
+    // assigned in reverse peeling order, each key's last free position 
+    // makes the xor of its three come out to its fingerprint
+    for (uint32_t i = peeled; i-- > 0; ) 
+    {
+        uint64_t hash = order[i];
+        uint8_t found = reverse_h[i];
+        h012[0] = fuse_pos(0, hash, head);
+        h012[1] = fuse_pos(1, hash, head);
+        h012[2] = fuse_pos(2, hash, head);
+        h012[3] = h012[0];
+        h012[4] = h012[1];
+        fps[h012[found]] = fuse_fingerprint(hash) 
+            ^ fps[h012[found + 1]] ^ fps[h012[found + 2]];
+    }
+    head->seed = seed;
+
+    return true;
+}
+
+bool FuseFilter::Contains(const char *filter, uint64_t key)
+{
+    const fuse_head_t *head = (const fuse_head_t *)filter;
+    const uint8_t *fps = (const uint8_t *)(filter + sizeof(fuse_head_t));
+
+    uint64_t hash = fuse_mix(key, head->seed);
+    uint8_t f = fuse_fingerprint(hash);
+    f ^= fps[fuse_pos(0, hash, head)] ^ fps[fuse_pos(1, hash, head)] 
+        ^ fps[fuse_pos(2, hash, head)];
+
+    return 0 == f;
+}
+
+NAME_SPACE_ES
@@ -0,0 +1,45 @@
+#ifndef FUSE_FILTER_H
+#define FUSE_FILTER_H
+
+#include <vector>
+#include "common.h"
+
+using namespace std;
+
+NAME_SPACE_BS
+
+// Static binary fuse filter with 8 bit fingerprints (Graf and Lemire, 
+// "Binary Fuse Filters: Fast and Smaller Than Xor Filters"), built once 
+// from a known set of 64 bit keys. A lookup reads 3 bytes in 3 adjacent 
+// segments, false positives run at 1/256, and it takes about 1.13 bytes 
+// a key on large sets, more on small ones. 
+// 
+// layout in memory: fuse_head_t | uint8_t fingerprint[array_length]
+
+typedef struct fuse_head_s 
+{
+    uint64_t seed;
+    uint32_t segment_length;
+    uint32_t segment_count_length;
+    uint32_t array_length;
+    uint32_t key_num;
+} fuse_head_t;
+
+// false positive rate of the fingerprints
+#define FUSE_FAIL_RATE (1.0 / 256)
+
+class FuseFilter
+{
+public:
+    // bytes of a filter for up to key_num keys, 8 aligned
+    static int64_t ByteSize(uint32_t key_num);
+    // builds the filter of keys into out, sized by ByteSize(size) with 
+    // size >= keys.size(). keys are sorted and deduplicated in place. 
+    // False if no seed gave a filter, which does not happen in practice.
+    static bool Build(vector<uint64_t> &keys, uint32_t size, char *out);
+    static bool Contains(const char *filter, uint64_t key);
+};
+
+NAME_SPACE_ES
+
+#endif
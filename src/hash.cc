@@ -1,17 +1,149 @@
 #include "hash.h"
+#include <math.h>
+#include <string.h>
 
 NAME_SPACE_BS
 
 int64_t Hash::max_long_ = 0x7FFFFFFFFFFFFFFF;
 
-int64_t Hash::Simple_hash(const string &str)
+void Hash::CalcHash(const string &str, int hash_type, int hash_num, 
+    vector<int64_t> &hashs)
+{
+    CalcHash(str.c_str(), str.size(), hash_type, hash_num, hashs);
+}
+
+void Hash::CalcHash(const char *str, size_t len, int hash_type, 
+    int hash_num, vector<int64_t> &hashs)
+{
+    if (hDouble != hash_type) 
+    {
+        hashs.push_back(AP_hash(str, len));
+        hashs.push_back(RS_hash(str, len));
+        hashs.push_back(JS_hash(str, len));
+        hashs.push_back(PJW_hash(str, len));
+        hashs.push_back(ELF_hash(str, len));
+        hashs.push_back(BKDR_hash(str, len));
+        hashs.push_back(DJB_hash(str, len));
+        hashs.push_back(SDBM_hash(str, len));
+
+        return;
+    }
+
+    uint64_t h[2];
+    Murmur3_128(str, len, 0, h);
+
+    // an odd step never degenerates to a single position
+    h[1] |= 1;
+
+    for (int i = 0; i < hash_num; i++) 
+    {
+        hashs.push_back((int64_t)((h[0] + i * h[1]) & max_long_));
+    }
+}
+
+int Hash::HashNum(double fail_rate)
+{
+    if (fail_rate <= 0 || fail_rate >= 1) 
+    {
+        return LEGACY_HASH_NUM;
+    }
+
+    int k = (int)round(-log(fail_rate) / log(2));
+    k = k < 1 ? 1 : k;
+
+    return k > MAX_HASH_NUM ? MAX_HASH_NUM : k;
+}
+
+static inline uint64_t rotl64(uint64_t x, int8_t r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+
+    return k;
+}
+
+void Hash::Murmur3_128(const char *key, size_t len, uint32_t seed, 
+    uint64_t out[2])
+{
+    const uint8_t *data = (const uint8_t *)key;
+    const size_t nblocks = len / 16;
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+
+    uint64_t h1 = seed;
+    uint64_t h2 = seed;
+
+    for (size_t i = 0; i < nblocks; i++) 
+    {
+        uint64_t k1;
+        uint64_t k2;
+        memcpy(&k1, data + i * 16, sizeof(uint64_t));
+        memcpy(&k2, data + i * 16 + 8, sizeof(uint64_t));
+
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    const uint8_t *tail = data + nblocks * 16;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+
+    switch (len & 15) 
+    {
+    case 15: k2 ^= ((uint64_t)tail[14]) << 48;
+    case 14: k2 ^= ((uint64_t)tail[13]) << 40;
+    case 13: k2 ^= ((uint64_t)tail[12]) << 32;
+    case 12: k2 ^= ((uint64_t)tail[11]) << 24;
+    case 11: k2 ^= ((uint64_t)tail[10]) << 16;
+    case 10: k2 ^= ((uint64_t)tail[9]) << 8;
+    case 9: k2 ^= ((uint64_t)tail[8]);
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+    case 8: k1 ^= ((uint64_t)tail[7]) << 56;
+    case 7: k1 ^= ((uint64_t)tail[6]) << 48;
+    case 6: k1 ^= ((uint64_t)tail[5]) << 40;
+    case 5: k1 ^= ((uint64_t)tail[4]) << 32;
+    case 4: k1 ^= ((uint64_t)tail[3]) << 24;
+    case 3: k1 ^= ((uint64_t)tail[2]) << 16;
+    case 2: k1 ^= ((uint64_t)tail[1]) << 8;
+    case 1: k1 ^= ((uint64_t)tail[0]);
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= len;
+    h2 ^= len;
+
+    h1 += h2;
+    h2 += h1;
+
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+
+    h1 += h2;
+    h2 += h1;
+
+    out[0] = h1;
+    out[1] = h2;
+}
+
+int64_t Hash::Simple_hash(const char *pstr, size_t len)
 {
     int64_t hash = 0;  
     unsigned char *p = NULL;  
 
-    const char *pstr = str.c_str(); 
+    const char *pend = pstr + len;
 
-    for (hash = 0, p = (unsigned char *)pstr; *p; p++) 
+    for (hash = 0, p = (unsigned char *)pstr; p < (unsigned char *)pend; p++) 
     {
         hash = 31 * hash + *p;  
     } 
@@ -19,15 +151,15 @@ int64_t Hash::Simple_hash(const string &str)
     return (hash & max_long_);
 }
 
-int64_t Hash::RS_hash(const string &str)
+int64_t Hash::RS_hash(const char *pstr, size_t len)
 {
     int64_t b = 378551;  
     int64_t a = 63689;  
     int64_t hash = 0;  
 
-    const char *pstr = str.c_str();
+    const char *pend = pstr + len;
 
-    while (*pstr) 
+    while (pstr < pend) 
     {  
         hash = hash * a + (*pstr++);  
         a *= b;  
@@ -36,13 +168,13 @@ int64_t Hash::RS_hash(const string &str)
     return (hash & max_long_);  
 }
 
-int64_t Hash::JS_hash(const string &str)
+int64_t Hash::JS_hash(const char *pstr, size_t len)
 {
     int64_t hash = 1315423911;  
 
-    const char *pstr = str.c_str();
+    const char *pend = pstr + len;
 
-    while (*pstr) 
+    while (pstr < pend) 
     {  
         hash ^= ((hash << 5) + (*pstr++) + (hash >> 2));  
     }  
@@ -50,7 +182,7 @@ int64_t Hash::JS_hash(const string &str)
     return (hash & max_long_); 
 }
 
-int64_t Hash::PJW_hash(const string &str)
+int64_t Hash::PJW_hash(const char *pstr, size_t len)
 {
     int64_t bits = (int64_t)(sizeof(int64_t) * 8);  
     int64_t quarters = (int64_t)((bits * 3) / 4);  
@@ -59,9 +191,9 @@ int64_t Hash::PJW_hash(const string &str)
     int64_t hash = 0;  
     int64_t test = 0;  
 
-    const char *pstr = str.c_str();
+    const char *pend = pstr + len;
 
-    while (*pstr) 
+    while (pstr < pend) 
     {  
         hash = (hash << one_eighth) + (*pstr++);  
         if ((test = hash & high_bits) != 0) 
@@ -73,14 +205,14 @@ int64_t Hash::PJW_hash(const string &str)
     return (hash & max_long_);  
 }
 
-int64_t Hash::ELF_hash(const string &str)
+int64_t Hash::ELF_hash(const char *pstr, size_t len)
 {
     int64_t hash = 0;  
     int64_t x = 0;  
 
-    const char *pstr = str.c_str();
+    const char *pend = pstr + len;
 
-    while (*pstr) 
+    while (pstr < pend) 
     {  
         hash = (hash << 4) + (*pstr++);  
         if ((x = hash & 0xF0000000L) != 0) 
@@ -93,14 +225,14 @@ int64_t Hash::ELF_hash(const string &str)
     return (hash & max_long_); 
 }
 
-int64_t Hash::BKDR_hash(const string &str)
+int64_t Hash::BKDR_hash(const char *pstr, size_t len)
 {
     int64_t seed = 131313;
     int64_t hash = 0;  
 
-    const char *pstr = str.c_str();
+    const char *pend = pstr + len;
 
-    while (*pstr) 
+    while (pstr < pend) 
     {  
         hash = hash * seed + (*pstr++);  
     }  
@@ -108,13 +240,13 @@ int64_t Hash::BKDR_hash(const string &str)
     return (hash & max_long_);  
 }
 
-int64_t Hash::SDBM_hash(const string &str)
+int64_t Hash::SDBM_hash(const char *pstr, size_t len)
 {
     int64_t hash = 0;  
 
-    const char *pstr = str.c_str();
+    const char *pend = pstr + len;
 
-    while (*pstr) 
+    while (pstr < pend) 
     {  
         hash = (*pstr++) + (hash << 6) + (hash << 16) - hash;  
     }  
@@ -122,13 +254,13 @@ int64_t Hash::SDBM_hash(const string &str)
     return (hash & max_long_);  
 }
 
-int64_t Hash::DJB_hash(const string &str)
+int64_t Hash::DJB_hash(const char *pstr, size_t len)
 {
     int64_t hash = 5381;  
 
-    const char *pstr = str.c_str();
+    const char *pend = pstr + len;
 
-    while (*pstr) 
+    while (pstr < pend) 
     {  
         hash += (hash << 5) + (*pstr++);  
     }  
@@ -136,13 +268,13 @@ int64_t Hash::DJB_hash(const string &str)
     return (hash & max_long_);  
 }
 
-int64_t Hash::AP_hash(const string &str)
+int64_t Hash::AP_hash(const char *pstr, size_t len)
 {
     int64_t hash = 0;  
 
-    const char *pstr = str.c_str();
+    const char *pend = pstr + len;
 
-    for (int i = 0; *pstr; i++) 
+    for (int i = 0; pstr < pend; i++) 
     {  
         if ((i & 1) == 0) 
         {  
@@ -1,33 +1,51 @@
 #ifndef HASH_H
 #define HASH_H 
 
-#include <tr1/functional>
 #include <string>
+#include <vector>
 #include "common.h"
 
 using namespace std;
 
 NAME_SPACE_BS
 
+enum HashType 
+{
+    hLegacy,
+    hDouble
+};
+
+#define LEGACY_HASH_NUM 8
+#define MAX_HASH_NUM 32
+
 class Hash 
 {
 public:
-    static int64_t Simple_hash(const string &str);  
-    static int64_t RS_hash(const string &str);  
-    static int64_t JS_hash(const string &str);  
-    static int64_t PJW_hash(const string &str);  
-    static int64_t ELF_hash(const string &str);  
-    static int64_t BKDR_hash(const string &str);  
-    static int64_t SDBM_hash(const string &str);  
-    static int64_t DJB_hash(const string &str);  
-    static int64_t AP_hash(const string &str);  
+    // hLegacy: the eight string hashes below, hash_num is ignored.
+    // hDouble: one murmur3 128 bit hash, k = hash_num positions derived 
+    // as h1 + i * h2 (Kirsch-Mitzenmacher).
+    static void CalcHash(const string &str, int hash_type, int hash_num, 
+        vector<int64_t> &hashs);
+    static void CalcHash(const char *str, size_t len, int hash_type, 
+        int hash_num, vector<int64_t> &hashs);
+    static int HashNum(double fail_rate);
+    static void Murmur3_128(const char *key, size_t len, uint32_t seed, 
+        uint64_t out[2]);
+
+    static int64_t Simple_hash(const char *pstr, size_t len);  
+    static int64_t RS_hash(const char *pstr, size_t len);  
+    static int64_t JS_hash(const char *pstr, size_t len);  
+    static int64_t PJW_hash(const char *pstr, size_t len);  
+    static int64_t ELF_hash(const char *pstr, size_t len);  
+    static int64_t BKDR_hash(const char *pstr, size_t len);  
+    static int64_t SDBM_hash(const char *pstr, size_t len);  
+    static int64_t DJB_hash(const char *pstr, size_t len);  
+    static int64_t AP_hash(const char *pstr, size_t len);  
 
 private:
     static int64_t max_long_;
 }; 
 
-typedef tr1::function<int64_t(const string &str)> HashHandle;
-
 NAME_SPACE_ES
 
 #endif
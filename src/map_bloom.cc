@@ -1,8 +1,16 @@
 #include "map_bloom.h"
+#include "cuckoo_filter.h"
+#include <math.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/vfs.h>
 #include <fcntl.h>
+#include <unistd.h>
+
+#ifndef HUGETLBFS_MAGIC
+#define HUGETLBFS_MAGIC 0x958458f6
+#endif
 
 NAME_SPACE_BS
 
@@ -11,11 +19,19 @@ MapBloom::MapBloom()
     bit_num_ = 0;
     capacity_ = 0;
     fail_rate_ = 0.0;
+    hash_type_ = hLegacy;
+    hash_num_ = LEGACY_HASH_NUM;
+    layout_ = lStandard;
+    block_num_ = 0;
     byte_size_ = 0;
+    map_size_ = 0;
     fd_ = -1;
     mptr_ = NULL;
     need_flush_ = true;
     need_delete_ = false;
+    atomic_add_ = false;
+    backing_ = mPage;
+    tier_num_ = 0;
 }
 
 MapBloom::~MapBloom()
@@ -24,7 +40,7 @@ MapBloom::~MapBloom()
     
     if (mptr_) 
     {
-        munmap(mptr_, byte_size_);
+        munmap(mptr_, map_size_);
         mptr_ = NULL;
     }
     
@@ -38,12 +54,22 @@ MapBloom::~MapBloom()
 }
 
 bool MapBloom::Init(int64_t bloom_num, int64_t capacity, double fail_rate, 
-    string fname, int64_t bit_num, bool rw)
+    int hash_type, int layout, string fname, int64_t bit_num, bool rw)
 {
     if (capacity < 0 || fail_rate < 0 || fail_rate > 1) 
     {
         return false;
     }
+
+    hash_type_ = hash_type;
+    hash_num_ = (hDouble == hash_type_) 
+        ? Hash::HashNum(fail_rate) : LEGACY_HASH_NUM;
+    layout_ = layout;
+    // a cuckoo slot takes the first hash value only
+    if (lCuckoo == layout_) 
+    {
+        hash_num_ = 1;
+    }
     
     int ret = access(fname.c_str(), F_OK);
     if (0 == ret && 0 != bit_num) 
@@ -66,9 +92,13 @@ bool MapBloom::NewBloom(int64_t bloom_num, int64_t capacity,
     size_t found = fname.rfind("/");
     fname_ = fname.substr(found + 1);
 
-    double m_g = ((capacity_ * log(fail_rate_)) / (log(2) * log(2))) * -1;
-    bit_num_ = ceil(m_g);
+    bit_num_ = BitNum(capacity_, fail_rate_, layout_);
+    if (lBlocked == layout_) 
+    {
+        block_num_ = bit_num_ / BLOCK_BITS;
+    }
     byte_size_ = (bit_num_ / 8) * bloom_num;
+    InitTiers(bloom_num);
 
     fd_ = open(path_name_.c_str(), O_CREAT | O_RDWR, 0744);
     if (fd_ < 0) 
@@ -81,6 +111,11 @@ bool MapBloom::NewBloom(int64_t bloom_num, int64_t capacity,
         return false;
     }
 
+    if (mHugetlb == backing_ && MapHuge(true)) 
+    {
+        return true;
+    }
+
     void *mptr = mmap(NULL, byte_size_, PROT_READ | PROT_WRITE, 
         MAP_SHARED | MAP_POPULATE, fd_, 0);
     if (MAP_FAILED == mptr) 
@@ -89,10 +124,109 @@ bool MapBloom::NewBloom(int64_t bloom_num, int64_t capacity,
     }
 
     mptr_ = (char *)mptr;
+    map_size_ = byte_size_;
+    if (mPage != backing_) 
+    {
+        backing_ = mThp;
+        AdviseHuge(mptr_, map_size_);
+    }
 
     return true;
 }
 
+int64_t MapBloom::BitNum(int64_t capacity, double fail_rate, int layout)
+{
+    // the fingerprints set the fail rate of a cuckoo slot
+    if (lCuckoo == layout) 
+    {
+        return CuckooFilter::ByteSize(capacity) * 8;
+    }
+
+    double m_g = ((capacity * log(fail_rate)) / (log(2) * log(2))) * -1;
+    int64_t bit_num = ceil(m_g);
+    if (lBlocked == layout) 
+    {
+        // whole blocks only, keeps every slot cache line aligned
+        return ((bit_num + BLOCK_BITS - 1) / BLOCK_BITS) * BLOCK_BITS;
+    } 
+
+    // whole bytes, or the tail bits of a slot land in the next one
+    return ((bit_num + 7) / 8) * 8;
+}
+
+void MapBloom::MakeTiers(int64_t bloom_num, int64_t capacity, 
+    double fail_rate, int hash_type, int layout, int tiers, 
+    vector<bloom_tier_t> &out)
+{
+    out.clear();
+    int64_t rest = bloom_num;
+    for (int t = 0; t < tiers && t < MAX_TIERS; t++) 
+    {
+        double rate = fail_rate / (2 << t);
+
+        bloom_tier_t tier;
+        tier.bit_num = BitNum(capacity << t, rate, layout);
+        tier.hash_num = (hDouble == hash_type) 
+            ? Hash::HashNum(rate) : LEGACY_HASH_NUM;
+        if (lCuckoo == layout) 
+        {
+            tier.hash_num = 1;
+        }
+        tier.slot_num = (0 == t) ? 0 : bloom_num >> (t + 1);
+        tier.base = 0;
+        rest -= tier.slot_num;
+        out.push_back(tier);
+    }
+
+    if (out.empty()) 
+    {
+        return;
+    }
+    out[0].slot_num = rest;
+
+    int64_t base = 0;
+    for (auto &tier : out) 
+    {
+        tier.base = base;
+        base += (tier.bit_num / 8) * tier.slot_num;
+    }
+}
+
+int64_t MapBloom::ByteSize(int64_t bloom_num, int64_t capacity, 
+    double fail_rate, int hash_type, int layout, int tiers)
+{
+    vector<bloom_tier_t> out;
+    MakeTiers(bloom_num, capacity, fail_rate, hash_type, layout, tiers, out);
+    if (out.empty()) 
+    {
+        return (BitNum(capacity, fail_rate, layout) / 8) * bloom_num;
+    }
+
+    return out.back().base + (out.back().bit_num / 8) * out.back().slot_num;
+}
+
+// a tiered bloom is the regions of its size classes back to back, the 
+// plain bit_num_ is that of tier 0
+void MapBloom::InitTiers(int64_t bloom_num)
+{
+    if (0 == tier_num_) 
+    {
+        return;
+    }
+
+    MakeTiers(bloom_num, capacity_, fail_rate_, hash_type_, layout_, 
+        tier_num_, tiers_);
+    tier_num_ = tiers_.size();
+    bit_num_ = tiers_[0].bit_num;
+    hash_num_ = tiers_[0].hash_num;
+    if (lBlocked == layout_) 
+    {
+        block_num_ = bit_num_ / BLOCK_BITS;
+    }
+    byte_size_ = tiers_.back().base 
+        + (tiers_.back().bit_num / 8) * tiers_.back().slot_num;
+}
+
 bool MapBloom::ResetBloom(int64_t bloom_num, int64_t capacity, 
     double fail_rate, string fname, int64_t bit_num, bool rw)
 {
@@ -100,68 +234,325 @@ bool MapBloom::ResetBloom(int64_t bloom_num, int64_t capacity,
     fail_rate_ = fail_rate;
     path_name_ = fname;
     bit_num_ = bit_num;
+    if (lBlocked == layout_) 
+    {
+        block_num_ = bit_num_ / BLOCK_BITS;
+    }
     byte_size_ = (bit_num_ / 8) * bloom_num;
+    InitTiers(bloom_num);
 
     size_t found = fname.rfind("/");
     fname_ = fname.substr(found + 1);
 
-    fd_ = open(path_name_.c_str(), (rw ? O_RDWR : O_RDONLY), 0744);
+    // a closed day of cuckoo slots still takes removes
+    bool writable = rw || lCuckoo == layout_;
+    fd_ = open(path_name_.c_str(), (writable ? O_RDWR : O_RDONLY), 0744);
     if (fd_ < 0) 
     {
         return false;
     }
 
+    if (rw && mHugetlb == backing_ && MapHuge(false)) 
+    {
+        return true;
+    }
+
+    // only the written day is faulted in up front, the others open in 
+    // O(1) and fault in as they are read
     void *mptr = mmap(NULL, byte_size_, 
-        (rw ? (PROT_READ | PROT_WRITE) : PROT_READ), 
-        MAP_SHARED | MAP_POPULATE, fd_, 0);
+        (writable ? (PROT_READ | PROT_WRITE) : PROT_READ), 
+        MAP_SHARED | (rw ? MAP_POPULATE : 0), fd_, 0);
     if (MAP_FAILED == mptr) 
     {
         return false;
     }
 
     mptr_ = (char *)mptr;
+    map_size_ = byte_size_;
+    if (mPage != backing_) 
+    {
+        backing_ = mThp;
+        AdviseHuge(mptr_, map_size_);
+    }
 
     return true;
 }
 
-void MapBloom::Add(int64_t offset, vector<int64_t> &hash_vals)
+// Maps huge_dir/fname in place of the bloom file. The hugetlbfs file is 
+// the live copy of the day for every process: one of the right size is 
+// used as is, otherwise it is made anew, empty for a fresh bloom (fresh) 
+// or filled from the bloom file. Sync2File and SyncRange copy it back.
+bool MapBloom::MapHuge(bool fresh)
 {
+    struct statfs sfs;
+    if (huge_dir_.empty() || 0 != statfs(huge_dir_.c_str(), &sfs) 
+        || HUGETLBFS_MAGIC != sfs.f_type) 
+    {
+        return false;
+    }
+
+    int64_t huge_page = sfs.f_bsize;
+    int64_t map_size = (byte_size_ + huge_page - 1) / huge_page * huge_page;
+    string huge_name = huge_dir_ + "/" + fname_;
+
+    int fd = open(huge_name.c_str(), O_CREAT | O_RDWR, 0744);
+    if (fd < 0) 
+    {
+        return false;
+    }
+
+    struct stat sb;
+    bool made = fresh || 0 != fstat(fd, &sb) || sb.st_size != map_size;
+    if (made && (-1 == ftruncate(fd, 0) || -1 == ftruncate(fd, map_size))) 
+    {
+        close(fd);
+
+        return false;
+    }
+
+    // the pages are reserved here, short of them mmap fails instead of 
+    // a later fault
+    void *mptr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, 
+        MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == mptr) 
+    {
+        if (made) 
+        {
+            unlink(huge_name.c_str());
+        }
+
+        return false;
+    }
+
+    if (made && !fresh) 
+    {
+        for (int64_t off = 0; off < byte_size_; ) 
+        {
+            ssize_t n = pread(fd_, (char *)mptr + off, byte_size_ - off, off);
+            if (n <= 0) 
+            {
+                munmap(mptr, map_size);
+                unlink(huge_name.c_str());
+
+                return false;
+            }
+            off += n;
+        }
+    }
+
+    mptr_ = (char *)mptr;
+    map_size_ = map_size;
+    huge_name_ = huge_name;
+
+    return true;
+}
+
+void MapBloom::AdviseHuge(void *ptr, int64_t len)
+{
+#ifdef MADV_HUGEPAGE
+    madvise(ptr, len, MADV_HUGEPAGE);
+#endif
+}
+
+bool MapBloom::CopyBack(const string &huge_name, const string &fname)
+{
+    int src = open(huge_name.c_str(), O_RDONLY);
+    if (src < 0) 
+    {
+        return false;
+    }
+
+    // the copy is rounded up to whole huge pages, the file is not
+    int dst = open(fname.c_str(), O_RDWR);
+    struct stat hsb;
+    struct stat sb;
+    if (dst < 0 || 0 != fstat(src, &hsb) || 0 != fstat(dst, &sb) 
+        || hsb.st_size < sb.st_size) 
+    {
+        close(src);
+        if (dst >= 0) 
+        {
+            close(dst);
+        }
+
+        return false;
+    }
+
+    string buf(1 << 20, 0x00);
+    int64_t off = 0;
+    while (off < sb.st_size) 
+    {
+        ssize_t n = pread(src, &buf[0], min((int64_t)buf.size(), 
+            (int64_t)sb.st_size - off), off);
+        if (n <= 0 || pwrite(dst, buf.c_str(), n, off) != n) 
+        {
+            break;
+        }
+        off += n;
+    }
+    fdatasync(dst);
+
+    close(src);
+    close(dst);
+
+    return off == sb.st_size;
+}
+
+bool MapBloom::Add(int64_t offset, vector<int64_t> &hash_vals, int tier)
+{
+    int64_t bit_num = GetBitNum(tier);
+    if (lCuckoo == layout_) 
+    {
+        return CuckooFilter::Insert(mptr_ + offset, bit_num / 8, 
+            hash_vals[0]);
+    }
+
+    if (atomic_add_) 
+    {
+        AtomicAdd(offset, bit_num, hash_vals);
+
+        return true;
+    }
+
     int64_t val = 0;
     int64_t bkt = 0;
     int off = 0;
+    int64_t block_num = (lBlocked == layout_) ? bit_num / BLOCK_BITS : 0;
+    int64_t block = BlockOf(layout_, block_num, hash_vals);
 
     for (auto v : hash_vals) 
     {
-        val = v % bit_num_;
+        val = PosOf(layout_, bit_num, block_num, block, v);
         bkt = val / 8;
         off = val % 8;
         
         char *ptr = mptr_ + offset + bkt;
         *ptr |= (1 << off);
     }
+
+    return true;
+}
+
+// All workers write the same MAP_SHARED pages, a plain byte |= may lose 
+// a bit set by another process. Bits are or-ed into aligned 64 bit words 
+// instead, one locked op per distinct word, skipped when already set.
+void MapBloom::AtomicAdd(int64_t offset, int64_t bit_num, 
+    vector<int64_t> &hash_vals)
+{
+    uint64_t words[MAX_HASH_NUM];
+    uint64_t masks[MAX_HASH_NUM];
+    int num = 0;
+    int64_t block_num = (lBlocked == layout_) ? bit_num / BLOCK_BITS : 0;
+    int64_t block = BlockOf(layout_, block_num, hash_vals);
+
+    for (int j = 0; j < hash_vals.size() && j < MAX_HASH_NUM; j++) 
+    {
+        int64_t v = hash_vals[j];
+
+        // little endian: bit off of byte bkt is bit (bkt % 8) * 8 + off
+        // of the word holding it
+        uint64_t pos = offset * 8 
+            + PosOf(layout_, bit_num, block_num, block, v);
+        uint64_t word = pos / 64;
+        uint64_t mask = (uint64_t)1 << (pos % 64);
+
+        int i = 0;
+        for (; i < num && words[i] != word; i++);
+        if (i == num) 
+        {
+            words[num] = word;
+            masks[num] = 0;
+            num++;
+        }
+        masks[i] |= mask;
+    }
+
+    uint64_t *base = (uint64_t *)mptr_;
+    for (int i = 0; i < num; i++) 
+    {
+        uint64_t *ptr = base + words[i];
+        if ((__atomic_load_n(ptr, __ATOMIC_RELAXED) & masks[i]) != masks[i]) 
+        {
+            __sync_fetch_and_or(ptr, masks[i]);
+        }
+    }
+}
+
+bool MapBloom::Lookup(int64_t offset, vector<int64_t> &hash_vals, int tier)
+{
+    if (lCuckoo == layout_) 
+    {
+        return CuckooFilter::Contains(mptr_ + offset, GetBitNum(tier) / 8, 
+            hash_vals[0]);
+    }
+
+    return Test(mptr_ + offset, GetBitNum(tier), layout_, hash_vals);
 }
 
-bool MapBloom::Lookup(int64_t offset, vector<int64_t> &hash_vals)
+bool MapBloom::Remove(int64_t offset, vector<int64_t> &hash_vals, int tier)
 {
+    if (lCuckoo != layout_) 
+    {
+        return false;
+    }
+
+    return CuckooFilter::Remove(mptr_ + offset, GetBitNum(tier) / 8, 
+        hash_vals[0]);
+}
+
+bool MapBloom::Test(const char *bits, int64_t bit_num, int layout, 
+    const vector<int64_t> &hash_vals)
+{
+    int64_t block_num = (lBlocked == layout) ? bit_num / BLOCK_BITS : 0;
+    int64_t block = BlockOf(layout, block_num, hash_vals);
+
     for (auto val : hash_vals) 
     {
-    	if (!Get(offset, val % bit_num_)) 
+        int64_t pos = PosOf(layout, bit_num, block_num, block, val);
+        if (0 == (bits[pos / 8] & (1 << (pos % 8)))) 
         {
-	    return false;
-    	}
+            return false;
+        }
     }
 
     return true;
 }
 
-bool MapBloom::Get(int64_t offset, int64_t val)
+void MapBloom::Set(char *bits, int64_t bit_num, int layout, 
+    const vector<int64_t> &hash_vals)
 {
-    int64_t bkt = val / 8;
-    int off = val % 8;
-    
-    char *ptr = mptr_ + offset + bkt;
-    
-    return (0 == (*ptr & (1 << off))) ? false : true;
+    int64_t block_num = (lBlocked == layout) ? bit_num / BLOCK_BITS : 0;
+    int64_t block = BlockOf(layout, block_num, hash_vals);
+
+    for (auto val : hash_vals) 
+    {
+        int64_t pos = PosOf(layout, bit_num, block_num, block, val);
+        bits[pos / 8] |= (1 << (pos % 8));
+    }
+}
+
+int64_t MapBloom::BlockOf(int layout, int64_t block_num, 
+    const vector<int64_t> &hash_vals)
+{
+    if (lBlocked != layout || hash_vals.empty()) 
+    {
+        return 0;
+    }
+
+    return hash_vals[0] % block_num;
+}
+
+int64_t MapBloom::PosOf(int layout, int64_t bit_num, int64_t block_num, 
+    int64_t block, int64_t val)
+{
+    if (lBlocked != layout) 
+    {
+        return val % bit_num;
+    }
+
+    // the low part of the hash went into the block choice
+    return block * BLOCK_BITS + (val / block_num) % BLOCK_BITS;
 }
 
 void MapBloom::Unlink()
@@ -178,13 +569,45 @@ void MapBloom::Sync2File()
     {
     	return;
     }
+
+    if (mHugetlb == backing_) 
+    {
+        SyncRange(0, byte_size_);
+
+        return;
+    }
     
     msync(mptr_, byte_size_, MS_SYNC);
 }
 
-int64_t MapBloom::GetBitNum()
+// msync only writes the pages dirtied, a hugetlbfs copy is written back 
+// when the day is settled
+void MapBloom::ForceSync()
 {
-    return bit_num_;
+    if (mptr_ && mHugetlb != backing_) 
+    {
+        msync(mptr_, byte_size_, MS_SYNC);
+    }
+}
+
+int64_t MapBloom::GetBitNum(int tier)
+{
+    return tiers_.empty() ? bit_num_ : tiers_[tier].bit_num;
+}
+
+int MapBloom::GetHashType()
+{
+    return hash_type_;
+}
+
+int MapBloom::GetHashNum(int tier)
+{
+    return tiers_.empty() ? hash_num_ : tiers_[tier].hash_num;
+}
+
+int MapBloom::GetLayout()
+{
+    return layout_;
 }
 
 string MapBloom::GetFileName()
@@ -197,6 +620,40 @@ char *MapBloom::GetMapPtr()
     return mptr_;
 }
 
+int64_t MapBloom::SyncRange(int64_t offset, int64_t len)
+{
+    if (!need_flush_ || NULL == mptr_ || offset >= byte_size_) 
+    {
+        return 0;
+    }
+
+    int64_t page = sysconf(_SC_PAGESIZE);
+    int64_t begin = offset / page * page;
+    int64_t end = min(offset + len, byte_size_);
+
+    if (mHugetlb != backing_) 
+    {
+        msync(mptr_ + begin, end - begin, MS_SYNC);
+
+        return end - begin;
+    }
+
+    // hugetlbfs has no backing store, the range is written to the file
+    for (int64_t off = begin; off < end; ) 
+    {
+        ssize_t n = pwrite(fd_, mptr_ + off, end - off, off);
+        if (n <= 0) 
+        {
+            return off - begin;
+        }
+        off += n;
+    }
+    sync_file_range(fd_, begin, end - begin, SYNC_FILE_RANGE_WAIT_BEFORE 
+        | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+
+    return end - begin;
+}
+
 void MapBloom::StartFlush()
 {
     need_flush_ = true;
@@ -212,4 +669,48 @@ void MapBloom::SetDelete(bool del)
     need_delete_ = del;
 }
 
+void MapBloom::SetAtomicAdd(bool atomic_add)
+{
+    atomic_add_ = atomic_add;
+}
+
+void MapBloom::SetBacking(int backing, const string &huge_dir)
+{
+    backing_ = backing;
+    huge_dir_ = huge_dir;
+}
+
+int MapBloom::GetBacking()
+{
+    return backing_;
+}
+
+void MapBloom::SetTiers(int tiers)
+{
+    tier_num_ = tiers;
+}
+
+int MapBloom::GetTiers()
+{
+    return tier_num_;
+}
+
+const bloom_tier_t &MapBloom::GetTier(int tier)
+{
+    return tiers_[tier];
+}
+
+string MapBloom::GetHugeName()
+{
+    return huge_name_;
+}
+
+void MapBloom::UnlinkHuge()
+{
+    if (!huge_name_.empty()) 
+    {
+        unlink(huge_name_.c_str());
+    }
+}
+
 NAME_SPACE_ES
@@ -4,12 +4,52 @@
 #include <boost/shared_ptr.hpp>
 #include <string>
 #include "common.h"
+#include "hash.h"
 
 using namespace std;
 using namespace boost;
 
 NAME_SPACE_BS
 
+enum BloomLayout 
+{
+    lStandard,
+    lBlocked,
+    // not a bloom: every slot is a cuckoo filter, see CuckooFilter
+    lCuckoo
+};
+
+// lBlocked: the first hash picks one 64 bytes block of the slot and 
+// all k bits of a vid are set/tested inside it, one cache line per probe
+#define BLOCK_BITS 512
+
+// the memory behind the mapping, probes land on random offsets of a 
+// multi-GB file and with 4k pages nearly every one misses the TLB
+enum MemBacking 
+{
+    mPage,
+    // transparent huge pages, asked for with madvise
+    mThp,
+    // a written bloom lives in a hugetlbfs file and is copied back to 
+    // its own file when synced, a read-only one falls back to mThp
+    mHugetlb
+};
+
+// most size classes a tiered bloom has
+#define MAX_TIERS 8
+
+// one size class of a tiered bloom: tier t holds filters of capacity 
+// << t at fail_rate / 2^(t + 1), so a chain of them stays under 
+// fail_rate, in a region of the file of its own
+typedef struct bloom_tier_s 
+{
+    int64_t bit_num;
+    int hash_num;
+    int64_t slot_num;
+    // byte offset of the region
+    int64_t base;
+} bloom_tier_t;
+
 class MapBloom
 {
 public:
@@ -17,38 +57,105 @@ public:
     virtual ~MapBloom();
 
     bool Init(int64_t bloom_num, int64_t capacity, double fail_rate, 
-        string fname, int64_t bit_num = 0, bool rw = true);
+        int hash_type, int layout, string fname, int64_t bit_num = 0, 
+        bool rw = true);
 
-    void Add(int64_t offset, vector<int64_t> &hash_vals);
-    bool Lookup(int64_t offset, vector<int64_t> &hash_vals);
+    // tier is that of the slot at offset, 0 for an untiered bloom. 
+    // false if the slot has no room for the vid, only lCuckoo
+    bool Add(int64_t offset, vector<int64_t> &hash_vals, int tier = 0);
+    bool Lookup(int64_t offset, vector<int64_t> &hash_vals, int tier = 0);
+    // lCuckoo only, false if the vid was not in the slot
+    bool Remove(int64_t offset, vector<int64_t> &hash_vals, int tier = 0);
 
     void Sync2File();
+    // Sync2File even with flushing stopped, for the removes on the 
+    // closed days of lCuckoo
+    void ForceSync();
+    // writes back the pages holding [offset, offset + len), returns the 
+    // bytes covered
+    int64_t SyncRange(int64_t offset, int64_t len);
     void StartFlush();
     void StopFlush();
     void SetDelete(bool del);
-    int64_t GetBitNum();
+    void SetAtomicAdd(bool atomic_add);
+    // before Init, huge_dir is a hugetlbfs directory for mHugetlb
+    void SetBacking(int backing, const string &huge_dir);
+    // what Init ended up with
+    int GetBacking();
+    // before Init, 0 keeps every slot at the one size of GetBitNum
+    void SetTiers(int tiers);
+    int GetTiers();
+    const bloom_tier_t &GetTier(int tier);
+    string GetHugeName();
+    // drops the hugetlbfs copy, the pages go with the last mapping
+    void UnlinkHuge();
+    // of the slots of tier, tier 0 is also the plain slot size
+    int64_t GetBitNum(int tier = 0);
+    int GetHashType();
+    int GetHashNum(int tier = 0);
+    int GetLayout();
     string GetFileName();
     char *GetMapPtr();
 
+    // bits of one slot of a new bloom
+    static int64_t BitNum(int64_t capacity, double fail_rate, int layout);
+    // the size classes of a bloom of bloom_num slots, bloom_num >> (t + 1) 
+    // of tier t and the rest of tier 0
+    static void MakeTiers(int64_t bloom_num, int64_t capacity, 
+        double fail_rate, int hash_type, int layout, int tiers, 
+        vector<bloom_tier_t> &out);
+    // file bytes of a new bloom
+    static int64_t ByteSize(int64_t bloom_num, int64_t capacity, 
+        double fail_rate, int hash_type, int layout, int tiers);
+
+    // the bit math of Add/Lookup on a bare slot, for consumers of the 
+    // exported bits and for slots rebuilt from their vids
+    static bool Test(const char *bits, int64_t bit_num, int layout, 
+        const vector<int64_t> &hash_vals);
+    static void Set(char *bits, int64_t bit_num, int layout, 
+        const vector<int64_t> &hash_vals);
+    static int64_t BlockOf(int layout, int64_t block_num, 
+        const vector<int64_t> &hash_vals);
+    static int64_t PosOf(int layout, int64_t bit_num, int64_t block_num, 
+        int64_t block, int64_t val);
+
+    static void AdviseHuge(void *ptr, int64_t len);
+    // writes a hugetlbfs copy left behind into its bloom file
+    static bool CopyBack(const string &huge_name, const string &fname);
+
 private:
     bool NewBloom(int64_t bloom_num, int64_t capacity, 
         double fail_rate, string fname);
     bool ResetBloom(int64_t bloom_num, int64_t capacity, double fail_rate, 
         string fname, int64_t bit_num, bool rw);
+    bool MapHuge(bool fresh);
+    void InitTiers(int64_t bloom_num);
     void Unlink();
-    bool Get(int64_t offset, int64_t val);
+    void AtomicAdd(int64_t offset, int64_t bit_num, 
+        vector<int64_t> &hash_vals);
 
 private:
     int64_t bit_num_; 
     int64_t capacity_;
     int64_t byte_size_;
+    int64_t map_size_;
     double fail_rate_;
+    int hash_type_;
+    int hash_num_;
+    int layout_;
+    int64_t block_num_;
     int fd_;
     bool need_flush_;
     bool need_delete_;
+    bool atomic_add_;
     char *mptr_;
     string path_name_;
     string fname_;
+    int backing_;
+    string huge_dir_;
+    string huge_name_;
+    int tier_num_;
+    vector<bloom_tier_t> tiers_;
 };
 
 typedef boost::shared_ptr<MapBloom> MapBloomPtr;
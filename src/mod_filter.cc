@@ -1,6 +1,7 @@
 #include "mod_filter.h"
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
 #include <sstream>
 #include "comm/logging.h"
 #include "comm/thread_key.h"
@@ -98,6 +99,9 @@ bool FilterModule::InitInWorker(int *thread_num)
     Register("sync", std::tr1::bind(&FilterModule::Sync, this, 
         std::tr1::placeholders::_1, std::tr1::placeholders::_2, 
         std::tr1::placeholders::_3));
+    Register("stats", std::tr1::bind(&FilterModule::Stats, this, 
+        std::tr1::placeholders::_1, std::tr1::placeholders::_2, 
+        std::tr1::placeholders::_3));
 
     show_bloom_mgr_->StartReloadMeta();
 
@@ -148,12 +152,37 @@ void FilterModule::Sync(const map<string, string>& params,
     const InvokeCompleteHandler& cb,
     boost::shared_ptr<InvokeParams> invoke_params)
 {
-    LOG(INFO) << "Got sync request...";
+    // the master's flusher does the writing, a caller polls with the 
+    // returned gen until it reads back synced
+    map<string, string> res;
+    map<string, string>::const_iterator it = params.find("gen");
+    if (params.end() != it) 
+    {
+        int64_t gen = atoll(it->second.c_str());
+        int64_t synced = show_bloom_mgr_->GetSyncedGen();
+        res["result"] = (synced >= gen) ? "synced" : "pending";
+        res["synced_gen"] = boost::lexical_cast<string>(synced);
+    } 
+    else 
+    {
+        int64_t gen = show_bloom_mgr_->RequestSync();
+        res["result"] = "sync requested";
+        res["gen"] = boost::lexical_cast<string>(gen);
+
+        LOG(INFO) << "Sync\tgen=" << gen;
+    }
 
-    show_bloom_mgr_->Sync2File();
+    InvokeResult result;
+    result.set_results(res);
+    cb(result);
+}
 
+void FilterModule::Stats(const map<string, string>& params, 
+    const InvokeCompleteHandler& cb,
+    boost::shared_ptr<InvokeParams> invoke_params)
+{
     map<string, string> res;
-    res["result"] = "sync done";
+    res["result"] = show_bloom_mgr_->GetStats();
     InvokeResult result;
     result.set_results(res);
     cb(result);
@@ -170,15 +199,39 @@ bool FilterModule::InitShowBloomMgr()
         cfg_engines_->engine("show_bloom");
     if (NULL != eng && eng->enabled()) 
     {
-        string prefix = eng->GetStr("prefix");
-        int bloom_num = eng->GetInt("bloom_num");
-        int capacity = eng->GetInt("capacity");
-        double fail_rate = eng->GetNum("fail_rate");
-        int days = eng->GetInt("days");
-        int create_bloom_at = eng->GetInt("create_bloom_at");
+        bloom_conf_t conf;
+        conf.prefix = eng->GetStr("prefix");
+        conf.bloom_num = eng->GetInt("bloom_num");
+        conf.capacity = eng->GetInt("capacity");
+        conf.fail_rate = eng->GetNum("fail_rate");
+        conf.days = eng->GetInt("days");
+        conf.create_bloom_at = eng->GetInt("create_bloom_at");
+        conf.type = TYPE_SHOW;
+        conf.hash_type = eng->GetInt("hash_type");
+        conf.layout = eng->GetInt("layout");
+        conf.atomic_add = (0 != eng->GetInt("atomic_add"));
+        conf.stage_hours = eng->GetInt("stage_hours");
+        conf.stage_mb_per_sec = eng->GetInt("stage_mb_per_sec");
+        conf.reclaim_mb_per_sec = eng->GetInt("reclaim_mb_per_sec");
+        conf.flush_sec = eng->GetInt("flush_sec");
+        conf.flush_mb_per_sec = eng->GetInt("flush_mb_per_sec");
+        conf.wal_commit_ms = eng->GetInt("wal_commit_ms");
+        conf.wal_segment_mb = eng->GetInt("wal_segment_mb");
+        conf.load_threads = eng->GetInt("load_threads");
+        conf.mem_backing = eng->GetInt("mem_backing");
+        conf.hugetlb_dir = eng->GetStr("hugetlb_dir");
+        conf.grow_tiers = eng->GetInt("grow_tiers");
+        conf.store = eng->GetInt("store");
+        conf.freeze_days = eng->GetInt("freeze_days");
             
-        show_bloom_mgr_.reset(new BloomMgr(prefix, bloom_num, capacity, 
-            fail_rate, days, create_bloom_at, TYPE_SHOW));
+        if (sSliced == conf.store) 
+        {
+            show_bloom_mgr_.reset(new SliceMgr(conf));
+        } 
+        else 
+        {
+            show_bloom_mgr_.reset(new BloomMgr(conf));
+        }
 
         return show_bloom_mgr_->InitBlooms();
     }
@@ -6,6 +6,7 @@
 #include "http_invoke_params.h"
 #include "comm/config_engine.h"
 #include "bloom_mgr.h"
+#include "slice_mgr.h"
 #include "filter.h"
 #include "filter_show.h"
 
@@ -35,6 +36,9 @@ public:
     void Sync(const std::map<std::string, std::string>& params, 
         const shs::InvokeCompleteHandler& cb,
         boost::shared_ptr<InvokeParams> invoke_params);
+    void Stats(const std::map<std::string, std::string>& params, 
+        const shs::InvokeCompleteHandler& cb,
+        boost::shared_ptr<InvokeParams> invoke_params);
 
 private:
     bool InitBloomMgr();
@@ -44,7 +48,7 @@ private:
     boost::shared_ptr<shs_conf::Config> cfg_;
     boost::shared_ptr<shs_conf::ConfigEngines> cfg_engines_;
 
-    BloomMgrPtr show_bloom_mgr_;
+    BloomEnginePtr show_bloom_mgr_;
     FilterShow *filter_show_;
 };
 
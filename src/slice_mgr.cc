@@ -0,0 +1,977 @@
+#include "slice_mgr.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <string.h>
+#include <sstream>
+#include <algorithm>
+#include "comm/logging.h"
+#include "map_bloom.h"
+#include "hash.h"
+#include "util.h"
+
+#define SLICE_FILE "slices"
+#define FLUSH_OVERLAP_MS 1000
+
+LOG_NAME("Filter");
+
+NAME_SPACE_BS
+
+static string col_name(const slice_head_t *head, int col)
+{
+    return string(head->names[col], 
+        strnlen(head->names[col], BLOOM_NAME_SZ));
+}
+
+// takes num adds of slot if it has room, a retired or free slot never has
+static bool claim(uint32_t *adds, int num, int64_t max_adds)
+{
+    uint32_t val = __atomic_load_n(adds, __ATOMIC_RELAXED);
+    while ((int64_t)val + num <= max_adds) 
+    {
+        if (__sync_bool_compare_and_swap(adds, val, val + num)) 
+        {
+            return true;
+        }
+        val = __atomic_load_n(adds, __ATOMIC_RELAXED);
+    }
+
+    return false;
+}
+
+SliceMgr::SliceMgr(const bloom_conf_t &conf)
+    : prefix_(conf.prefix)
+    , bloom_num_(conf.bloom_num)
+    , capacity_(conf.capacity)
+    , fail_rate_(conf.fail_rate)
+    , days_(conf.days)
+    , create_bloom_at_(conf.create_bloom_at)
+    , type_(conf.type)
+    , hash_type_(conf.hash_type)
+    , layout_(conf.layout)
+    , flush_sec_(conf.flush_sec)
+    , flush_mb_per_sec_(conf.flush_mb_per_sec)
+    , mem_backing_(conf.mem_backing)
+    , block_num_(0)
+    , sync_(NULL)
+    , fd_(-1)
+    , fsize_(0)
+    , mptr_(NULL)
+    , head_(NULL)
+    , fps_(NULL)
+    , adds_(NULL)
+    , cells_(NULL)
+    , ckpt_slots_(0)
+{
+    double m_g = ((capacity_ * log(fail_rate_)) / (log(2) * log(2))) * -1;
+    max_adds_ = (ceil(m_g) / 8) * 0.99;
+
+    // the positions of a slot are those of a MapBloom slot of the same 
+    // config, a cell per bit
+    bit_num_ = MapBloom::BitNum(capacity_, fail_rate_, layout_);
+    hash_num_ = (hDouble == hash_type_) 
+        ? Hash::HashNum(fail_rate_) : LEGACY_HASH_NUM;
+    if (lBlocked == layout_) 
+    {
+        block_num_ = bit_num_ / BLOCK_BITS;
+    }
+}
+
+SliceMgr::~SliceMgr()
+{
+    if (mptr_) 
+    {
+        munmap(mptr_, fsize_);
+        mptr_ = NULL;
+    }
+
+    if (fd_ > 0) 
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool SliceMgr::InitBlooms()
+{
+    if (-1 == access(prefix_.c_str(), 0)) 
+    {
+        LOG(ERROR) << "dir: " << prefix_ << " doesn't exist.";
+
+        return false;
+    }
+
+    if (days_ < 1 || days_ > MAX_SLICE_DAYS) 
+    {
+        LOG(ERROR) << "InitBlooms\tdays out of range\tdays=" << days_ 
+            << "\tmax_days=" << MAX_SLICE_DAYS;
+
+        return false;
+    }
+
+    if (lCuckoo == layout_) 
+    {
+        LOG(ERROR) << "InitBlooms\tlayout not sliced\tlayout=" << layout_;
+
+        return false;
+    }
+
+    // a free slot links the next one in the low bits of its adds
+    if (bloom_num_ >= SLICE_FREE) 
+    {
+        LOG(ERROR) << "InitBlooms\tbloom_num out of range\tbloom_num=" 
+            << bloom_num_;
+
+        return false;
+    }
+
+    // mapped before the workers are forked, so they share it
+    void *mptr = mmap(NULL, sizeof(sync_state_t), PROT_READ | PROT_WRITE, 
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == mptr) 
+    {
+        return false;
+    }
+    sync_ = (sync_state_t *)mptr;
+    sync_->request = 0;
+    sync_->done = 0;
+    sync_->flushed = 0;
+
+    if (!OpenSlices() || !LoadIndex()) 
+    {
+        return false;
+    }
+
+    create_bloom_thread_.reset(new boost::thread(tr1::bind(
+        &SliceMgr::CreateBloomHandle, this)));
+    create_bloom_thread_->detach();
+
+    flush_thread_.reset(new boost::thread(tr1::bind(
+        &SliceMgr::FlushHandle, this)));
+    flush_thread_->detach();
+
+    return true;
+}
+
+// the workers run on the master's mapping, a rotation is in the head 
+// they read on every request, there is nothing to reload
+void SliceMgr::StartReloadMeta()
+{
+}
+
+bool SliceMgr::OpenSlices()
+{
+    string fname = prefix_ + "/" + SLICE_FILE;
+    int64_t page = sysconf(_SC_PAGESIZE);
+    int64_t cells_off = (page + (sizeof(uint64_t) + sizeof(uint32_t)) 
+        * bloom_num_ + page - 1) / page * page;
+    // whole words, the rotation sweep reads cells 8 at a time
+    fsize_ = cells_off + (bit_num_ * bloom_num_ + 7) / 8 * 8;
+
+    fd_ = open(fname.c_str(), O_CREAT | O_RDWR, 0744);
+    if (fd_ < 0) 
+    {
+        return false;
+    }
+
+    struct stat sb;
+    if (0 != fstat(fd_, &sb)) 
+    {
+        return false;
+    }
+
+    if (0 == sb.st_size) 
+    {
+        if (-1 == ftruncate(fd_, fsize_)) 
+        {
+            return false;
+        }
+    }
+    else if (sb.st_size != fsize_) 
+    {
+        LOG(ERROR) << "OpenSlices\tsize mismatch\tfname=" << fname 
+            << "\tsize=" << sb.st_size << "\texpected=" << fsize_;
+
+        return false;
+    }
+
+    mptr_ = (char *)mmap(NULL, fsize_, PROT_READ | PROT_WRITE, 
+        MAP_SHARED | MAP_POPULATE, fd_, 0);
+    if (MAP_FAILED == mptr_) 
+    {
+        mptr_ = NULL;
+
+        return false;
+    }
+
+    if (mPage != mem_backing_) 
+    {
+        MapBloom::AdviseHuge(mptr_, fsize_);
+    }
+
+    head_ = (slice_head_t *)mptr_;
+    fps_ = (uint64_t *)(mptr_ + page);
+    adds_ = (uint32_t *)(fps_ + bloom_num_);
+    cells_ = (uint8_t *)(mptr_ + cells_off);
+
+    // zeroed, new or never finished
+    if (0 == head_->magic) 
+    {
+        head_->slot_num = bloom_num_;
+        head_->bit_num = bit_num_;
+        head_->hash_type = hash_type_;
+        head_->hash_num = hash_num_;
+        head_->layout = layout_;
+        head_->days = days_;
+        head_->col = 0;
+        head_->counter = 0;
+        strncpy(head_->names[0], day_name(time(NULL)).c_str(), 
+            BLOOM_NAME_SZ - 1);
+        __atomic_store_n(&head_->magic, SLICE_MAGIC, __ATOMIC_RELEASE);
+        msync(mptr_, page, MS_SYNC);
+
+        LOG(INFO) << "OpenSlices\tnew\tfname=" << fname << "\tsize=" << fsize_;
+
+        return true;
+    }
+
+    // the cells only mean something under the geometry they were set 
+    // with, a changed config needs the file moved away
+    if (SLICE_MAGIC != head_->magic || bloom_num_ != head_->slot_num 
+        || bit_num_ != head_->bit_num || hash_type_ != head_->hash_type 
+        || hash_num_ != head_->hash_num || layout_ != head_->layout 
+        || days_ != head_->days) 
+    {
+        LOG(ERROR) << "OpenSlices\tconfig mismatch\tfname=" << fname 
+            << "\tslot_num=" << head_->slot_num 
+            << "\tbit_num=" << head_->bit_num 
+            << "\tdays=" << head_->days;
+
+        return false;
+    }
+
+    // a lock of the last run, no process of it is left
+    head_->owner = 0;
+
+    LOG(INFO) << "OpenSlices\tfname=" << fname 
+        << "\tnewest=" << col_name(head_, head_->col) 
+        << "\tslots=" << SlotNum();
+
+    return true;
+}
+
+bool SliceMgr::LoadIndex()
+{
+    // slots retired or taken again after the checkpoint changed chains 
+    // below it, the index is built anew from the fps
+    string fname = prefix_ + "/.uidx_" + SLICE_FILE;
+    if (head_->retired + head_->reused != head_->relinks_ckpt) 
+    {
+        unlink(fname.c_str());
+    }
+
+    uidx_.reset(new UidIndex);
+    if (!uidx_->Init(bloom_num_, fname)) 
+    {
+        return false;
+    }
+
+    // a checkpointed image is used as is, only the slots past its 
+    // checkpoint (those of a crash before the next flush) are looked at
+    int64_t from = uidx_->IsNew() ? 0 : uidx_->GetCheckpoint();
+    int64_t slot_num = SlotNum();
+    int64_t ver = now_ms();
+    int64_t inserted = 0;
+    for (int64_t i = from; i < slot_num; i++) 
+    {
+        uint64_t key = __atomic_load_n(fps_ + i, __ATOMIC_ACQUIRE);
+        if (0 == key || (!uidx_->IsNew() && uidx_->Contains(key, i))) 
+        {
+            continue;
+        }
+
+        uidx_->Insert(key, i);
+        uidx_->Touch(i, ver);
+        inserted++;
+    }
+
+    LOG(INFO) << "BuildUidIndex\tbloom_name=" << SLICE_FILE 
+        << "\tfrom=" << from << "\tbloom_num=" << slot_num 
+        << "\tinserted=" << inserted << "\tuid_num=" << uidx_->GetUidNum();
+
+    return true;
+}
+
+int64_t SliceMgr::SlotNum()
+{
+    int64_t num = __atomic_load_n(&head_->counter, __ATOMIC_ACQUIRE);
+
+    return num < bloom_num_ ? num : bloom_num_;
+}
+
+// Free slots first, then the end of the file. The slot is claimed and 
+// its key stored before it is inserted, a retirement never sees it 
+// without adds and a rebuild finds its uid.
+int64_t SliceMgr::NewSlot(uint64_t key, int num)
+{
+    pid_lock(&head_->owner);
+
+    int64_t slot = head_->free_top - 1;
+    bool reuse = slot >= 0;
+    if (reuse) 
+    {
+        head_->free_top = __atomic_load_n(adds_ + slot, __ATOMIC_RELAXED) 
+            & ~SLICE_FREE;
+        head_->free_num--;
+    }
+    else if (head_->counter < bloom_num_) 
+    {
+        slot = head_->counter;
+        __atomic_store_n(&head_->counter, slot + 1, __ATOMIC_RELEASE);
+    }
+
+    if (slot >= 0) 
+    {
+        __atomic_store_n(adds_ + slot, (uint32_t)num, __ATOMIC_RELAXED);
+        __atomic_store_n(fps_ + slot, key, __ATOMIC_RELEASE);
+        uidx_->Insert(key, slot);
+        // counted once written back with its link, see FlushDirty
+        uidx_->Touch(slot, now_ms());
+        if (reuse) 
+        {
+            __atomic_add_fetch(&head_->reused, 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    pid_unlock(&head_->owner);
+
+    return slot;
+}
+
+bool SliceMgr::SlotEmpty(int64_t slot)
+{
+    const uint64_t *words = (const uint64_t *)(cells_ + bit_num_ * slot);
+    for (int64_t i = 0; i < bit_num_ / 8; i++) 
+    {
+        if (0 != __atomic_load_n(words + i, __ATOMIC_RELAXED)) 
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int64_t SliceMgr::Recycle(const vector<int64_t> &empty)
+{
+    int64_t ver = now_ms();
+    int64_t slot_num = SlotNum();
+    int64_t retired = 0;
+
+    // retired a rotation ago, a lookup that still had them in a chain 
+    // is done. Only a rotation retires, they are listed before locking.
+    vector<int64_t> freed;
+    for (int64_t slot = 0; slot < slot_num; slot++) 
+    {
+        if (SLICE_RETIRED == __atomic_load_n(adds_ + slot, __ATOMIC_RELAXED)) 
+        {
+            freed.push_back(slot);
+        }
+    }
+
+    pid_lock(&head_->owner);
+
+    for (auto slot : freed) 
+    {
+        __atomic_store_n(adds_ + slot, 
+            SLICE_FREE | (uint32_t)head_->free_top, __ATOMIC_RELAXED);
+        head_->free_top = slot + 1;
+        head_->free_num++;
+        uidx_->Touch(slot, ver);
+    }
+
+    // an Add claims before it sets bits and adds is reset after this, 
+    // 0 means no Add since the last rotation; retired, none claims it
+    for (auto slot : empty) 
+    {
+        if (!__sync_bool_compare_and_swap(adds_ + slot, 0, SLICE_RETIRED)) 
+        {
+            continue;
+        }
+
+        if (!SlotEmpty(slot)) 
+        {
+            __atomic_store_n(adds_ + slot, 0, __ATOMIC_RELAXED);
+
+            continue;
+        }
+
+        int64_t prev = -1;
+        uint64_t key = __atomic_load_n(fps_ + slot, __ATOMIC_ACQUIRE);
+        uidx_->Remove(key, slot, prev);
+        __atomic_store_n(fps_ + slot, 0, __ATOMIC_RELEASE);
+        uidx_->Touch(slot, ver);
+        if (prev >= 0) 
+        {
+            uidx_->Touch(prev, ver);
+        }
+        __atomic_add_fetch(&head_->retired, 1, __ATOMIC_RELEASE);
+        retired++;
+    }
+
+    pid_unlock(&head_->owner);
+
+    return retired;
+}
+
+void SliceMgr::CreateBloomHandle()
+{
+    while (1) 
+    {
+        // wake at the start of the next create_bloom_at hour, or right 
+        // away when started inside it and the day is not there yet
+        time_t curr_time = time(NULL);
+        struct tm tmstru;
+        localtime_r(&curr_time, &tmstru);
+        tmstru.tm_hour = create_bloom_at_;
+        tmstru.tm_min = 0;
+        tmstru.tm_sec = 0;
+        tmstru.tm_isdst = -1;
+        time_t next_time = mktime(&tmstru);
+        if (next_time + 3600 <= curr_time) 
+        {
+            tmstru.tm_mday += 1;
+            tmstru.tm_isdst = -1;
+            next_time = mktime(&tmstru);
+        }
+
+        // short steps, a clock jump can't make us oversleep by much
+        while ((curr_time = time(NULL)) < next_time) 
+        {
+            sleep(min((int)(next_time - curr_time), 60));
+        }
+
+        localtime_r(&curr_time, &tmstru);
+        string name = day_name(curr_time);
+        int col = __atomic_load_n(&head_->col, __ATOMIC_ACQUIRE);
+        if (0 == col_name(head_, col).compare(name)) 
+        {
+            sleep(1);
+
+            continue;
+        }
+
+        if (create_bloom_at_ != tmstru.tm_hour) 
+        {
+            continue;
+        }
+
+        Rotate(name);
+        __atomic_store_n(&head_->rotation_lag_ms, 
+            now_ms() - (int64_t)next_time * 1000, __ATOMIC_RELAXED);
+    }
+}
+
+// The column of the oldest day becomes the newest one: its bit is 
+// cleared in every cell of the slots handed out so far, a word of 8 
+// cells at a time and only where set, so untouched pages stay clean. 
+// Adds keep going to the old newest column until the switch, lookups 
+// of the whole window may miss part of the oldest day while it is 
+// swept. Slots with no bit of any day left are given back. A swept slot 
+// is touched and written back by the next flush pass like an Add, 
+// rotation itself does no I/O.
+void SliceMgr::Rotate(const string &name)
+{
+    boost::mutex::scoped_lock lock(flush_mutex_);
+
+    int64_t begin_ms = now_ms();
+    int col = (__atomic_load_n(&head_->col, __ATOMIC_ACQUIRE) + 1) % days_;
+    uint64_t mask = 0x0101010101010101ULL << col;
+    int64_t slot_num = SlotNum();
+    int64_t cleared = 0;
+    vector<int64_t> empty;
+    for (int64_t slot = 0; slot < slot_num; slot++) 
+    {
+        // bit_num is whole bytes, a slot is whole words
+        uint64_t *words = (uint64_t *)(cells_ + bit_num_ * slot);
+        uint64_t left = 0;
+        int64_t swept = 0;
+        for (int64_t i = 0; i < bit_num_ / 8; i++) 
+        {
+            uint64_t word = __atomic_load_n(words + i, __ATOMIC_RELAXED);
+            if (0 != (word & mask)) 
+            {
+                __sync_fetch_and_and(words + i, ~mask);
+                swept++;
+            }
+            left |= word & ~mask;
+        }
+
+        if (swept > 0) 
+        {
+            uidx_->Touch(slot, begin_ms);
+            cleared += swept;
+        }
+
+        if (0 == left && 0 != __atomic_load_n(fps_ + slot, __ATOMIC_RELAXED)) 
+        {
+            empty.push_back(slot);
+        }
+    }
+
+    memset(head_->names[col], 0x00, BLOOM_NAME_SZ);
+    strncpy(head_->names[col], name.c_str(), BLOOM_NAME_SZ - 1);
+    __atomic_store_n(&head_->col, col, __ATOMIC_RELEASE);
+
+    int64_t retired = Recycle(empty);
+
+    // adds counts the newest day only, every slot in use has room again. 
+    // Not written back for itself, a stale count only limits the day.
+    for (int64_t i = 0; i < slot_num; i++) 
+    {
+        uint32_t adds = __atomic_load_n(adds_ + i, __ATOMIC_RELAXED);
+        if (SLICE_RETIRED != adds && 0 == (adds & SLICE_FREE)) 
+        {
+            __atomic_store_n(adds_ + i, 0, __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_add_fetch(&head_->rotations, 1, __ATOMIC_RELAXED);
+    RequestSync();
+
+    LOG(INFO) << "Rotation\tpid=" << getpid() << "\tlast_hour=" << name 
+        << "\tcol=" << col << "\tcleared_words=" << cleared 
+        << "\tretired=" << retired 
+        << "\tfree_slots=" << __atomic_load_n(&head_->free_num, __ATOMIC_RELAXED) 
+        << "\tcost_ms=" << now_ms() - begin_ms;
+}
+
+int64_t SliceMgr::RequestSync()
+{
+    return __sync_add_and_fetch(&sync_->request, 1);
+}
+
+int64_t SliceMgr::GetSyncedGen()
+{
+    return __atomic_load_n(&sync_->done, __ATOMIC_ACQUIRE);
+}
+
+void SliceMgr::FlushHandle()
+{
+    int64_t since = 0;
+    int64_t last_flush = now_ms();
+
+    while (true) 
+    {
+        usleep(100000);
+
+        int64_t req = __atomic_load_n(&sync_->request, __ATOMIC_ACQUIRE);
+        bool due = flush_sec_ > 0 && now_ms() - last_flush >= flush_sec_ * 1000;
+        if (req <= GetSyncedGen() && !due) 
+        {
+            continue;
+        }
+
+        boost::mutex::scoped_lock lock(flush_mutex_);
+
+        // an Add touches its slot after setting the bits, a slot touched 
+        // from here on is flushed by the next pass
+        last_flush = now_ms();
+        int64_t bytes = FlushDirty(since);
+        since = last_flush - FLUSH_OVERLAP_MS;
+
+        __atomic_store_n(&sync_->flushed, since, __ATOMIC_RELEASE);
+        __atomic_store_n(&sync_->done, req, __ATOMIC_RELEASE);
+
+        LOG(INFO) << "FlushDirty\tsynced_gen=" << req << "\tbytes=" << bytes 
+            << "\tcost_ms=" << now_ms() - last_flush;
+    }
+}
+
+// Writes back the slots touched at or after since, as runs of adjacent 
+// slots, at flush_mb_per_sec.
+int64_t SliceMgr::FlushDirty(int64_t since)
+{
+    int64_t slot_num = SlotNum();
+    // a slot retired or taken again is touched before it is counted
+    int64_t relinks = __atomic_load_n(&head_->retired, __ATOMIC_ACQUIRE) 
+        + __atomic_load_n(&head_->reused, __ATOMIC_ACQUIRE);
+    int64_t rate = (int64_t)flush_mb_per_sec_ << 20;
+    int64_t begin_ms = now_ms();
+    int64_t bytes = SyncRange(mptr_, sizeof(slice_head_t));
+
+    for (int64_t slot = 0; slot < slot_num; ) 
+    {
+        if (uidx_->GetVersion(slot) < since) 
+        {
+            slot++;
+
+            continue;
+        }
+
+        int64_t end = slot + 1;
+        while (end < slot_num && uidx_->GetVersion(end) >= since) 
+        {
+            end++;
+        }
+
+        bytes += SyncRange((char *)(cells_ + bit_num_ * slot), 
+                bit_num_ * (end - slot)) 
+            + SyncRange((char *)(fps_ + slot), sizeof(uint64_t) * (end - slot)) 
+            + SyncRange((char *)(adds_ + slot), 
+                sizeof(uint32_t) * (end - slot));
+        bytes += uidx_->SyncSlots(slot, end);
+        slot = end;
+
+        if (rate > 0) 
+        {
+            int64_t ahead = bytes * 1000 / rate - (now_ms() - begin_ms);
+            if (ahead > 0) 
+            {
+                usleep(ahead * 1000);
+            }
+        }
+    }
+
+    bytes += uidx_->SyncBuckets();
+
+    // a slot is counted before it is inserted, the inserts of the slots 
+    // counted one pass ago are done and now written back
+    uidx_->Checkpoint(ckpt_slots_);
+    ckpt_slots_ = slot_num;
+    __atomic_store_n(&head_->relinks_ckpt, relinks, __ATOMIC_RELEASE);
+    SyncRange(mptr_, sizeof(slice_head_t));
+
+    return bytes;
+}
+
+int64_t SliceMgr::SyncRange(char *ptr, int64_t len)
+{
+    if (len <= 0) 
+    {
+        return 0;
+    }
+
+    int64_t page = sysconf(_SC_PAGESIZE);
+    char *begin = mptr_ + (ptr - mptr_) / page * page;
+    msync(begin, ptr + len - begin, MS_SYNC);
+
+    return ptr + len - begin;
+}
+
+string SliceMgr::GetStats()
+{
+    int col = __atomic_load_n(&head_->col, __ATOMIC_ACQUIRE);
+
+    stringstream ss;
+    ss << "pid=" << getpid() 
+        << "\tstore=" << sSliced 
+        << "\tdays=" << days_ 
+        << "\tnewest=" << col_name(head_, col) 
+        << "\tcol=" << col 
+        << "\tuid_num=" << uidx_->GetUidNum() 
+        << "\tbloom_num=" << SlotNum() 
+        << "\tfree_slots=" << __atomic_load_n(&head_->free_num, __ATOMIC_RELAXED) 
+        << "\tretired=" << __atomic_load_n(&head_->retired, __ATOMIC_RELAXED) 
+        << "\treused=" << __atomic_load_n(&head_->reused, __ATOMIC_RELAXED) 
+        << "\tmem_backing=" << mem_backing_ 
+        << "\trotations=" << __atomic_load_n(&head_->rotations, __ATOMIC_RELAXED) 
+        << "\trotation_lag_ms=" 
+        << __atomic_load_n(&head_->rotation_lag_ms, __ATOMIC_RELAXED) 
+        << "\tsync_gen=" << __atomic_load_n(&sync_->request, __ATOMIC_ACQUIRE) 
+        << "\tsynced_gen=" << GetSyncedGen();
+
+    return ss.str();
+}
+
+bool SliceMgr::Add(ContextPtr ctx)
+{
+    int vid_num = ctx->finfo_.vid_size;
+    int col = __atomic_load_n(&head_->col, __ATOMIC_ACQUIRE);
+    uint8_t bit = 1 << col;
+    uint64_t key = UidIndex::UidHash(ctx->uid_);
+
+    // the newest slot of the user with room left today, older ones 
+    // have room again after a rotation
+    int64_t slot = uidx_->Find(key);
+    for (; slot >= 0; slot = uidx_->Next(slot)) 
+    {
+        if (claim(adds_ + slot, vid_num, max_adds_)) 
+        {
+            break;
+        }
+    }
+
+    if (slot < 0 && (slot = NewSlot(key, vid_num)) < 0) 
+    {
+        ctx->err_ = eForbid;
+
+        LOG(ERROR) << "bloom_overflow" 
+            << "\tbloom_num=" << bloom_num_ << "\tuid=" << ctx->uid_ 
+            << "\tsid=" << ctx->sid_;
+
+        return false;
+    }
+
+    // always a locked or, a plain one racing with the sweep of a 
+    // rotation could write back a bit of the day being cleared
+    uint8_t *cell = cells_ + bit_num_ * slot;
+    vector<int64_t> hashs;
+    hashs.reserve(hash_num_);
+    auto &finfo = ctx->finfo_;
+    for (uint32_t i = 0, g = 0; i < finfo.vids.size(); i++) 
+    {
+        const VidView &v = finfo.vids[i];
+        Hash::CalcHash(v.ptr, v.len, hash_type_, hash_num_, hashs);
+        int64_t block = MapBloom::BlockOf(layout_, block_num_, hashs);
+        for (auto val : hashs) 
+        {
+            uint8_t *ptr = cell 
+                + MapBloom::PosOf(layout_, bit_num_, block_num_, block, val);
+            if (0 == (__atomic_load_n(ptr, __ATOMIC_RELAXED) & bit)) 
+            {
+                __sync_fetch_and_or(ptr, bit);
+            }
+        }
+        hashs.clear();
+
+        if (i > 0) 
+        {
+            ctx->add_vids_ << ((i == finfo.groups[g]) ? "|" : ",");
+        }
+        if (i == finfo.groups[g]) 
+        {
+            g++;
+        }
+        ctx->add_vids_.write(v.ptr, v.len);
+    }
+
+    uidx_->Touch(slot, now_ms());
+
+    return true;
+}
+
+// a cell only knows that some vid of the slot set it
+bool SliceMgr::Remove(ContextPtr ctx)
+{
+    ctx->err_ = eForbid;
+
+    return false;
+}
+
+void SliceMgr::Get(ContextPtr ctx)
+{
+    auto &finfo = ctx->finfo_;
+    auto &filtered_vids = ctx->filtered_vids_;
+    if (filtered_vids.str().size() > 0) 
+    {
+        filtered_vids << "_";
+    }
+    int days = ctx->days_ < 0 ? days_ : ctx->days_;
+    uint8_t mask = DayMask(days);
+
+    vector<int64_t> slots;
+    UserSlots(ctx->uid_, slots);
+
+    finfo.hits.assign(finfo.vids.size(), 0);
+    for (uint32_t i = 0, g = 0; i < finfo.vids.size(); i++) 
+    {
+        if (i == finfo.groups[g]) 
+        {
+            filtered_vids << "|";
+            g++;
+        }
+
+        const VidView &v = finfo.vids[i];
+        if (!v.empty() && !slots.empty() && Lookup(slots, mask, v)) 
+        {
+            finfo.hits[i] = 1;
+            filtered_vids.write(v.ptr, v.len);
+            if (i + 1 < finfo.groups[g]) 
+            {
+                filtered_vids << ",";
+            }
+        }
+    }
+}
+
+void SliceMgr::UserSlots(const string &uid, vector<int64_t> &slots)
+{
+    for (int64_t slot = uidx_->Find(uid); slot >= 0; 
+        slot = uidx_->Next(slot)) 
+    {
+        slots.push_back(slot);
+    }
+}
+
+// one probe sequence for all the days: the AND of the k cells keeps 
+// the bit of each day that has the vid
+bool SliceMgr::Lookup(const vector<int64_t> &slots, uint8_t mask, 
+    const VidView &vid) 
+{
+    vector<int64_t> hashs;
+    hashs.reserve(hash_num_);
+    Hash::CalcHash(vid.ptr, vid.len, hash_type_, hash_num_, hashs);
+    int64_t block = MapBloom::BlockOf(layout_, block_num_, hashs);
+
+    for (auto slot : slots) 
+    {
+        const uint8_t *cell = cells_ + bit_num_ * slot;
+        uint8_t seen = mask;
+        for (size_t i = 0; i < hashs.size() && 0 != seen; i++) 
+        {
+            seen &= cell[MapBloom::PosOf(layout_, bit_num_, block_num_, 
+                block, hashs[i])];
+        }
+
+        if (0 != seen) 
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint8_t SliceMgr::DayMask(int days)
+{
+    int col = __atomic_load_n(&head_->col, __ATOMIC_ACQUIRE);
+    uint8_t mask = 0;
+    for (int i = 0; i < days && i < days_; i++) 
+    {
+        mask |= 1 << ((col - i + days_) % days_);
+    }
+
+    return mask;
+}
+
+void SliceMgr::DayCols(const string &ts, vector<int> &cols)
+{
+    int col = __atomic_load_n(&head_->col, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < days_; i++) 
+    {
+        int c = (col - i + days_) % days_;
+        string name = col_name(head_, c);
+        if (name.empty() || 0 == name.compare(ts)) 
+        {
+            break;
+        }
+
+        cols.push_back(c);
+    }
+}
+
+bool SliceMgr::ExtractDay(int64_t slot, int col, char *bits)
+{
+    const uint8_t *cell = cells_ + bit_num_ * slot;
+    memset(bits, 0x00, (bit_num_ + 7) / 8);
+
+    bool any = false;
+    for (int64_t p = 0; p < bit_num_; p++) 
+    {
+        if (cell[p] & (1 << col)) 
+        {
+            bits[p / 8] |= 1 << (p % 8);
+            any = true;
+        }
+    }
+
+    return any;
+}
+
+// the same payload as BloomMgr: a plain bloom per day and slot, cut 
+// out of the cells, days where the slot has no bit are left out
+void SliceMgr::GetBloom(ContextPtr ctx)
+{
+    if (eDelta == ctx->mode_) 
+    {
+        GetBloomDelta(ctx);
+
+        return;
+    }
+
+    // the mode=0 blob has no room for the hash scheme or layout
+    if (hLegacy != hash_type_ || lStandard != layout_) 
+    {
+        ctx->err_ = eForbid;
+
+        return;
+    }
+
+    vector<int> cols;
+    DayCols(ctx->ts_, cols);
+
+    vector<int64_t> slots;
+    UserSlots(ctx->uid_, slots);
+
+    vector<export_slot_t> out;
+    list<string> bits;
+    ExportSlots(cols, slots, out, bits);
+    BloomExport::PutFull(type_, out, ctx->blooms_);
+}
+
+void SliceMgr::GetBloomDelta(ContextPtr ctx)
+{
+    // taken before any bit is read, an Add racing with the copy below 
+    // stamps its slot at or after it and is sent again next time
+    int64_t version = now_ms();
+
+    vector<int> cols;
+    DayCols(ctx->ts_, cols);
+
+    vector<string> days;
+    for (auto col : cols) 
+    {
+        days.push_back(col_name(head_, col));
+    }
+
+    vector<int64_t> slots;
+    for (int64_t slot = uidx_->Find(ctx->uid_); slot >= 0;
+        slot = uidx_->Next(slot)) 
+    {
+        if (uidx_->GetVersion(slot) >= ctx->ver_) 
+        {
+            slots.push_back(slot);
+        }
+    }
+
+    vector<export_slot_t> out;
+    list<string> bits;
+    ExportSlots(cols, slots, out, bits);
+    BloomExport::PutDelta(type_, version, days, out, ctx->blooms_);
+}
+
+void SliceMgr::ExportSlots(const vector<int> &cols, 
+    const vector<int64_t> &slots, vector<export_slot_t> &out, 
+    list<string> &bits)
+{
+    for (auto col : cols) 
+    {
+        string name = col_name(head_, col);
+        for (auto slot : slots) 
+        {
+            bits.push_back(string(bit_num_ / 8, 0x00));
+            if (!ExtractDay(slot, col, &bits.back()[0])) 
+            {
+                bits.pop_back();
+                continue;
+            }
+
+            export_slot_t s;
+            s.name = name;
+            s.bits = bits.back().c_str();
+            s.bit_num = bit_num_;
+            s.slot = slot;
+            s.version = uidx_->GetVersion(slot);
+            s.hash_type = hash_type_;
+            s.hash_num = hash_num_;
+            s.layout = layout_;
+            out.push_back(s);
+        }
+    }
+}
+
+NAME_SPACE_ES
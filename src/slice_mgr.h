@@ -0,0 +1,166 @@
+#ifndef SLICE_MGR_H
+#define SLICE_MGR_H
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <list>
+#include "bloom_engine.h"
+#include "bloom_mgr.h"
+#include "uid_index.h"
+#include "common.h"
+#include "context.h"
+
+using namespace std;
+
+NAME_SPACE_BS
+
+// a day is one bit of a cell, days of a sliced window
+#define MAX_SLICE_DAYS 8
+#define SLICE_MAGIC 0x3145434c49534253LL
+// adds of a slot given up by its uid, it is freed by the next rotation
+#define SLICE_RETIRED 0xffffffffU
+// adds of a free slot, the low bits hold the next free slot + 1
+#define SLICE_FREE 0x80000000U
+
+typedef struct slice_head_s 
+{
+    int64_t magic;
+    int64_t slot_num;
+    int64_t bit_num;
+    int32_t hash_type;
+    int32_t hash_num;
+    int32_t layout;
+    int32_t days;
+    // column of the newest day, the one adds go to
+    int32_t col;
+    int32_t reserved;
+    // slots taken from the end of the file, at most slot_num
+    int64_t counter;
+    int64_t rotations;
+    int64_t rotation_lag_ms;
+    // the day in each column, "" for a column not used yet
+    char names[MAX_SLICE_DAYS][BLOOM_NAME_SZ];
+    // pid holding the slot lock, see pid_lock
+    int32_t owner;
+    int32_t reserved2;
+    // first free slot + 1, 0 for none
+    int64_t free_top;
+    int64_t free_num;
+    int64_t retired;
+    int64_t reused;
+    // retired + reused at the last checkpoint of .uidx_slices
+    int64_t relinks_ckpt;
+} slice_head_t;
+
+// The whole window of days in one file, bit-sliced: a user's slot has 
+// one byte per bloom position instead of one bit, bit c of the byte is 
+// the position's bit in the day of column c. A vid is hashed and probed 
+// once for all days, the AND of its k cells has bit c set if day c has 
+// the vid, and a lookup over the last N days tests it against a mask of 
+// their columns. Rotation moves the newest column one on and clears it, 
+// no file is created or dropped. 
+// 
+// file: slice_head_t (one page) | uint64_t fp[slot_num] 
+//     | uint32_t adds[slot_num] | uint8_t cell[slot_num][bit_num] 
+// fp is the UidIndex key of the slot's uid, stored before the slot is 
+// inserted so .uidx_slices can be rebuilt from it. adds counts the vids 
+// of the newest day only, or marks a slot retired or free. A user's 
+// slots are taken again in later days once rotation has emptied them. 
+// A slot left without any day bit by a rotation is retired: it leaves 
+// the chain of its uid at once and is freed by the next rotation, so a 
+// lookup that read the chain before can't see the bits of its next 
+// user. Slots are taken from the free list first, so bloom_num has to 
+// cover the users active in the window only.
+class SliceMgr : public BloomEngine
+{
+public:
+    explicit SliceMgr(const bloom_conf_t &conf);
+    virtual ~SliceMgr();
+
+    bool InitBlooms();
+    void StartReloadMeta();
+
+    bool Add(ContextPtr ctx);
+    bool Remove(ContextPtr ctx);
+    void Get(ContextPtr ctx);
+    void GetBloom(ContextPtr ctx);
+
+    int64_t RequestSync();
+    int64_t GetSyncedGen();
+    string GetStats();
+
+    // the day named name takes the column of the oldest one
+    void Rotate(const string &name);
+    // the slots of uid, newest first
+    void UserSlots(const string &uid, vector<int64_t> &slots);
+    // the columns of the newest days of the window
+    uint8_t DayMask(int days);
+    // the vid is in one of slots in a day of mask
+    bool Lookup(const vector<int64_t> &slots, uint8_t mask, 
+        const VidView &vid);
+
+private:
+    bool OpenSlices();
+    bool LoadIndex();
+    void CreateBloomHandle();
+    void FlushHandle();
+    int64_t FlushDirty(int64_t since);
+    int64_t SyncRange(char *ptr, int64_t len);
+    int64_t SlotNum();
+    // takes a free slot for key with num adds claimed, -1 if none left
+    int64_t NewSlot(uint64_t key, int num);
+    // frees the slots retired by the last rotation, then retires those 
+    // of empty that are still so, returns the number retired
+    int64_t Recycle(const vector<int64_t> &empty);
+    bool SlotEmpty(int64_t slot);
+    // columns of the newest days newest first, up to the one named ts 
+    // if ts is given
+    void DayCols(const string &ts, vector<int> &cols);
+    // the bits of slot in the day of col as a plain bloom, false if 
+    // none is set
+    bool ExtractDay(int64_t slot, int col, char *bits);
+    void GetBloomDelta(ContextPtr ctx);
+    // the days of cols of slots as plain blooms, bits holds them
+    void ExportSlots(const vector<int> &cols, const vector<int64_t> &slots, 
+        vector<export_slot_t> &out, list<string> &bits);
+
+private:
+    string prefix_;
+    int64_t bloom_num_;
+    int64_t capacity_;
+    double fail_rate_;
+    int days_;
+    int64_t max_adds_;
+    int create_bloom_at_;
+    int32_t type_;
+    int hash_type_;
+    int layout_;
+    int flush_sec_;
+    int flush_mb_per_sec_;
+    int mem_backing_;
+    int64_t bit_num_;
+    int hash_num_;
+    int64_t block_num_;
+    sync_state_t *sync_;
+    int fd_;
+    int64_t fsize_;
+    char *mptr_;
+    slice_head_t *head_;
+    uint64_t *fps_;
+    uint32_t *adds_;
+    uint8_t *cells_;
+    UidIndexPtr uidx_;
+    // flush thread only, the slot count at the last pass
+    int64_t ckpt_slots_;
+    // a flush pass and the sweep of a rotation never overlap
+    boost::mutex flush_mutex_;
+    boost::shared_ptr<boost::thread> create_bloom_thread_;
+    boost::shared_ptr<boost::thread> flush_thread_;
+};
+
+typedef boost::shared_ptr<SliceMgr> SliceMgrPtr;
+
+NAME_SPACE_ES
+
+#endif
@@ -0,0 +1,533 @@
+#include "uid_index.h"
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "hash.h"
+
+NAME_SPACE_BS
+
+static int64_t bucket_num_of(int64_t slot_num)
+{
+    // keep the load factor under 2/3
+    int64_t want = slot_num + slot_num / 2 + 1;
+    int64_t num = 1;
+    while (num < want) 
+    {
+        num <<= 1;
+    }
+
+    return num;
+}
+
+UidIndex::UidIndex()
+{
+    byte_size_ = 0;
+    bucket_mask_ = 0;
+    fd_ = -1;
+    is_new_ = false;
+    need_flush_ = true;
+    need_delete_ = false;
+    mptr_ = NULL;
+    head_ = NULL;
+    buckets_ = NULL;
+    next_ = NULL;
+    version_ = NULL;
+}
+
+UidIndex::~UidIndex()
+{
+    Sync2File();
+
+    if (mptr_) 
+    {
+        munmap(mptr_, byte_size_);
+        mptr_ = NULL;
+    }
+
+    if (fd_ > 0) 
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+
+    Unlink();
+}
+
+bool UidIndex::Init(int64_t slot_num, string fname, bool rw, bool populate)
+{
+    if (slot_num <= 0) 
+    {
+        return false;
+    }
+
+    path_name_ = fname;
+    byte_size_ = ByteSize(slot_num);
+
+    struct stat sb;
+    if (0 == stat(path_name_.c_str(), &sb) && sb.st_size == byte_size_) 
+    {
+        if (ResetIndex(slot_num, rw, populate)) 
+        {
+            return true;
+        }
+
+        if (!rw) 
+        {
+            return false;
+        }
+
+        // a magic of 0 is a file that was never written to, e.g. one 
+        // staged ahead of rotation, it is all zero and can be used as is
+        bool zeroed = (NULL != head_ && 0 == head_->magic);
+
+        if (mptr_) 
+        {
+            munmap(mptr_, byte_size_);
+            mptr_ = NULL;
+            head_ = NULL;
+        }
+        close(fd_);
+        fd_ = -1;
+
+        return NewIndex(slot_num, zeroed);
+    }
+
+    return rw ? NewIndex(slot_num, false) : false;
+}
+
+int64_t UidIndex::ByteSize(int64_t slot_num)
+{
+    return sizeof(uidx_head_t) 
+        + sizeof(uidx_bucket_t) * bucket_num_of(slot_num)
+        + sizeof(int64_t) * slot_num * 2;
+}
+
+bool UidIndex::NewIndex(int64_t slot_num, bool zeroed)
+{
+    // otherwise a foreign or torn file, start over
+    if (!zeroed) 
+    {
+        unlink(path_name_.c_str());
+    }
+
+    fd_ = open(path_name_.c_str(), O_CREAT | O_RDWR, 0744);
+    if (fd_ < 0) 
+    {
+        return false;
+    }
+
+    if (-1 == ftruncate(fd_, byte_size_)) 
+    {
+        return false;
+    }
+
+    void *mptr = mmap(NULL, byte_size_, PROT_READ | PROT_WRITE, 
+        MAP_SHARED | MAP_POPULATE, fd_, 0);
+    if (MAP_FAILED == mptr) 
+    {
+        return false;
+    }
+
+    mptr_ = (char *)mptr;
+    head_ = (uidx_head_t *)mptr_;
+    buckets_ = (uidx_bucket_t *)(mptr_ + sizeof(uidx_head_t));
+    bucket_mask_ = bucket_num_of(slot_num) - 1;
+    next_ = (int64_t *)(buckets_ + bucket_mask_ + 1);
+    version_ = next_ + slot_num;
+
+    head_->bucket_num = bucket_mask_ + 1;
+    head_->slot_num = slot_num;
+    head_->uid_num = 0;
+    head_->checkpoint = 0;
+    __atomic_store_n(&head_->magic, UIDX_MAGIC, __ATOMIC_RELEASE);
+
+    is_new_ = true;
+
+    return true;
+}
+
+bool UidIndex::ResetIndex(int64_t slot_num, bool rw, bool populate)
+{
+    fd_ = open(path_name_.c_str(), (rw ? O_RDWR : O_RDONLY), 0744);
+    if (fd_ < 0) 
+    {
+        return false;
+    }
+
+    void *mptr = mmap(NULL, byte_size_, 
+        (rw ? (PROT_READ | PROT_WRITE) : PROT_READ), 
+        MAP_SHARED | (populate ? MAP_POPULATE : 0), fd_, 0);
+    if (MAP_FAILED == mptr) 
+    {
+        return false;
+    }
+
+    mptr_ = (char *)mptr;
+    head_ = (uidx_head_t *)mptr_;
+    buckets_ = (uidx_bucket_t *)(mptr_ + sizeof(uidx_head_t));
+    bucket_mask_ = bucket_num_of(slot_num) - 1;
+    next_ = (int64_t *)(buckets_ + bucket_mask_ + 1);
+    version_ = next_ + slot_num;
+
+    if (UIDX_MAGIC != __atomic_load_n(&head_->magic, __ATOMIC_ACQUIRE) 
+        || head_->bucket_num != bucket_mask_ + 1 
+        || head_->slot_num != slot_num) 
+    {
+        return false;
+    }
+
+    is_new_ = false;
+
+    return true;
+}
+
+uint64_t UidIndex::UidHash(const string &uid)
+{
+    uint64_t h[2];
+    Hash::Murmur3_128(uid.c_str(), uid.size(), 0, h);
+
+    // 0 marks an empty bucket, UIDX_TOMB one given up
+    return (0 == h[0] || UIDX_TOMB == h[0]) ? 1 : h[0];
+}
+
+int64_t UidIndex::Find(const string &uid)
+{
+    return Find(UidHash(uid));
+}
+
+int64_t UidIndex::Find(uint64_t key)
+{
+    int64_t idx = key & bucket_mask_;
+
+    for (int64_t i = 0; i <= bucket_mask_; i++) 
+    {
+        uidx_bucket_t *b = buckets_ + idx;
+        uint64_t k = __atomic_load_n(&b->key, __ATOMIC_ACQUIRE);
+        if (0 == k) 
+        {
+            return -1;
+        }
+
+        if (k == key) 
+        {
+            return __atomic_load_n(&b->head, __ATOMIC_ACQUIRE) - 1;
+        }
+
+        idx = (idx + 1) & bucket_mask_;
+    }
+
+    return -1;
+}
+
+int64_t UidIndex::Next(int64_t slot)
+{
+    if (slot < 0 || slot >= head_->slot_num) 
+    {
+        return -1;
+    }
+
+    return __atomic_load_n(next_ + slot, __ATOMIC_ACQUIRE) - 1;
+}
+
+bool UidIndex::Contains(const string &uid, int64_t slot)
+{
+    return Contains(UidHash(uid), slot);
+}
+
+bool UidIndex::Contains(uint64_t key, int64_t slot)
+{
+    for (int64_t s = Find(key); s >= 0; s = Next(s)) 
+    {
+        if (s == slot) 
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool UidIndex::Insert(const string &uid, int64_t slot)
+{
+    return Insert(UidHash(uid), slot);
+}
+
+bool UidIndex::Insert(uint64_t key, int64_t slot)
+{
+    if (slot < 0 || slot >= head_->slot_num) 
+    {
+        return false;
+    }
+
+    int64_t idx = key & bucket_mask_;
+    uidx_bucket_t *tomb = NULL;
+
+    for (int64_t i = 0; i <= bucket_mask_; i++) 
+    {
+        uidx_bucket_t *b = buckets_ + idx;
+        uint64_t k = __atomic_load_n(&b->key, __ATOMIC_ACQUIRE);
+        if (UIDX_TOMB == k && NULL == tomb) 
+        {
+            tomb = b;
+        }
+
+        // a new uid, the first bucket given up on the way is taken first
+        if (0 == k && NULL != tomb) 
+        {
+            if (__sync_bool_compare_and_swap(&tomb->key, UIDX_TOMB, key)) 
+            {
+                __sync_fetch_and_add(&head_->uid_num, 1);
+            } 
+            else if (__atomic_load_n(&tomb->key, __ATOMIC_ACQUIRE) != key) 
+            {
+                // taken by another uid meanwhile, probe again
+                idx = key & bucket_mask_;
+                tomb = NULL;
+                i = -1;
+                continue;
+            }
+            b = tomb;
+            k = key;
+        }
+
+        if (0 == k) 
+        {
+            if (__sync_bool_compare_and_swap(&b->key, 0, key)) 
+            {
+                __sync_fetch_and_add(&head_->uid_num, 1);
+                k = key;
+            } 
+            else 
+            {
+                k = __atomic_load_n(&b->key, __ATOMIC_ACQUIRE);
+            }
+        }
+
+        if (k == key) 
+        {
+            // lock-free push of slot in front of the chain. A slot may 
+            // be pushed by its owner and by a rebuild at once, pushed 
+            // twice it would point at itself: each try first looks for 
+            // it in the chain, and next is only set by CAS from what was 
+            // read before the head, so a try that lost to a push of the 
+            // same slot can't change its link any more.
+            while (true) 
+            {
+                int64_t next = __atomic_load_n(next_ + slot, __ATOMIC_ACQUIRE);
+                int64_t head = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+                for (int64_t s = head - 1; s >= 0; s = Next(s)) 
+                {
+                    if (s == slot) 
+                    {
+                        return true;
+                    }
+                }
+
+                if (__sync_bool_compare_and_swap(next_ + slot, next, head) 
+                    && __sync_bool_compare_and_swap(&b->head, head, slot + 1)) 
+                {
+                    return true;
+                }
+            }
+        }
+
+        idx = (idx + 1) & bucket_mask_;
+    }
+
+    return false;
+}
+
+bool UidIndex::Remove(uint64_t key, int64_t slot, int64_t &prev)
+{
+    prev = -1;
+    if (slot < 0 || slot >= head_->slot_num) 
+    {
+        return false;
+    }
+
+    int64_t idx = key & bucket_mask_;
+    uidx_bucket_t *b = NULL;
+    for (int64_t i = 0; i <= bucket_mask_; i++) 
+    {
+        uint64_t k = __atomic_load_n(&buckets_[idx].key, __ATOMIC_ACQUIRE);
+        if (0 == k) 
+        {
+            return false;
+        }
+
+        if (k == key) 
+        {
+            b = buckets_ + idx;
+            break;
+        }
+
+        idx = (idx + 1) & bucket_mask_;
+    }
+
+    if (NULL == b) 
+    {
+        return false;
+    }
+
+    // the head moves on unless a push got in front of the slot, then 
+    // the slot before it skips it
+    int64_t next = __atomic_load_n(next_ + slot, __ATOMIC_ACQUIRE);
+    if (!__sync_bool_compare_and_swap(&b->head, slot + 1, next)) 
+    {
+        prev = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE) - 1;
+        while (prev >= 0 && Next(prev) != slot) 
+        {
+            prev = Next(prev);
+        }
+
+        if (prev < 0) 
+        {
+            return false;
+        }
+        __atomic_store_n(next_ + prev, next, __ATOMIC_RELEASE);
+    }
+
+    if (0 != __atomic_load_n(&b->head, __ATOMIC_ACQUIRE)) 
+    {
+        return true;
+    }
+
+    // a lookup passes a given up bucket by, the ones at the end of a 
+    // run of buckets are emptied so lookups of new uids stop early
+    __atomic_store_n(&b->key, UIDX_TOMB, __ATOMIC_RELEASE);
+    __sync_fetch_and_sub(&head_->uid_num, 1);
+    while (UIDX_TOMB == __atomic_load_n(&buckets_[idx].key, __ATOMIC_ACQUIRE) 
+        && 0 == __atomic_load_n(&buckets_[(idx + 1) & bucket_mask_].key, 
+        __ATOMIC_ACQUIRE)) 
+    {
+        __sync_bool_compare_and_swap(&buckets_[idx].key, UIDX_TOMB, 0);
+        idx = (idx - 1) & bucket_mask_;
+    }
+
+    return true;
+}
+
+void UidIndex::Touch(int64_t slot, int64_t ver)
+{
+    if (slot < 0 || slot >= head_->slot_num) 
+    {
+        return;
+    }
+
+    int64_t old = __atomic_load_n(version_ + slot, __ATOMIC_RELAXED);
+    while (old < ver 
+        && !__atomic_compare_exchange_n(version_ + slot, &old, ver, false, 
+        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) 
+    {
+    }
+}
+
+int64_t UidIndex::GetVersion(int64_t slot)
+{
+    if (slot < 0 || slot >= head_->slot_num) 
+    {
+        return 0;
+    }
+
+    return __atomic_load_n(version_ + slot, __ATOMIC_ACQUIRE);
+}
+
+void UidIndex::Unlink()
+{
+    if (need_delete_) 
+    {
+        unlink(path_name_.c_str());
+    }
+}
+
+void UidIndex::Sync2File()
+{
+    if (!need_flush_ || NULL == mptr_) 
+    {
+        return;
+    }
+
+    msync(mptr_, byte_size_, MS_SYNC);
+}
+
+int64_t UidIndex::SyncRange(char *ptr, int64_t len)
+{
+    int64_t page = sysconf(_SC_PAGESIZE);
+    int64_t off = (ptr - mptr_) / page * page;
+    len += (ptr - mptr_) - off;
+    msync(mptr_ + off, len, MS_SYNC);
+
+    return len;
+}
+
+int64_t UidIndex::SyncSlots(int64_t begin, int64_t end)
+{
+    if (!need_flush_ || NULL == mptr_ || begin >= end) 
+    {
+        return 0;
+    }
+
+    return SyncRange((char *)(next_ + begin), sizeof(int64_t) * (end - begin))
+        + SyncRange((char *)(version_ + begin), 
+        sizeof(int64_t) * (end - begin));
+}
+
+int64_t UidIndex::SyncBuckets()
+{
+    if (!need_flush_ || NULL == mptr_) 
+    {
+        return 0;
+    }
+
+    return SyncRange(mptr_, (char *)next_ - mptr_);
+}
+
+void UidIndex::Checkpoint(int64_t slot_num)
+{
+    if (NULL == head_ || slot_num <= GetCheckpoint()) 
+    {
+        return;
+    }
+
+    __atomic_store_n(&head_->checkpoint, slot_num, __ATOMIC_RELEASE);
+    msync(mptr_, sysconf(_SC_PAGESIZE), MS_SYNC);
+}
+
+int64_t UidIndex::GetCheckpoint()
+{
+    return __atomic_load_n(&head_->checkpoint, __ATOMIC_ACQUIRE);
+}
+
+void UidIndex::StartFlush()
+{
+    need_flush_ = true;
+}
+
+void UidIndex::StopFlush()
+{
+    need_flush_ = false;
+}
+
+void UidIndex::SetDelete(bool del)
+{
+    need_delete_ = del;
+}
+
+bool UidIndex::IsNew()
+{
+    return is_new_;
+}
+
+int64_t UidIndex::GetUidNum()
+{
+    return head_ ? __atomic_load_n(&head_->uid_num, __ATOMIC_RELAXED) : 0;
+}
+
+string UidIndex::GetFileName()
+{
+    return path_name_;
+}
+
+NAME_SPACE_ES
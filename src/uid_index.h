@@ -0,0 +1,126 @@
+#ifndef UID_INDEX_H
+#define UID_INDEX_H
+
+#include <boost/shared_ptr.hpp>
+#include <string>
+#include "common.h"
+
+using namespace std;
+
+NAME_SPACE_BS
+
+// Per day uid -> slots table shared by all processes through a mapped 
+// .uidx_ file. Open addressing with linear probing over 64 bit uid 
+// hashes, the slots of one uid are chained newest first through a 
+// per slot next array. Buckets are claimed and chains pushed with CAS, 
+// so every process inserts in place and readers never lock.
+//
+// file: uidx_head_t | uidx_bucket_t[bucket_num] | int64_t next[slot_num]
+//     | int64_t version[slot_num]
+// head and next hold slot + 1, 0 ends a chain. version is the ms time 
+// of the last Add into the slot, the delta export compares against it. 
+// A bucket whose uid lost its last slot keeps UIDX_TOMB until a new uid 
+// takes it. The file is the image of the table, opening it costs 
+// nothing. The slots below checkpoint were written back with their 
+// inserts, loading only has to look at the ones past it.
+
+#define UIDX_MAGIC 0x3158444955464253LL
+// the key of a bucket whose uid has no slot left, see Remove
+#define UIDX_TOMB 0xffffffffffffffffULL
+
+typedef struct uidx_head_s 
+{
+    int64_t magic;
+    int64_t bucket_num;
+    int64_t slot_num;
+    int64_t uid_num;
+    int64_t checkpoint;
+} uidx_head_t;
+
+typedef struct uidx_bucket_s 
+{
+    uint64_t key;
+    int64_t head;
+} uidx_bucket_t;
+
+class UidIndex
+{
+public:
+    UidIndex();
+    virtual ~UidIndex();
+
+    // opens fname, or creates it when missing or not matching slot_num, 
+    // IsNew() tells the caller to refill it. populate faults the whole 
+    // file in up front.
+    bool Init(int64_t slot_num, string fname, bool rw = true, 
+        bool populate = true);
+
+    // newest slot of uid, -1 if none
+    int64_t Find(const string &uid);
+    // the same by UidHash(uid), as the .idx_ slots keep it
+    int64_t Find(uint64_t key);
+    // the slot of the same uid allocated before slot, -1 at the end
+    int64_t Next(int64_t slot);
+    // pushes slot in front of the chain of uid, a slot already in it 
+    // stays where it is
+    bool Insert(const string &uid, int64_t slot);
+    bool Insert(uint64_t key, int64_t slot);
+    // unlinks slot from the chain of key, prev is the slot whose link 
+    // changed, -1 if it was the head. A uid left without slots gives its 
+    // bucket up. Lookups and pushes onto chains may run meanwhile, a 
+    // Remove and an Insert of a new uid must not (SliceMgr holds its 
+    // lock for both), the slot's own link stays for readers on it.
+    bool Remove(uint64_t key, int64_t slot, int64_t &prev);
+    // slot is in the chain of uid
+    bool Contains(const string &uid, int64_t slot);
+    bool Contains(uint64_t key, int64_t slot);
+    // raises the version of slot to ver, never lowers it
+    void Touch(int64_t slot, int64_t ver);
+    int64_t GetVersion(int64_t slot);
+
+    void Sync2File();
+    // marks the slots below slot_num as written back, the caller has 
+    // synced them, never lowers it
+    void Checkpoint(int64_t slot_num);
+    int64_t GetCheckpoint();
+    // next and version of the slots in [begin, end), returns the bytes 
+    // covered
+    int64_t SyncSlots(int64_t begin, int64_t end);
+    // head and buckets, only the pages new uids went to are written
+    int64_t SyncBuckets();
+    void StartFlush();
+    void StopFlush();
+    void SetDelete(bool del);
+    bool IsNew();
+    int64_t GetUidNum();
+    string GetFileName();
+
+    static uint64_t UidHash(const string &uid);
+    static int64_t ByteSize(int64_t slot_num);
+
+private:
+    bool NewIndex(int64_t slot_num, bool zeroed);
+    bool ResetIndex(int64_t slot_num, bool rw, bool populate);
+    int64_t SyncRange(char *ptr, int64_t len);
+    void Unlink();
+
+private:
+    int64_t byte_size_;
+    int64_t bucket_mask_;
+    int fd_;
+    bool is_new_;
+    bool need_flush_;
+    bool need_delete_;
+    char *mptr_;
+    uidx_head_t *head_;
+    uidx_bucket_t *buckets_;
+    int64_t *next_;
+    int64_t *version_;
+    string path_name_;
+};
+
+typedef boost::shared_ptr<UidIndex> UidIndexPtr;
+
+NAME_SPACE_ES
+
+#endif
@@ -1,4 +1,14 @@
 #include "util.h"
+#include <sys/time.h>
+#include <sys/types.h>
+#include <signal.h>
+#include <sched.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sstream>
+
+// failed tries on a held lock between two checks of its owner
+#define PID_LOCK_CHECK 1024
 
 NAME_SPACE_BS
 
@@ -10,5 +20,48 @@ string get_param(const map<string, string> &params,
     return ite != params.end() ? ite->second : default_value;
 }
 
+int64_t now_ms()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+string day_name(time_t t)
+{
+    struct tm tmstru;
+    localtime_r(&t, &tmstru);
+    stringstream ss;    
+    ss << tmstru.tm_year + 1900 << tmstru.tm_mon + 1 << tmstru.tm_mday
+        << tmstru.tm_hour;
+
+    return ss.str();
+}
+
+void pid_lock(int32_t *owner)
+{
+    int32_t pid = getpid();
+    for (int64_t tries = 1; !__sync_bool_compare_and_swap(owner, 0, pid);
+        tries++) 
+    {
+        if (0 == tries % PID_LOCK_CHECK) 
+        {
+            int32_t holder = __atomic_load_n(owner, __ATOMIC_ACQUIRE);
+            if (0 != holder && 0 != kill(holder, 0) && ESRCH == errno 
+                && __sync_bool_compare_and_swap(owner, holder, pid)) 
+            {
+                return;
+            }
+        }
+        sched_yield();
+    }
+}
+
+void pid_unlock(int32_t *owner)
+{
+    __atomic_store_n(owner, 0, __ATOMIC_RELEASE);
+}
+
 NAME_SPACE_ES
 
@@ -1,6 +1,7 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <time.h>
 #include "common.h"
 
 using namespace std;
@@ -26,6 +27,16 @@ enum Errno
 string get_param(const map<string, string> &params,
     const string &key, string defalut_value = "");
 
+int64_t now_ms();
+
+// days are named by the local hour they were created in
+string day_name(time_t t);
+
+// a spin lock in shared memory between processes, owner holds the pid 
+// of the holder, 0 for none. A lock left by a dead process is taken over.
+void pid_lock(int32_t *owner);
+void pid_unlock(int32_t *owner);
+
 NAME_SPACE_ES
 
 #endif
@@ -0,0 +1,219 @@
+#include "vid_log.h"
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// the hash values are kept to 63 bits, see Hash::CalcHash
+#define VLOG_HASH_MASK 0x7FFFFFFFFFFFFFFFULL
+
+NAME_SPACE_BS
+
+VidLog::VidLog()
+{
+    fd_ = -1;
+    byte_size_ = 0;
+    need_delete_ = false;
+    mptr_ = NULL;
+    head_ = NULL;
+    recs_ = NULL;
+    synced_ = 0;
+}
+
+VidLog::~VidLog()
+{
+    if (mptr_) 
+    {
+        munmap(mptr_, byte_size_);
+        mptr_ = NULL;
+    }
+
+    if (fd_ > 0) 
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+
+    if (need_delete_) 
+    {
+        unlink(path_name_.c_str());
+    }
+}
+
+bool VidLog::Init(const string &fname, int64_t cap, bool rw)
+{
+    path_name_ = fname;
+    int64_t page = sysconf(_SC_PAGESIZE);
+
+    bool fresh = (cap > 0 && rw && 0 != access(fname.c_str(), F_OK));
+    fd_ = open(fname.c_str(), 
+        fresh ? (O_CREAT | O_RDWR) : (rw ? O_RDWR : O_RDONLY), 0744);
+    if (fd_ < 0) 
+    {
+        return false;
+    }
+
+    if (fresh) 
+    {
+        byte_size_ = page + sizeof(vid_rec_t) * cap;
+        if (-1 == ftruncate(fd_, byte_size_)) 
+        {
+            return false;
+        }
+    }
+    else 
+    {
+        struct stat sb;
+        if (0 != fstat(fd_, &sb) || sb.st_size < page) 
+        {
+            return false;
+        }
+        byte_size_ = sb.st_size;
+    }
+
+    // records are faulted in as they are written, never up front
+    void *mptr = mmap(NULL, byte_size_, 
+        (rw ? (PROT_READ | PROT_WRITE) : PROT_READ), MAP_SHARED, fd_, 0);
+    if (MAP_FAILED == mptr) 
+    {
+        return false;
+    }
+
+    mptr_ = (char *)mptr;
+    head_ = (vlog_head_t *)mptr_;
+    recs_ = (vid_rec_t *)(mptr_ + page);
+
+    if (fresh) 
+    {
+        head_->cap = cap;
+        head_->counter = 0;
+        __atomic_store_n(&head_->magic, VLOG_MAGIC, __ATOMIC_RELEASE);
+    }
+
+    if (VLOG_MAGIC != __atomic_load_n(&head_->magic, __ATOMIC_ACQUIRE) 
+        || byte_size_ != page + (int64_t)sizeof(vid_rec_t) * head_->cap) 
+    {
+        return false;
+    }
+    synced_ = GetNum();
+
+    return true;
+}
+
+bool VidLog::Append(int64_t slot, const vector<vid_key_t> &keys)
+{
+    if (keys.empty()) 
+    {
+        return true;
+    }
+
+    int64_t pos = __sync_fetch_and_add(&head_->counter, (int64_t)keys.size());
+    if (pos + (int64_t)keys.size() > head_->cap) 
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < keys.size(); i++) 
+    {
+        vid_rec_t *rec = recs_ + pos + i;
+        rec->key = keys[i].key;
+        rec->step = keys[i].step;
+        __atomic_store_n(&rec->slot, (uint32_t)(slot + 1), __ATOMIC_RELEASE);
+    }
+
+    return true;
+}
+
+bool VidLog::Get(int64_t i, int64_t &slot, vid_key_t &key)
+{
+    const vid_rec_t *rec = recs_ + i;
+    uint32_t s = __atomic_load_n(&rec->slot, __ATOMIC_ACQUIRE);
+    if (0 == s) 
+    {
+        return false;
+    }
+
+    slot = s - 1;
+    key.key = rec->key;
+    key.step = rec->step;
+
+    return true;
+}
+
+int64_t VidLog::GetNum()
+{
+    int64_t num = __atomic_load_n(&head_->counter, __ATOMIC_ACQUIRE);
+
+    return num < head_->cap ? num : head_->cap;
+}
+
+bool VidLog::IsFull()
+{
+    return __atomic_load_n(&head_->counter, __ATOMIC_ACQUIRE) > head_->cap;
+}
+
+void VidLog::Sync2File()
+{
+    if (mptr_) 
+    {
+        msync(mptr_, byte_size_, MS_SYNC);
+    }
+}
+
+int64_t VidLog::SyncNew()
+{
+    int64_t num = GetNum();
+    int64_t bytes = SyncRange(mptr_, sizeof(vlog_head_t)) 
+        + SyncRange((char *)(recs_ + synced_), 
+            sizeof(vid_rec_t) * (num - synced_));
+    synced_ = num;
+
+    return bytes;
+}
+
+int64_t VidLog::SyncRange(char *ptr, int64_t len)
+{
+    if (len <= 0) 
+    {
+        return 0;
+    }
+
+    int64_t page = sysconf(_SC_PAGESIZE);
+    char *begin = mptr_ + (ptr - mptr_) / page * page;
+    msync(begin, ptr + len - begin, MS_SYNC);
+
+    return ptr + len - begin;
+}
+
+void VidLog::SetDelete(bool del)
+{
+    need_delete_ = del;
+}
+
+string VidLog::GetFileName()
+{
+    return path_name_;
+}
+
+// hashs[i] = (h0 + i * h1) & mask, the mask keeps it a ring
+vid_key_t VidLog::KeyOf(const vector<int64_t> &hashs)
+{
+    vid_key_t key;
+    key.key = hashs[0];
+    key.step = (hashs.size() > 1) 
+        ? ((uint64_t)hashs[1] - (uint64_t)hashs[0]) & VLOG_HASH_MASK : 0;
+
+    return key;
+}
+
+void VidLog::HashsOf(const vid_key_t &key, int hash_num, 
+    vector<int64_t> &hashs) 
+{
+    for (int i = 0; i < hash_num; i++) 
+    {
+        hashs.push_back((int64_t)((key.key + i * key.step) & VLOG_HASH_MASK));
+    }
+}
+
+NAME_SPACE_ES
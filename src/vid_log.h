@@ -0,0 +1,97 @@
+#ifndef VID_LOG_H
+#define VID_LOG_H
+
+#include <boost/shared_ptr.hpp>
+#include <string>
+#include <vector>
+#include "common.h"
+
+using namespace std;
+
+NAME_SPACE_BS
+
+// Per day log of the hashed vids added to each slot, shared by all 
+// processes through a mapped .vlog_ file, what a closed day is frozen 
+// from (see FrozenDay). A vid is kept as its double hash base: key is 
+// the first hash value and step the distance to the next, the k values 
+// of any tier are key + i * step, so the bloom bits of a slot can be set 
+// again from its records. 
+// 
+// file: vlog_head_t (one page) | vid_rec_t rec[cap] 
+// Every process takes records with an atomic fetch-add on the counter 
+// and stores slot + 1 last, a reader treats 0 as "taken but not yet 
+// written". The file is sparse, only the records written take blocks. 
+// A counter past cap means adds were lost, the day can't be frozen.
+
+#define VLOG_MAGIC 0x31474f4c44495653LL
+
+typedef struct vlog_head_s 
+{
+    int64_t magic;
+    int64_t cap;
+    int64_t counter;
+} vlog_head_t;
+
+typedef struct vid_key_s 
+{
+    uint64_t key;
+    uint64_t step;
+} vid_key_t;
+
+#pragma pack(push, 4)
+typedef struct vid_rec_s 
+{
+    uint64_t key;
+    uint64_t step;
+    uint32_t slot;
+} vid_rec_t;
+#pragma pack(pop)
+
+class VidLog
+{
+public:
+    VidLog();
+    virtual ~VidLog();
+
+    // opens fname, or creates it for cap records when cap > 0 and it is 
+    // missing
+    bool Init(const string &fname, int64_t cap = 0, bool rw = true);
+
+    // false once the log is full
+    bool Append(int64_t slot, const vector<vid_key_t> &keys);
+    // record i of the GetNum() taken, false if it was never written
+    bool Get(int64_t i, int64_t &slot, vid_key_t &key);
+    int64_t GetNum();
+    bool IsFull();
+
+    void Sync2File();
+    // the head and the records taken since the last call, returns the 
+    // bytes covered
+    int64_t SyncNew();
+    void SetDelete(bool del);
+    string GetFileName();
+
+    // of the hash values of a vid, hDouble only
+    static vid_key_t KeyOf(const vector<int64_t> &hashs);
+    static void HashsOf(const vid_key_t &key, int hash_num, 
+        vector<int64_t> &hashs);
+
+private:
+    int64_t SyncRange(char *ptr, int64_t len);
+
+private:
+    int fd_;
+    int64_t byte_size_;
+    bool need_delete_;
+    char *mptr_;
+    vlog_head_t *head_;
+    vid_rec_t *recs_;
+    int64_t synced_;
+    string path_name_;
+};
+
+typedef boost::shared_ptr<VidLog> VidLogPtr;
+
+NAME_SPACE_ES
+
+#endif
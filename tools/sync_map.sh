@@ -1,4 +1,13 @@
 #!/bin/sh
 
-curl -d "sync" "http://127.0.0.1:10018/sbf/sync"
+# the flush runs in the master, wait until it has written back our gen
+gen=`curl -s -d "sync" "http://127.0.0.1:10018/sbf/sync" \
+    | grep -o '"gen" *: *"*[0-9]*' | grep -o '[0-9]*$'`
+if [ -z "$gen" ]; then
+    exit 1
+fi
 
+while ! curl -s "http://127.0.0.1:10018/sbf/sync?gen=$gen" \
+    | grep -q '"synced"'; do
+    sleep 1
+done